@@ -10,6 +10,24 @@
 #define WGS84_B 6356.752314245 // semi-minor axis (km)
 #define WGS84_E2 ((WGS84_A * WGS84_A - WGS84_B * WGS84_B) / (WGS84_A * WGS84_A)) // eccentricity^2
 
+// ECEF positions in km need double precision, a float is only good to about
+// half a meter at Earth radius.
+typedef union {
+    struct {
+        double x, y, z;
+    };
+    double raw[3];
+} dvec3s;
+
+static inline dvec3s dvec3_add_scaled(dvec3s a, vec3s dir, double s) {
+    return (dvec3s){{a.x + dir.x * s, a.y + dir.y * s, a.z + dir.z * s}};
+}
+
+static inline vec3s dvec3_to_vec3(dvec3s a) { return (vec3s){{a.x, a.y, a.z}}; }
+
+// glm_rad() works in float, which is off by up to a meter at Earth radius
+static inline double deg2rad(double deg) { return deg * (M_PI / 180.0); }
+
 vec3s geodetic_to_ecef(double lat, double lon, double h) {
     double sinLat = sin(lat);
     double cosLat = cos(lat);
@@ -26,13 +44,24 @@ vec3s geodetic_to_ecef(double lat, double lon, double h) {
     return ecef;
 }
 
-void ecef_to_geodetic(vec3s ecef, double *lat, double *lon, double *h) {
+// Double precision variant for positions that must survive at Earth scale.
+void geodetic_to_ecef_d(double lat, double lon, double h, double ecef[3]) {
+    double sinLat = sin(lat);
+    double cosLat = cos(lat);
+    double N = WGS84_A / sqrt(1.0 - WGS84_E2 * sinLat * sinLat);
+
+    ecef[0] = (N + h) * cosLat * cos(lon);
+    ecef[1] = (N + h) * cosLat * sin(lon);
+    ecef[2] = ((1.0 - WGS84_E2) * N + h) * sinLat;
+}
+
+void ecef_to_geodetic(dvec3s ecef, double *lat, double *lon, double *h) {
     double a = WGS84_A;
     double e2 = WGS84_E2;
 
-    float X = ecef.x;
-    float Y = ecef.y;
-    float Z = ecef.z;
+    double X = ecef.x;
+    double Y = ecef.y;
+    double Z = ecef.z;
 
     *lon = atan2(Y, X);
 
@@ -53,23 +82,23 @@ void ecef_to_geodetic(vec3s ecef, double *lat, double *lon, double *h) {
     double V = sqrt((r - e2 * r0) * (r - e2 * r0) + (1.0 - e2) * Z * Z);
     double z0 = (a * a * (1.0 - e2) * Z) / (a * V);
 
-    *lat = atan2(Z + z0 * e2, r);
+    // the latitude correction is scaled by the second eccentricity e'^2 = e^2 / (1 - e^2)
+    *lat = atan2(Z + z0 * e2 / (1.0 - e2), r);
 
-    double sinLat = sin(*lat);
-    double N = a / sqrt(1.0 - e2 * sinLat * sinLat);
-
-    *h = r / cos(*lat) - N;
+    // unlike r / cos(lat) - N this holds up at the poles
+    *h = U * (1.0 - (1.0 - e2) * a / V);
 }
 
 struct aircraft_state {
     double lat, lon, height;
     float max_speed, throttle;
-    vec3s pos, forward, up, right;
+    dvec3s pos;
+    vec3s forward, up, right;
 };
 
 void aircraft_update(struct aircraft_state *ac, float dt) {
     float d = ac->throttle * ac->max_speed * dt / 1000; // meters traveled
-    ac->pos = glms_vec3_add(ac->pos, glms_vec3_scale(ac->forward, d));
+    ac->pos = dvec3_add_scaled(ac->pos, ac->forward, d);
 }
 
 void aircraft_pitch(struct aircraft_state *a, float rad) {
@@ -87,4 +116,31 @@ void aircraft_yaw(struct aircraft_state *a, float rad) {
     a->right = glms_vec3_normalize(glms_vec3_rotate(a->right, rad, a->up));
 }
 
+// Place the aircraft at lat, lon in degrees and height in km, with heading,
+// pitch and roll in degrees.
+void aircraft_set_pose(struct aircraft_state *ac, double lat, double lon, double height,
+                       double heading, double pitch, double roll) {
+    double phi = deg2rad(lat), lam = deg2rad(lon);
+    double p[3];
+    geodetic_to_ecef_d(phi, lam, height, p);
+    ac->pos = (dvec3s){{p[0], p[1], p[2]}};
+    ac->lat = phi;
+    ac->lon = lam;
+    ac->height = height;
+
+    vec3s east = {{-sin(lam), cos(lam), 0}};
+    vec3s north = {{-sin(phi) * cos(lam), -sin(phi) * sin(lam), cos(phi)}};
+    vec3s up = {{cos(phi) * cos(lam), cos(phi) * sin(lam), sin(phi)}};
+    float h = deg2rad(heading), th = deg2rad(pitch), r = deg2rad(roll);
+    vec3s level = glms_vec3_add(glms_vec3_scale(north, cosf(h)), glms_vec3_scale(east, sinf(h)));
+    vec3s right = glms_vec3_sub(glms_vec3_scale(east, cosf(h)), glms_vec3_scale(north, sinf(h)));
+    ac->forward = glms_vec3_add(glms_vec3_scale(level, cosf(th)), glms_vec3_scale(up, sinf(th)));
+    vec3s body_up =
+        glms_vec3_sub(glms_vec3_scale(up, cosf(th)), glms_vec3_scale(level, sinf(th)));
+    // positive roll drops the right wing
+    ac->right =
+        glms_vec3_sub(glms_vec3_scale(right, cosf(r)), glms_vec3_scale(body_up, sinf(r)));
+    ac->up = glms_vec3_add(glms_vec3_scale(body_up, cosf(r)), glms_vec3_scale(right, sinf(r)));
+}
+
 #endif
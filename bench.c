@@ -0,0 +1,667 @@
+// Offline benchmarks of the non-GL modules.
+//
+//   bench codec [file.tdb]   tile compression ratio and decode speed
+//   bench geodesy            batched coordinate conversion speed and error
+//   bench terrain [file.tdb] height queries, the SIMD path checked against scalar
+//   bench los [file.tdb]     ray casts against the terrain, checked by brute force
+//   bench overlay [file.csv] gathering obstacles and airports near the aircraft
+//
+// Without a database the codec, terrain and los benchmarks run on synthetic fractal
+// terrain, and without a file the overlay benchmark on random features over
+// the same terrain.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "geodesy.h"
+#include "los.h"
+#include "overlay.h"
+#include "tdb.h"
+#include "terrain.h"
+
+#define BENCH_TILE_RES 1200
+#define BENCH_MIN_SECONDS 0.5
+#define BENCH_POINTS 65536
+#define BENCH_RAYS 4096
+#define BENCH_CHECKED_RAYS 512 // against the brute-force march, which is slow
+#define BENCH_REF_STEP 0.002   // km between brute-force samples
+#define BENCH_FEATURES 300000
+#define BENCH_OVERLAY_RANGE 40 // km
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint32_t bench_rand(uint32_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+// Value noise octaves, roughly the roughness of 90 m mountain terrain, with
+// everything below sea level flagged as water.
+static int16_t *synthetic_tile(int res, uint32_t seed) {
+    int16_t *tile = malloc(sizeof(int16_t) * res * res);
+    float *h = calloc((size_t)res * res, sizeof(float));
+    float amp = 800;
+    for (int cell = res / 4; cell >= 1; cell /= 2, amp *= 0.5f) {
+        int n = res / cell + 2;
+        float *lattice = malloc(sizeof(float) * n * n);
+        for (int i = 0; i < n * n; i++)
+            lattice[i] = (bench_rand(&seed) / 4294967296.0f - 0.5f) * 2 * amp;
+        for (int y = 0; y < res; y++) {
+            for (int x = 0; x < res; x++) {
+                float fx = (float)x / cell, fy = (float)y / cell;
+                int ix = fx, iy = fy;
+                fx -= ix;
+                fy -= iy;
+                float a = lattice[iy * n + ix] + (lattice[iy * n + ix + 1] - lattice[iy * n + ix]) * fx;
+                float b = lattice[(iy + 1) * n + ix] +
+                          (lattice[(iy + 1) * n + ix + 1] - lattice[(iy + 1) * n + ix]) * fx;
+                h[(size_t)y * res + x] += a + (b - a) * fy;
+            }
+        }
+        free(lattice);
+    }
+    for (size_t i = 0; i < (size_t)res * res; i++) {
+        int height = h[i] + 300;
+        tile[i] = height > 0 ? height * 2 : 1; // water at sea level
+    }
+    free(h);
+    return tile;
+}
+
+static int bench_codec(int argc, char *argv[]) {
+    struct tdb db = {.fd = -1};
+    size_t num_tiles = 4;
+    if (argc > 0) {
+        if (!tdb_open(&db, argv[0]))
+            return 1;
+        num_tiles = db.num_tiles;
+    }
+
+    uint64_t raw_bytes = 0, packed_bytes = 0;
+    double decode_time = 0, copy_time = 0;
+    for (size_t t = 0; t < num_tiles; t++) {
+        int xres = BENCH_TILE_RES, yres = BENCH_TILE_RES;
+        int16_t *tile;
+        if (db.map) {
+            xres = db.entries[t].xres;
+            yres = db.entries[t].yres;
+            tile = malloc((size_t)xres * yres * sizeof(int16_t));
+            if (!tdb_read_tile(&db, t, tile))
+                return 1;
+        } else {
+            tile = synthetic_tile(BENCH_TILE_RES, 0x9e3779b9u * (t + 1));
+        }
+        size_t size = (size_t)xres * yres * sizeof(int16_t);
+        uint8_t *packed = malloc(tdb_encode_bound(xres, yres));
+        size_t packed_size = tdb_encode(tile, xres, yres, packed);
+        int16_t *out = malloc(size);
+
+        if (!tdb_decode(packed, packed_size, xres, yres, out) || memcmp(out, tile, size) != 0) {
+            fprintf(stderr, "codec: tile %zu does not round trip\n", t);
+            return 1;
+        }
+
+        int reps = 0;
+        double start = now(), elapsed;
+        do {
+            tdb_decode(packed, packed_size, xres, yres, out);
+            reps++;
+        } while ((elapsed = now() - start) < BENCH_MIN_SECONDS / num_tiles);
+        decode_time += elapsed / reps;
+
+        reps = 0;
+        start = now();
+        do {
+            memcpy(out, tile, size);
+            __asm__ volatile("" : : "r"(out) : "memory");
+            reps++;
+        } while ((elapsed = now() - start) < BENCH_MIN_SECONDS / num_tiles);
+        copy_time += elapsed / reps;
+
+        raw_bytes += size;
+        packed_bytes += packed_size;
+        free(tile);
+        free(packed);
+        free(out);
+    }
+
+    double ratio = (double)raw_bytes / packed_bytes;
+    double decode_rate = raw_bytes / decode_time;
+    printf("tiles:        %zu (%s)\n", num_tiles, db.map ? argv[0] : "synthetic");
+    printf("raw:          %.2f MB\n", raw_bytes / 1e6);
+    printf("encoded:      %.2f MB, ratio %.2fx, %.2f bits/sample\n", packed_bytes / 1e6, ratio,
+           packed_bytes * 8.0 / (raw_bytes / 2));
+    printf("decode:       %.2f GB/s per core (%.2f ms/tile)\n", decode_rate / 1e9,
+           decode_time / num_tiles * 1e3);
+    printf("memcpy:       %.2f GB/s\n", raw_bytes / copy_time / 1e9);
+    // reading raw takes raw/D, encoded takes raw/(ratio D) + raw/decode_rate
+    printf("break-even:   faster than raw reads below %.0f MB/s of disk bandwidth\n",
+           decode_rate * (1 - 1 / ratio) / 1e6);
+    tdb_close(&db);
+    return 0;
+}
+
+// Horizontal and vertical distance in mm between two geodetic positions.
+static void geodetic_error(double lat0, double lon0, double h0, double lat1, double lon1,
+                           double h1, double *horiz, double *vert) {
+    double dlon = remainder(lon1 - lon0, 2 * M_PI);
+    *horiz = hypot(lat1 - lat0, dlon * cos(lat0)) * (WGS84_A + h0) * 1e6;
+    *vert = fabs(h1 - h0) * 1e6;
+}
+
+static int bench_geodesy(void) {
+    size_t n = BENCH_POINTS;
+    double *lat = malloc(sizeof(double) * n), *lon = malloc(sizeof(double) * n);
+    double *h = malloc(sizeof(double) * n);
+    double *x = malloc(sizeof(double) * n), *y = malloc(sizeof(double) * n);
+    double *z = malloc(sizeof(double) * n);
+    double *ox = malloc(sizeof(double) * n), *oy = malloc(sizeof(double) * n);
+    double *oz = malloc(sizeof(double) * n);
+
+    // anywhere on the globe, poles included, from below sea level to cruise
+    uint32_t seed = 0x2545f491u;
+    for (size_t i = 0; i < n; i++) {
+        lat[i] = (bench_rand(&seed) / 4294967295.0 - 0.5) * M_PI;
+        lon[i] = (bench_rand(&seed) / 4294967296.0 - 0.5) * 2 * M_PI;
+        h[i] = bench_rand(&seed) / 4294967296.0 * 15.5 - 0.5;
+        double ecef[3];
+        geodetic_to_ecef_d(lat[i], lon[i], h[i], ecef);
+        x[i] = ecef[0];
+        y[i] = ecef[1];
+        z[i] = ecef[2];
+    }
+
+    static const char *names[] = {"scalar", "sse2", "avx2"};
+    enum geodesy_isa best = geodesy_isa_best();
+    printf("points:       %zu per pass\n", n);
+
+    // the existing per-point functions are the reference for speed
+    int reps = 0;
+    double start = now(), elapsed;
+    do {
+        for (size_t i = 0; i < n; i++) {
+            double ecef[3];
+            geodetic_to_ecef_d(lat[i], lon[i], h[i], ecef);
+            ox[i] = ecef[0];
+        }
+        __asm__ volatile("" : : "r"(ox) : "memory");
+        reps++;
+    } while ((elapsed = now() - start) < BENCH_MIN_SECONDS);
+    printf("to ecef       %-9s %8.1f Mpts/s\n", "per-point", n * reps / elapsed / 1e6);
+    for (enum geodesy_isa isa = GEODESY_SCALAR; isa <= best; isa++) {
+        reps = 0;
+        start = now();
+        do {
+            geodetic_to_ecef_isa(isa, lat, lon, h, ox, oy, oz, n);
+            __asm__ volatile("" : : "r"(ox) : "memory");
+            reps++;
+        } while ((elapsed = now() - start) < BENCH_MIN_SECONDS);
+        double err = 0;
+        for (size_t i = 0; i < n; i++) {
+            double d = sqrt((ox[i] - x[i]) * (ox[i] - x[i]) + (oy[i] - y[i]) * (oy[i] - y[i]) +
+                            (oz[i] - z[i]) * (oz[i] - z[i]));
+            err = fmax(err, d * 1e6);
+        }
+        printf("to ecef       %-9s %8.1f Mpts/s   max error %.2e mm\n", names[isa],
+               n * reps / elapsed / 1e6, err);
+    }
+
+    // inverse errors are against the geodetic positions the ECEF came from
+    double horiz = 0, vert = 0;
+    reps = 0;
+    start = now();
+    do {
+        for (size_t i = 0; i < n; i++)
+            ecef_to_geodetic((dvec3s){{x[i], y[i], z[i]}}, &ox[i], &oy[i], &oz[i]);
+        __asm__ volatile("" : : "r"(ox) : "memory");
+        reps++;
+    } while ((elapsed = now() - start) < BENCH_MIN_SECONDS);
+    for (size_t i = 0; i < n; i++) {
+        double eh, ev;
+        geodetic_error(lat[i], lon[i], h[i], ox[i], oy[i], oz[i], &eh, &ev);
+        horiz = fmax(horiz, eh);
+        vert = fmax(vert, ev);
+    }
+    printf("to geodetic   %-9s %8.1f Mpts/s   max error %.2e mm horizontal, %.2e mm vertical\n",
+           "per-point", n * reps / elapsed / 1e6, horiz, vert);
+    for (enum geodesy_isa isa = GEODESY_SCALAR; isa <= best; isa++) {
+        reps = 0;
+        start = now();
+        do {
+            ecef_to_geodetic_isa(isa, x, y, z, ox, oy, oz, n);
+            __asm__ volatile("" : : "r"(ox) : "memory");
+            reps++;
+        } while ((elapsed = now() - start) < BENCH_MIN_SECONDS);
+        horiz = vert = 0;
+        for (size_t i = 0; i < n; i++) {
+            double eh, ev;
+            geodetic_error(lat[i], lon[i], h[i], ox[i], oy[i], oz[i], &eh, &ev);
+            horiz = fmax(horiz, eh);
+            vert = fmax(vert, ev);
+        }
+        printf("to geodetic   %-9s %8.1f Mpts/s   max error %.2e mm horizontal, %.2e mm "
+               "vertical\n",
+               names[isa], n * reps / elapsed / 1e6, horiz, vert);
+    }
+
+    free(lat);
+    free(lon);
+    free(h);
+    free(x);
+    free(y);
+    free(z);
+    free(ox);
+    free(oy);
+    free(oz);
+    return 0;
+}
+
+static double bench_uniform(uint32_t *seed) { return bench_rand(seed) / 4294967296.0; }
+
+// 2 x 2 synthetic tiles held in memory as a raw database.
+static void synthetic_db(struct tdb *db) {
+    int res = BENCH_TILE_RES + 1;
+    size_t bytes = (size_t)res * res * sizeof(int16_t);
+    *db = (struct tdb){.fd = -1, .version = TDB_VERSION, .num_tiles = 4};
+    db->map = malloc(bytes * 4);
+    db->map_size = bytes * 4;
+    db->entries = calloc(4, sizeof(struct tdb_entry));
+    for (int t = 0; t < 4; t++) {
+        int16_t *tile = synthetic_tile(res, 0x9e3779b9u * (t + 1));
+        memcpy(db->map + bytes * t, tile, bytes);
+        free(tile);
+        db->entries[t] = (struct tdb_entry){
+            .lat = 45 + t / 2, .lon = -74 + t % 2, .xres = res, .yres = res,
+            .offset = bytes * t, .size = bytes, .encoding = TDB_ENCODING_RAW,
+        };
+    }
+}
+
+// Time terrain_heights() over pts points with the sample function f.
+static double bench_heights(struct terrain *t, terrain_sample_fn f, const double *lat,
+                            const double *lon, float *out, size_t pts) {
+    t->sample = f;
+    int reps = 0;
+    double elapsed, start = now();
+    do {
+        terrain_heights(t, lat, lon, out, pts);
+        reps++;
+    } while ((elapsed = now() - start) < BENCH_MIN_SECONDS);
+    return elapsed / reps / pts;
+}
+
+// Points of a and b that differ, NAN matching NAN, and the largest difference.
+static size_t bench_compare(const float *a, const float *b, size_t n, double *worst) {
+    size_t differ = 0;
+    *worst = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (isnan(a[i]) || isnan(b[i])) {
+            differ += isnan(a[i]) != isnan(b[i]);
+        } else if (a[i] != b[i]) {
+            differ++;
+            *worst = fmax(*worst, fabs(a[i] - b[i]));
+        }
+    }
+    return differ;
+}
+
+static int bench_terrain(int argc, char *argv[]) {
+    struct tdb db = {.fd = -1};
+    if (argc > 0) {
+        if (!tdb_open(&db, argv[0]))
+            return 1;
+    } else {
+        synthetic_db(&db);
+    }
+    struct terrain terrain;
+    terrain_init(&terrain, &db);
+    terrain_sample_fn best = terrain.sample;
+    printf("tiles:        %zu (%s)\n", db.num_tiles, argc > 0 ? argv[0] : "synthetic");
+
+    // A path of BENCH_POINTS points 20 m apart wandering over the tiles,
+    // turning back where they end, then as many points on tile edges and
+    // corners, some just off the database, and as many scattered at random
+    // over the tiles and around them.
+    size_t n = 3 * BENCH_POINTS;
+    double *lat = malloc(sizeof(double) * n), *lon = malloc(sizeof(double) * n);
+    uint32_t seed = 0x7e44a1d5u;
+    const struct tdb_entry *e = &db.entries[0];
+    double plat = e->lat - 0.5, plon = e->lon + 0.5, heading = 0;
+    for (size_t i = 0; i < BENCH_POINTS; i++) {
+        heading += (bench_uniform(&seed) - 0.5) * 0.2;
+        double next_lat = plat + 0.00018 * cos(heading);
+        double next_lon = plon + 0.00018 * sin(heading) / cos(deg2rad(plat));
+        if (terrain_tile_at(&terrain, next_lat, next_lon) < 0) {
+            heading += M_PI;
+        } else {
+            plat = next_lat;
+            plon = next_lon;
+        }
+        lat[i] = plat;
+        lon[i] = plon;
+    }
+    for (size_t i = BENCH_POINTS; i < 2 * BENCH_POINTS; i++) {
+        e = &db.entries[bench_rand(&seed) % db.num_tiles];
+        double u = bench_uniform(&seed), v = bench_uniform(&seed);
+        switch (bench_rand(&seed) % 5) {
+        case 0: lat[i] = e->lat, lon[i] = e->lon + u; break;
+        case 1: lat[i] = e->lat - 1, lon[i] = e->lon + u; break;
+        case 2: lat[i] = e->lat - u, lon[i] = e->lon; break;
+        case 3: lat[i] = e->lat - u, lon[i] = e->lon + 1; break;
+        default: lat[i] = e->lat - (v < 0.5), lon[i] = e->lon + (u < 0.5); break;
+        }
+        // just inside and outside the edge as well as on it
+        if (bench_rand(&seed) % 3 == 0)
+            lat[i] = nextafter(lat[i], bench_rand(&seed) % 2 ? INFINITY : -INFINITY);
+        if (bench_rand(&seed) % 3 == 0)
+            lon[i] = nextafter(lon[i], bench_rand(&seed) % 2 ? INFINITY : -INFINITY);
+    }
+    for (size_t i = 2 * BENCH_POINTS; i < n; i++) {
+        e = &db.entries[bench_rand(&seed) % db.num_tiles];
+        lat[i] = e->lat + 1 - 3 * bench_uniform(&seed);
+        lon[i] = e->lon - 1 + 3 * bench_uniform(&seed);
+    }
+
+    float *single = malloc(sizeof(float) * n), *scalar = malloc(sizeof(float) * n),
+          *simd = malloc(sizeof(float) * n);
+    size_t missing = 0;
+    int reps = 0;
+    double elapsed, start = now();
+    do {
+        for (size_t i = 0; i < n; i++)
+            single[i] = terrain_height_at(&terrain, lat[i], lon[i]);
+        reps++;
+    } while ((elapsed = now() - start) < BENCH_MIN_SECONDS);
+    for (size_t i = 0; i < n; i++)
+        missing += isnan(single[i]);
+    printf("points:       %zu, %zu with no tile\n", n, missing);
+    printf("single:       %.1f ns per query\n", elapsed / reps / n * 1e9);
+
+    // the path on its own, where runs in one tile are long, then everything
+    double path_scalar =
+        bench_heights(&terrain, terrain_sample_scalar, lat, lon, scalar, BENCH_POINTS);
+    double all_scalar = bench_heights(&terrain, terrain_sample_scalar, lat, lon, scalar, n);
+    printf("scalar:       %.1f ns per point along the path, %.1f ns over all\n",
+           path_scalar * 1e9, all_scalar * 1e9);
+    double worst;
+    size_t differ = bench_compare(single, scalar, n, &worst);
+    size_t simd_differ = 0;
+    if (best == terrain_sample_avx2) {
+        double path_simd = bench_heights(&terrain, best, lat, lon, simd, BENCH_POINTS);
+        double all_simd = bench_heights(&terrain, best, lat, lon, simd, n);
+        printf("avx2:         %.1f ns per point along the path, %.1f ns over all\n",
+               path_simd * 1e9, all_simd * 1e9);
+        double simd_worst;
+        simd_differ = bench_compare(scalar, simd, n, &simd_worst);
+        printf("avx2 check:   %zu of %zu points differ from scalar, worst %.3f mm\n", simd_differ,
+               n, simd_worst * 1e6);
+    } else {
+        printf("avx2:         not supported here\n");
+    }
+    printf("batch check:  %zu of %zu points differ from single queries, worst %.3f mm\n", differ,
+           n, worst * 1e6);
+
+    terrain_destroy(&terrain);
+    if (argc > 0) {
+        tdb_close(&db);
+    } else {
+        free(db.map);
+        free(db.entries);
+    }
+    free(lat);
+    free(lon);
+    free(single);
+    free(scalar);
+    free(simd);
+    return differ || simd_differ;
+}
+
+// First crossing in plain BENCH_REF_STEP steps, refined like los_cast().
+static bool los_reference(struct terrain *t, const struct los_ray *r, double *hit_t) {
+    double prev = -1;
+    for (double s = 0; s <= r->length; s += BENCH_REF_STEP) {
+        dvec3s x = {{r->origin[0] + r->dir[0] * s, r->origin[1] + r->dir[1] * s,
+                     r->origin[2] + r->dir[2] * s}};
+        double lat, lon, h;
+        ecef_to_geodetic(x, &lat, &lon, &h);
+        float g = terrain_height_at(t, lat * (180 / M_PI), lon * (180 / M_PI));
+        if (h <= (isnan(g) ? 0 : g)) {
+            double lo = prev < 0 ? s : prev, hi = s;
+            for (int k = 0; k < 24; k++) {
+                double mid = (lo + hi) / 2;
+                x = (dvec3s){{r->origin[0] + r->dir[0] * mid, r->origin[1] + r->dir[1] * mid,
+                              r->origin[2] + r->dir[2] * mid}};
+                ecef_to_geodetic(x, &lat, &lon, &h);
+                g = terrain_height_at(t, lat * (180 / M_PI), lon * (180 / M_PI));
+                if (h <= (isnan(g) ? 0 : g))
+                    hi = mid;
+                else
+                    lo = mid;
+            }
+            *hit_t = hi;
+            return true;
+        }
+        prev = s;
+    }
+    return false;
+}
+
+static int bench_los(int argc, char *argv[]) {
+    struct tdb db = {.fd = -1};
+    if (argc > 0) {
+        if (!tdb_open(&db, argv[0]))
+            return 1;
+    } else {
+        synthetic_db(&db);
+    }
+    struct terrain terrain;
+    terrain_init(&terrain, &db);
+    struct los los;
+    los_init(&los, &terrain);
+    printf("tiles:        %zu (%s)\n", db.num_tiles, argc > 0 ? argv[0] : "synthetic");
+
+    // Half are sight lines between points up to 2 km over the ground and up
+    // to 30 km apart, half are picks from 0.5 to 5 km up looking 5 to 60
+    // degrees below the horizon.
+    size_t n = BENCH_RAYS;
+    struct los_ray *rays = malloc(sizeof(struct los_ray) * n);
+    struct los_hit *hits = malloc(sizeof(struct los_hit) * n);
+    uint32_t seed = 0x51ed270bu;
+    size_t sight_lines = 0;
+    for (size_t i = 0; i < n; i++) {
+        const struct tdb_entry *e = &db.entries[bench_rand(&seed) % db.num_tiles];
+        double lat = e->lat - bench_uniform(&seed), lon = e->lon + bench_uniform(&seed);
+        float g = terrain_height_at(&terrain, lat, lon);
+        double a[3], b[3];
+        struct los_ray *r = &rays[i];
+        if (i % 2 == 0) {
+            geodetic_to_ecef_d(deg2rad(lat), deg2rad(lon), g + 0.002 + bench_uniform(&seed) * 2,
+                               a);
+            double dist = bench_uniform(&seed) * 30, az = bench_uniform(&seed) * 2 * M_PI;
+            double lat2 = lat + dist / 111.0 * cos(az);
+            double lon2 = lon + dist / (111.0 * cos(deg2rad(lat))) * sin(az);
+            float g2 = terrain_height_at(&terrain, lat2, lon2);
+            geodetic_to_ecef_d(deg2rad(lat2), deg2rad(lon2), (isnan(g2) ? 0 : g2) + 0.002, b);
+            double len = sqrt((b[0] - a[0]) * (b[0] - a[0]) + (b[1] - a[1]) * (b[1] - a[1]) +
+                              (b[2] - a[2]) * (b[2] - a[2]));
+            for (int k = 0; k < 3; k++) {
+                r->origin[k] = a[k];
+                r->dir[k] = (b[k] - a[k]) / len;
+            }
+            r->length = len;
+            sight_lines++;
+        } else {
+            double phi = deg2rad(lat), lam = deg2rad(lon);
+            geodetic_to_ecef_d(phi, lam, g + 0.5 + bench_uniform(&seed) * 4.5, a);
+            double az = bench_uniform(&seed) * 2 * M_PI;
+            double el = -deg2rad(5 + bench_uniform(&seed) * 55);
+            double east[3] = {-sin(lam), cos(lam), 0};
+            double north[3] = {-sin(phi) * cos(lam), -sin(phi) * sin(lam), cos(phi)};
+            double up[3] = {cos(phi) * cos(lam), cos(phi) * sin(lam), sin(phi)};
+            for (int k = 0; k < 3; k++) {
+                r->origin[k] = a[k];
+                r->dir[k] = cos(el) * (cos(az) * north[k] + sin(az) * east[k]) + sin(el) * up[k];
+            }
+            r->length = INFINITY;
+        }
+    }
+
+    // the first batch also builds the trees of the tiles it crosses
+    double start = now();
+    los_cast_batch(&los, rays, hits, n);
+    double first = now() - start;
+    size_t trees = 0;
+    for (size_t i = 0; i < db.num_tiles; i++)
+        trees += atomic_load(&los.trees[i].max) != NULL;
+    printf("quadtrees:    %zu built in the first batch, %.2f ms on %d workers, %.1f MB\n", trees,
+           first * 1e3, los.num_workers + 1, atomic_load(&los.tree_bytes) / 1e6);
+
+    int reps = 0;
+    double elapsed;
+    start = now();
+    do {
+        los_cast_batch(&los, rays, hits, n);
+        reps++;
+    } while ((elapsed = now() - start) < BENCH_MIN_SECONDS);
+    size_t blocked = 0;
+    for (size_t i = 0; i < n; i += 2)
+        blocked += hits[i].hit;
+    printf("rays:         %zu, %zu sight lines (%zu blocked) and %zu picks\n", n, sight_lines,
+           blocked, n - sight_lines);
+    printf("batch:        %.2f ms, %.2f Mrays/s\n", elapsed / reps * 1e3,
+           n * reps / elapsed / 1e6);
+
+    reps = 0;
+    start = now();
+    do {
+        for (size_t i = 0; i < n; i++)
+            los_cast(&los, &rays[i], &hits[i]);
+        reps++;
+    } while ((elapsed = now() - start) < BENCH_MIN_SECONDS);
+    printf("one thread:   %.2f ms, %.2f Mrays/s\n", elapsed / reps * 1e3,
+           n * reps / elapsed / 1e6);
+
+    // the reference can miss a crossing thinner than its step, so only hits
+    // further apart than a step count against los_cast()
+    size_t checked = n < BENCH_CHECKED_RAYS ? n : BENCH_CHECKED_RAYS, disagree = 0;
+    double worst = 0;
+    start = now();
+    for (size_t i = 0; i < checked; i++) {
+        double t;
+        bool hit = los_reference(&terrain, &rays[i], &t);
+        if (hit != hits[i].hit) {
+            disagree++;
+        } else if (hit) {
+            double err = fabs(t - hits[i].t);
+            if (err > BENCH_REF_STEP)
+                disagree++;
+            worst = fmax(worst, err);
+        }
+    }
+    printf("reference:    %zu rays in %.2f s, %zu disagree, worst hit %.3f m apart\n", checked,
+           now() - start, disagree, worst * 1e3);
+
+    los_destroy(&los);
+    terrain_destroy(&terrain);
+    if (argc > 0) {
+        tdb_close(&db);
+    } else {
+        free(db.map);
+        free(db.entries);
+    }
+    free(rays);
+    free(hits);
+    return disagree > checked / 100; // a grazing ray or two may differ
+}
+
+static int bench_overlay(int argc, char *argv[]) {
+    struct tdb db;
+    synthetic_db(&db);
+    struct terrain terrain;
+    terrain_init(&terrain, &db);
+
+    // features fall on the synthetic tiles, around 45N 73W
+    struct overlay o = {0};
+    uint32_t seed = 0x0bad5eedu;
+    double start = now();
+    if (argc > 0) {
+        if (!overlay_load(&o, argv[0]))
+            return 1;
+    } else {
+        o.count = BENCH_FEATURES;
+        o.features = malloc(sizeof(struct overlay_feature) * o.count);
+        for (size_t i = 0; i < o.count; i++)
+            o.features[i] = (struct overlay_feature){
+                .lat = 44 + 2 * bench_uniform(&seed),
+                .lon = -74 + 2 * bench_uniform(&seed),
+                .height = 0.02 + 0.3 * bench_uniform(&seed),
+                .length = 0.02,
+                .width = 0.02,
+                .heading = 2 * M_PI * bench_uniform(&seed),
+                .kind = i % 100 == 0 ? OVERLAY_RUNWAY : i % 3 ? OVERLAY_TOWER : OVERLAY_BUILDING,
+            };
+        overlay_index(&o);
+    }
+    printf("features:     %zu (%s), indexed in %.1f ms\n", o.count,
+           argc > 0 ? argv[0] : "synthetic", (now() - start) * 1e3);
+
+    // queries around random features, each checked against a plain scan
+    struct overlay_view v = {0};
+    int queries = 0, wrong = 0;
+    size_t selected = 0;
+    double elapsed = 0;
+    while (elapsed < BENCH_MIN_SECONDS) {
+        const struct overlay_feature *f = &o.features[bench_rand(&seed) % o.count];
+        double lat = f->lat, lon = f->lon;
+        start = now();
+        overlay_gather(&o, &v, &terrain, lat, lon, BENCH_OVERLAY_RANGE);
+        elapsed += now() - start;
+        queries++;
+        selected += v.count;
+
+        double radius = BENCH_OVERLAY_RANGE * (1 + OVERLAY_MARGIN);
+        size_t expect = 0;
+        for (size_t i = 0; i < o.count; i++)
+            expect += overlay_distance(lat, lon, o.features[i].lat, o.features[i].lon) <= radius;
+        wrong += expect != v.count;
+    }
+    printf("gather:       %.0f features within %.0f km in %.2f ms (%.1f ns each)\n",
+           (double)selected / queries, BENCH_OVERLAY_RANGE * (1 + OVERLAY_MARGIN),
+           elapsed / queries * 1e3, elapsed / selected * 1e9);
+    printf("scan check:   %d of %d queries differ\n", wrong, queries);
+
+    overlay_view_destroy(&v);
+    overlay_destroy(&o);
+    terrain_destroy(&terrain);
+    free(db.map);
+    free(db.entries);
+    return wrong != 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc >= 2 && strcmp(argv[1], "codec") == 0)
+        return bench_codec(argc - 2, argv + 2);
+    if (argc >= 2 && strcmp(argv[1], "geodesy") == 0)
+        return bench_geodesy();
+    if (argc >= 2 && strcmp(argv[1], "terrain") == 0)
+        return bench_terrain(argc - 2, argv + 2);
+    if (argc >= 2 && strcmp(argv[1], "los") == 0)
+        return bench_los(argc - 2, argv + 2);
+    if (argc >= 2 && strcmp(argv[1], "overlay") == 0)
+        return bench_overlay(argc - 2, argv + 2);
+    fprintf(stderr, "usage: bench codec [file.tdb]\n"
+                    "       bench geodesy\n"
+                    "       bench terrain [file.tdb]\n"
+                    "       bench los [file.tdb]\n"
+                    "       bench overlay [file.csv]\n");
+    return 1;
+}
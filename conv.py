@@ -2,9 +2,17 @@ from PIL import Image
 import numpy as np
 import re
 import os
+import struct
 
 DATA_DIR = "data"
 
+# TDB v2, see tdb.h
+TDB_MAGIC = b"TDB\x02"
+TDB_VERSION = 2
+TDB_PAGE_SIZE = 4096
+TDB_HEADER = struct.Struct("<4sIIIQ")
+TDB_ENTRY = struct.Struct("<hhhhQQIIQ")
+
 
 def extract_lon_lat(filename: str) -> tuple[int, int] | None:
     pattern = r"_(?P<lat_sign>[NS])(?P<lat_deg>\d{2})_00_(?P<lon_sign>[EW])(?P<lon_deg>\d{3})_00_DEM"
@@ -43,15 +51,71 @@ def make_raw(fname: str):
     return packed.astype(np.int16)
 
 
-tdb = np.array([], dtype=np.int16)
+def reduce_level(a: np.ndarray, ufunc) -> np.ndarray:
+    # 2x2 blocks, an odd last row or column folds into the block before it
+    rows = np.arange(max(1, a.shape[0] // 2)) * 2
+    cols = np.arange(max(1, a.shape[1] // 2)) * 2
+    return ufunc.reduceat(ufunc.reduceat(a, rows, axis=0), cols, axis=1)
+
+
+def block_counts(n: int) -> np.ndarray:
+    starts = np.arange(max(1, n // 2)) * 2
+    return np.diff(np.append(starts, n))
+
+
+def make_pyramid(packed: np.ndarray) -> list[list[np.ndarray]]:
+    """Average (packed, water by majority), min and max levels below the base,
+    matching tdb_build_pyramid() in tdb.h."""
+    height = (packed >> 1).astype(np.int64)
+    water = (packed & 1).astype(np.int64)
+    lo = hi = height
+    avg_levels, min_levels, max_levels = [], [], []
+    while height.shape != (1, 1):
+        n = np.outer(block_counts(height.shape[0]), block_counts(height.shape[1]))
+        height = np.floor_divide(2 * reduce_level(height, np.add) + n, 2 * n)
+        water = (2 * reduce_level(water, np.add) > n).astype(np.int64)
+        lo = reduce_level(lo, np.minimum)
+        hi = reduce_level(hi, np.maximum)
+        avg_levels.append((height * 2 + water).astype(np.int16))
+        min_levels.append(lo.astype(np.int16))
+        max_levels.append(hi.astype(np.int16))
+    return [avg_levels, min_levels, max_levels]
+
+
+def page_align(off: int) -> int:
+    return (off + TDB_PAGE_SIZE - 1) // TDB_PAGE_SIZE * TDB_PAGE_SIZE
+
+
+tiles = []
 for f in os.listdir(DATA_DIR):
     res = extract_lon_lat(f)
     if not res:
         continue
-    lat, lon = res
-    data = make_raw(f)
-    x, y = data.shape
-    tdb = np.append(tdb, [lat, lon, x, y])
-    tdb = np.append(tdb, data.flatten())
-
-tdb.astype(np.int16).tofile("terrain.tdb")
+    tiles.append((res, f))
+tiles.sort()
+
+dir_offset = TDB_HEADER.size
+offset = page_align(dir_offset + TDB_ENTRY.size * len(tiles))
+
+with open("terrain.tdb", "wb") as out:
+    out.write(TDB_HEADER.pack(TDB_MAGIC, TDB_VERSION, len(tiles), TDB_ENTRY.size, dir_offset))
+    directory = []
+    for (lat, lon), f in tiles:
+        data = make_raw(f)
+        y, x = data.shape
+        pyramid = make_pyramid(data)
+        levels = len(pyramid[0])
+        pyramid_offset = offset + data.nbytes
+
+        out.seek(offset)
+        data.tofile(out)
+        for kind in pyramid:
+            for level in kind:
+                level.tofile(out)
+        directory.append(
+            TDB_ENTRY.pack(lat, lon, x, y, offset, data.nbytes, levels, 0, pyramid_offset)
+        )
+        offset = page_align(out.tell())
+
+    out.seek(dir_offset)
+    out.write(b"".join(directory))
@@ -0,0 +1,119 @@
+#ifndef CULL_H
+#define CULL_H
+
+#include <cglm/struct.h>
+#include <math.h>
+#include <stdbool.h>
+
+#include "aircraft_state.h"
+
+// Visibility tests for lat/lon boxes of terrain.
+//
+// Everything happens in double precision relative to the eye, so the planes
+// come from proj * view without the eye translation. A box is described by the
+// ECEF positions of a 3x3 lat/lon grid over its footprint at its lowest and
+// highest terrain height; the highest points are raised by the sagitta of the
+// grid spacing so the curved surface between them stays inside.
+//
+// Horizon culling follows the usual scaled-space test: after scaling the
+// occluding ellipsoid to a unit sphere, a point is hidden when it lies behind
+// the plane of the horizon circle and inside the cone tangent to the sphere.
+
+#define CULL_GRID 3
+#define CULL_HORIZON_HEIGHT -0.5 // km, occluder sits below the lowest dry land
+
+enum cull_result { CULL_VISIBLE, CULL_FRUSTUM, CULL_HORIZON };
+
+struct cull_view {
+    double eye[3];
+    double planes[6][4];
+    double radii[3];
+    double scaled_eye[3];
+    double vh2; // squared distance from the scaled eye to the horizon circle
+};
+
+void cull_view_init(struct cull_view *v, const double eye[3], mat4s viewproj) {
+    for (int i = 0; i < 3; i++)
+        v->eye[i] = eye[i];
+
+    // Gribb/Hartmann: planes are sums and differences of the matrix rows
+    for (int p = 0; p < 6; p++) {
+        int row = p / 2;
+        double sign = p % 2 ? -1 : 1;
+        for (int c = 0; c < 4; c++)
+            v->planes[p][c] = viewproj.raw[c][3] + sign * viewproj.raw[c][row];
+    }
+
+    v->radii[0] = v->radii[1] = WGS84_A + CULL_HORIZON_HEIGHT;
+    v->radii[2] = WGS84_B + CULL_HORIZON_HEIGHT;
+    double len2 = 0;
+    for (int i = 0; i < 3; i++) {
+        v->scaled_eye[i] = eye[i] / v->radii[i];
+        len2 += v->scaled_eye[i] * v->scaled_eye[i];
+    }
+    v->vh2 = len2 - 1;
+}
+
+static bool cull_point_occluded(const struct cull_view *v, const double p[3]) {
+    double vt[3], vt2 = 0, vt_dot_vc = 0;
+    for (int i = 0; i < 3; i++) {
+        vt[i] = p[i] / v->radii[i] - v->scaled_eye[i];
+        vt2 += vt[i] * vt[i];
+        vt_dot_vc -= vt[i] * v->scaled_eye[i];
+    }
+    if (v->vh2 < 0) // eye below the occluder
+        return vt_dot_vc > 0;
+    return vt_dot_vc > v->vh2 && vt_dot_vc * vt_dot_vc / vt2 > v->vh2;
+}
+
+bool cull_sphere_outside(const struct cull_view *v, const double center[3], double radius) {
+    for (int p = 0; p < 6; p++) {
+        const double *pl = v->planes[p];
+        double len = sqrt(pl[0] * pl[0] + pl[1] * pl[1] + pl[2] * pl[2]);
+        double d = pl[3];
+        for (int c = 0; c < 3; c++)
+            d += pl[c] * (center[c] - v->eye[c]);
+        if (d < -radius * len)
+            return true;
+    }
+    return false;
+}
+
+// Box spanning [lat - dlat, lat] x [lon, lon + dlon] degrees and [hmin, hmax] km.
+enum cull_result cull_box(const struct cull_view *v, double lat, double lon, double dlat,
+                          double dlon, double hmin, double hmax) {
+    double step_km = WGS84_A * glm_rad(dlat > dlon ? dlat : dlon) / (CULL_GRID - 1);
+    double hmax_bulge = hmax + step_km * step_km / (8 * WGS84_B);
+
+    double pts[2 * CULL_GRID * CULL_GRID][3];
+    int n = 0;
+    for (int y = 0; y < CULL_GRID; y++) {
+        for (int x = 0; x < CULL_GRID; x++) {
+            double plat = glm_rad(lat - dlat * y / (CULL_GRID - 1));
+            double plon = glm_rad(lon + dlon * x / (CULL_GRID - 1));
+            geodetic_to_ecef_d(plat, plon, hmin, pts[n++]);
+            geodetic_to_ecef_d(plat, plon, hmax_bulge, pts[n++]);
+        }
+    }
+
+    for (int p = 0; p < 6; p++) {
+        const double *pl = v->planes[p];
+        bool outside = true;
+        for (int i = 0; i < n && outside; i++) {
+            double d = pl[3];
+            for (int c = 0; c < 3; c++)
+                d += pl[c] * (pts[i][c] - v->eye[c]);
+            outside = d < 0;
+        }
+        if (outside)
+            return CULL_FRUSTUM;
+    }
+
+    // only the raised points can peek over the horizon
+    for (int i = 1; i < n; i += 2)
+        if (!cull_point_occluded(v, pts[i]))
+            return CULL_VISIBLE;
+    return CULL_HORIZON;
+}
+
+#endif
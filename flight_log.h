@@ -0,0 +1,626 @@
+#ifndef FLIGHT_LOG_H
+#define FLIGHT_LOG_H
+
+#include <SDL3/SDL_timer.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "aircraft_state.h"
+#include "sim.h"
+
+// Flight recording and replay.
+//
+// Every rendered frame's aircraft state and control inputs go into an
+// append-only binary log. Records are taken once per frame, not once per
+// SIM_RATE step of the simulation, so replay interpolates between frames and
+// loses any motion quicker than the frame rate. Each record is quantized to
+// integers, predicted from the records before it, and only the residuals of
+// the fields that changed are stored, as zigzag LEB128 varints behind a
+// bitmask; a steady flight costs around 15 bytes a frame. A keyframe holding
+// every field outright starts each FLIGHT_LOG_KEY_NS of log time, so replay
+// can start anywhere without decoding from the beginning.
+//
+// The render thread only encodes into memory. Full chunks go to a writer
+// thread that does the file I/O, so a slow disk never holds up a frame.
+// Closing the log appends an index of the keyframes and a footer pointing at
+// it; a log cut short by a crash has neither, and the reader rebuilds the
+// index by scanning the records that made it to disk.
+//
+// File layout, little endian:
+//
+//   header   char[4] "SVFL", u32 version, u64 wall clock at start in ns
+//   records  'K' then every field, or 'D', a varint field mask and the
+//            residuals of the fields in the mask
+//   index    varint count, then per keyframe varint time and offset deltas
+//   footer   u64 index offset, char[4] "SVIX"
+
+#define FLIGHT_LOG_MAGIC "SVFL"
+#define FLIGHT_LOG_INDEX_MAGIC "SVIX"
+#define FLIGHT_LOG_VERSION 1
+#define FLIGHT_LOG_HEADER_SIZE 16
+#define FLIGHT_LOG_FOOTER_SIZE 12
+#define FLIGHT_LOG_KEY_NS 1000000000 // keyframe interval, also how often chunks are handed over
+#define FLIGHT_LOG_CHUNK 65536       // bytes
+#define FLIGHT_LOG_MAX_RECORD 256    // bytes, tag, mask and a varint for every field
+
+// quantization
+#define FLIGHT_LOG_POS_SCALE 1e6       // mm per km
+#define FLIGHT_LOG_DIR_SCALE 1048576.0 // 2^20 per unit vector component
+#define FLIGHT_LOG_AXIS_SCALE 10000.0  // stick and throttle
+#define FLIGHT_LOG_LOOK_SCALE 16.0     // mouse pixels
+
+enum flight_log_field {
+    FLIGHT_LOG_TIME,
+    FLIGHT_LOG_POS,                          // x, y, z
+    FLIGHT_LOG_FORWARD = FLIGHT_LOG_POS + 3, // x, y, z
+    FLIGHT_LOG_UP = FLIGHT_LOG_FORWARD + 3,  // x, y, z
+    FLIGHT_LOG_LINEAR = FLIGHT_LOG_UP + 3,   // fields before this are predicted linearly
+    FLIGHT_LOG_THROTTLE = FLIGHT_LOG_LINEAR,
+    FLIGHT_LOG_STICK,                       // pitch, yaw, roll, throttle
+    FLIGHT_LOG_MOVE = FLIGHT_LOG_STICK + 4, // right, up, forward
+    FLIGHT_LOG_LOOK = FLIGHT_LOG_MOVE + 3,  // x, y
+    FLIGHT_LOG_FLAGS = FLIGHT_LOG_LOOK + 2,
+    FLIGHT_LOG_FIELDS,
+};
+
+enum {
+    FLIGHT_LOG_ACTIVE = 1,
+    FLIGHT_LOG_FREECAM = 2,
+    FLIGHT_LOG_FAST = 4,
+    FLIGHT_LOG_LEVEL = 8,
+    FLIGHT_LOG_NET = 16, // drawn from network input
+};
+
+struct flight_log_record {
+    Uint64 time_ns; // since the start of the log
+    struct aircraft_state ac;
+    struct sim_input in;
+    bool net_live;
+};
+
+// Prediction state, the same on both ends.
+struct flight_log_codec {
+    int64_t prev[FLIGHT_LOG_FIELDS];
+    int64_t slope[FLIGHT_LOG_FIELDS];
+};
+
+struct flight_log_key {
+    Uint64 time_ns;
+    uint64_t offset; // in the file
+};
+
+struct flight_log_chunk {
+    struct flight_log_chunk *next;
+    size_t len;
+    uint8_t data[FLIGHT_LOG_CHUNK];
+};
+
+struct flight_log_writer {
+    FILE *f;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    struct flight_log_chunk *queue, *queue_tail; // full chunks waiting for the writer
+    bool quit;
+    atomic_bool failed;
+
+    // render thread only
+    struct flight_log_chunk *cur;
+    uint64_t offset; // bytes encoded so far
+    Uint64 start_ns;
+    Uint64 next_key_ns;
+    struct flight_log_codec codec;
+    struct flight_log_key *index;
+    size_t num_keys, key_cap;
+    uint64_t records;
+};
+
+struct flight_log_reader {
+    uint8_t *data;
+    size_t size;
+    size_t end; // records stop here
+    struct flight_log_key *index;
+    size_t num_keys;
+    Uint64 duration_ns;
+    uint64_t start_wall_ns;
+
+    // replay cursor: prev and next bracket the last time asked for
+    struct flight_log_codec codec;
+    size_t pos;
+    struct flight_log_record prev, next;
+    bool at_end;
+};
+
+static uint8_t *flight_log_put_varint(uint8_t *p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = (uint8_t)v | 0x80;
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+static const uint8_t *flight_log_get_varint(const uint8_t *p, const uint8_t *end, uint64_t *v) {
+    *v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t b = *p++;
+        *v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return p;
+    }
+    return NULL; // truncated or overlong
+}
+
+static inline uint64_t flight_log_zigzag(int64_t v) { return ((uint64_t)v << 1) ^ (v >> 63); }
+static inline int64_t flight_log_unzigzag(uint64_t z) {
+    return (int64_t)(z >> 1) ^ -(int64_t)(z & 1);
+}
+
+static inline int64_t flight_log_predict(const struct flight_log_codec *c, int i) {
+    return i < FLIGHT_LOG_LINEAR ? c->prev[i] + c->slope[i] : c->prev[i];
+}
+
+static void flight_log_advance(struct flight_log_codec *c, const int64_t q[FLIGHT_LOG_FIELDS],
+                               bool key) {
+    for (int i = 0; i < FLIGHT_LOG_FIELDS; i++) {
+        c->slope[i] = key ? 0 : q[i] - c->prev[i];
+        c->prev[i] = q[i];
+    }
+}
+
+static uint8_t *flight_log_encode(struct flight_log_codec *c, const int64_t q[FLIGHT_LOG_FIELDS],
+                                  bool key, uint8_t *p) {
+    if (key) {
+        *p++ = 'K';
+        for (int i = 0; i < FLIGHT_LOG_FIELDS; i++)
+            p = flight_log_put_varint(p, flight_log_zigzag(q[i]));
+    } else {
+        int64_t r[FLIGHT_LOG_FIELDS];
+        uint64_t mask = 0;
+        for (int i = 0; i < FLIGHT_LOG_FIELDS; i++) {
+            r[i] = q[i] - flight_log_predict(c, i);
+            if (r[i])
+                mask |= 1ull << i;
+        }
+        *p++ = 'D';
+        p = flight_log_put_varint(p, mask);
+        for (int i = 0; i < FLIGHT_LOG_FIELDS; i++)
+            if (mask >> i & 1)
+                p = flight_log_put_varint(p, flight_log_zigzag(r[i]));
+    }
+    flight_log_advance(c, q, key);
+    return p;
+}
+
+// Decode one record into q, NULL at a bad or cut off record.
+static const uint8_t *flight_log_decode(struct flight_log_codec *c, const uint8_t *p,
+                                        const uint8_t *end, int64_t q[FLIGHT_LOG_FIELDS]) {
+    if (p >= end)
+        return NULL;
+    uint8_t tag = *p++;
+    uint64_t v;
+    if (tag == 'K') {
+        for (int i = 0; i < FLIGHT_LOG_FIELDS; i++) {
+            if (!(p = flight_log_get_varint(p, end, &v)))
+                return NULL;
+            q[i] = flight_log_unzigzag(v);
+        }
+    } else if (tag == 'D') {
+        uint64_t mask;
+        if (!(p = flight_log_get_varint(p, end, &mask)) || mask >> FLIGHT_LOG_FIELDS)
+            return NULL;
+        for (int i = 0; i < FLIGHT_LOG_FIELDS; i++) {
+            v = 0;
+            if (mask >> i & 1 && !(p = flight_log_get_varint(p, end, &v)))
+                return NULL;
+            q[i] = flight_log_predict(c, i) + flight_log_unzigzag(v);
+        }
+    } else {
+        return NULL;
+    }
+    flight_log_advance(c, q, tag == 'K');
+    return p;
+}
+
+static void flight_log_quantize(const struct flight_log_record *r, int64_t q[FLIGHT_LOG_FIELDS]) {
+    const struct aircraft_state *ac = &r->ac;
+    const struct sim_input *in = &r->in;
+    q[FLIGHT_LOG_TIME] = r->time_ns;
+    for (int k = 0; k < 3; k++) {
+        q[FLIGHT_LOG_POS + k] = llround(ac->pos.raw[k] * FLIGHT_LOG_POS_SCALE);
+        q[FLIGHT_LOG_FORWARD + k] = lround(ac->forward.raw[k] * FLIGHT_LOG_DIR_SCALE);
+        q[FLIGHT_LOG_UP + k] = lround(ac->up.raw[k] * FLIGHT_LOG_DIR_SCALE);
+        q[FLIGHT_LOG_MOVE + k] = lround(in->move[k]);
+    }
+    q[FLIGHT_LOG_THROTTLE] = lround(ac->throttle * FLIGHT_LOG_AXIS_SCALE);
+    for (int k = 0; k < 4; k++)
+        q[FLIGHT_LOG_STICK + k] = lround(in->stick[k] * FLIGHT_LOG_AXIS_SCALE);
+    for (int k = 0; k < 2; k++)
+        q[FLIGHT_LOG_LOOK + k] = lround(in->look[k] * FLIGHT_LOG_LOOK_SCALE);
+    q[FLIGHT_LOG_FLAGS] = (in->active ? FLIGHT_LOG_ACTIVE : 0) |
+                          (in->freecam ? FLIGHT_LOG_FREECAM : 0) |
+                          (in->fast ? FLIGHT_LOG_FAST : 0) | (in->level ? FLIGHT_LOG_LEVEL : 0) |
+                          (r->net_live ? FLIGHT_LOG_NET : 0);
+}
+
+static void flight_log_dequantize(const int64_t q[FLIGHT_LOG_FIELDS],
+                                  struct flight_log_record *r) {
+    *r = (struct flight_log_record){.time_ns = q[FLIGHT_LOG_TIME]};
+    struct aircraft_state *ac = &r->ac;
+    struct sim_input *in = &r->in;
+    for (int k = 0; k < 3; k++) {
+        ac->pos.raw[k] = q[FLIGHT_LOG_POS + k] / FLIGHT_LOG_POS_SCALE;
+        ac->forward.raw[k] = q[FLIGHT_LOG_FORWARD + k] / FLIGHT_LOG_DIR_SCALE;
+        ac->up.raw[k] = q[FLIGHT_LOG_UP + k] / FLIGHT_LOG_DIR_SCALE;
+        in->move[k] = q[FLIGHT_LOG_MOVE + k];
+    }
+    ac->forward = glms_vec3_normalize(ac->forward);
+    ac->up = glms_vec3_normalize(ac->up);
+    ac->right = glms_vec3_normalize(glms_vec3_cross(ac->forward, ac->up));
+    ac->throttle = q[FLIGHT_LOG_THROTTLE] / FLIGHT_LOG_AXIS_SCALE;
+    ecef_to_geodetic(ac->pos, &ac->lat, &ac->lon, &ac->height);
+    for (int k = 0; k < 4; k++)
+        in->stick[k] = q[FLIGHT_LOG_STICK + k] / FLIGHT_LOG_AXIS_SCALE;
+    for (int k = 0; k < 2; k++)
+        in->look[k] = q[FLIGHT_LOG_LOOK + k] / FLIGHT_LOG_LOOK_SCALE;
+    int64_t flags = q[FLIGHT_LOG_FLAGS];
+    in->active = flags & FLIGHT_LOG_ACTIVE;
+    in->freecam = flags & FLIGHT_LOG_FREECAM;
+    in->fast = flags & FLIGHT_LOG_FAST;
+    in->level = flags & FLIGHT_LOG_LEVEL;
+    r->net_live = flags & FLIGHT_LOG_NET;
+}
+
+static void *flight_log_worker(void *arg) {
+    struct flight_log_writer *w = arg;
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (!w->queue && !w->quit)
+            pthread_cond_wait(&w->wake, &w->lock);
+        struct flight_log_chunk *c = w->queue;
+        if (!c)
+            break; // quit with nothing left to write
+        w->queue = NULL;
+        pthread_mutex_unlock(&w->lock);
+
+        while (c) {
+            if (!atomic_load(&w->failed) &&
+                (fwrite(c->data, 1, c->len, w->f) != c->len || fflush(w->f) != 0)) {
+                fprintf(stderr, "flight log: write failed, recording stopped\n");
+                atomic_store(&w->failed, true);
+            }
+            struct flight_log_chunk *next = c->next;
+            free(c);
+            c = next;
+        }
+        pthread_mutex_lock(&w->lock);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+// Queue the chunk being filled for writing and start a new one.
+static void flight_log_hand_over(struct flight_log_writer *w) {
+    struct flight_log_chunk *c = w->cur;
+    w->cur = malloc(sizeof(struct flight_log_chunk));
+    w->cur->next = NULL;
+    w->cur->len = 0;
+    if (!c->len) {
+        free(c);
+        return;
+    }
+    pthread_mutex_lock(&w->lock);
+    if (w->queue)
+        w->queue_tail->next = c;
+    else
+        w->queue = c;
+    w->queue_tail = c;
+    pthread_cond_signal(&w->wake);
+    pthread_mutex_unlock(&w->lock);
+}
+
+bool flight_log_create(struct flight_log_writer *w, const char *path) {
+    *w = (struct flight_log_writer){0};
+    w->f = fopen(path, "wb");
+    if (!w->f) {
+        fprintf(stderr, "flight log: cannot write %s\n", path);
+        return false;
+    }
+    w->cur = malloc(sizeof(struct flight_log_chunk));
+    w->cur->next = NULL;
+    w->cur->len = FLIGHT_LOG_HEADER_SIZE;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t wall = ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    uint32_t version = FLIGHT_LOG_VERSION;
+    memcpy(w->cur->data, FLIGHT_LOG_MAGIC, 4);
+    memcpy(w->cur->data + 4, &version, 4);
+    memcpy(w->cur->data + 8, &wall, 8);
+    w->offset = FLIGHT_LOG_HEADER_SIZE;
+
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->wake, NULL);
+    pthread_create(&w->thread, NULL, flight_log_worker, w);
+    return true;
+}
+
+// Append the state drawn at now_ns and the inputs behind it. Only encodes
+// into memory; the first call starts the log's clock.
+void flight_log_append(struct flight_log_writer *w, Uint64 now_ns, const struct aircraft_state *ac,
+                       const struct sim_input *in, bool net_live) {
+    if (!w->f || atomic_load(&w->failed))
+        return;
+    if (!w->records)
+        w->start_ns = now_ns;
+    struct flight_log_record r = {
+        .time_ns = now_ns - w->start_ns,
+        .ac = *ac,
+        .in = *in,
+        .net_live = net_live,
+    };
+    int64_t q[FLIGHT_LOG_FIELDS];
+    flight_log_quantize(&r, q);
+
+    bool key = r.time_ns >= w->next_key_ns;
+    if (key) {
+        // a keyframe starts a fresh chunk, so at most a second is lost in a crash
+        flight_log_hand_over(w);
+        if (w->num_keys == w->key_cap) {
+            w->key_cap = w->key_cap ? w->key_cap * 2 : 256;
+            w->index = realloc(w->index, sizeof(struct flight_log_key) * w->key_cap);
+        }
+        w->index[w->num_keys++] = (struct flight_log_key){r.time_ns, w->offset};
+        w->next_key_ns = r.time_ns + FLIGHT_LOG_KEY_NS;
+    } else if (FLIGHT_LOG_CHUNK - w->cur->len < FLIGHT_LOG_MAX_RECORD) {
+        flight_log_hand_over(w);
+    }
+    uint8_t *p = w->cur->data + w->cur->len;
+    size_t len = flight_log_encode(&w->codec, q, key, p) - p;
+    w->cur->len += len;
+    w->offset += len;
+    w->records++;
+}
+
+// Flush what is left, append the keyframe index and close the file.
+bool flight_log_finish(struct flight_log_writer *w) {
+    if (!w->f)
+        return true;
+    flight_log_hand_over(w);
+    pthread_mutex_lock(&w->lock);
+    w->quit = true;
+    pthread_cond_signal(&w->wake);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->wake);
+
+    size_t size = 10 + w->num_keys * 20 + FLIGHT_LOG_FOOTER_SIZE;
+    uint8_t *buf = malloc(size), *p = buf;
+    p = flight_log_put_varint(p, w->num_keys);
+    struct flight_log_key last = {0};
+    for (size_t i = 0; i < w->num_keys; i++) {
+        p = flight_log_put_varint(p, w->index[i].time_ns - last.time_ns);
+        p = flight_log_put_varint(p, w->index[i].offset - last.offset);
+        last = w->index[i];
+    }
+    memcpy(p, &w->offset, 8);
+    memcpy(p + 8, FLIGHT_LOG_INDEX_MAGIC, 4);
+    p += FLIGHT_LOG_FOOTER_SIZE;
+
+    bool ok = !atomic_load(&w->failed);
+    ok &= fwrite(buf, 1, p - buf, w->f) == (size_t)(p - buf);
+    ok &= fclose(w->f) == 0;
+    if (!ok)
+        fprintf(stderr, "flight log: error writing the log\n");
+    free(buf);
+    free(w->cur);
+    free(w->index);
+    *w = (struct flight_log_writer){0};
+    return ok;
+}
+
+// Keyframe index from the footer, false if the log was never closed.
+static bool flight_log_read_index(struct flight_log_reader *r) {
+    if (r->size < FLIGHT_LOG_HEADER_SIZE + FLIGHT_LOG_FOOTER_SIZE)
+        return false;
+    const uint8_t *footer = r->data + r->size - FLIGHT_LOG_FOOTER_SIZE;
+    uint64_t index_offset;
+    memcpy(&index_offset, footer, 8);
+    if (memcmp(footer + 8, FLIGHT_LOG_INDEX_MAGIC, 4) != 0 ||
+        index_offset < FLIGHT_LOG_HEADER_SIZE || index_offset > r->size - FLIGHT_LOG_FOOTER_SIZE)
+        return false;
+
+    const uint8_t *p = r->data + index_offset;
+    uint64_t count;
+    if (!(p = flight_log_get_varint(p, footer, &count)) || count > r->size)
+        return false;
+    r->index = malloc(sizeof(struct flight_log_key) * (count ? count : 1));
+    struct flight_log_key k = {0};
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t dt, doff;
+        if (!(p = flight_log_get_varint(p, footer, &dt)) ||
+            !(p = flight_log_get_varint(p, footer, &doff))) {
+            free(r->index);
+            r->index = NULL;
+            return false;
+        }
+        k.time_ns += dt;
+        k.offset += doff;
+        if (k.offset < FLIGHT_LOG_HEADER_SIZE || k.offset >= index_offset ||
+            r->data[k.offset] != 'K') {
+            free(r->index);
+            r->index = NULL;
+            return false;
+        }
+        r->index[i] = k;
+    }
+    r->num_keys = count;
+    r->end = index_offset;
+    return true;
+}
+
+// Rebuild the index of a log cut short, keeping the records that decode.
+static void flight_log_scan(struct flight_log_reader *r) {
+    size_t cap = 256;
+    r->index = malloc(sizeof(struct flight_log_key) * cap);
+    r->num_keys = 0;
+    struct flight_log_codec codec = {0};
+    const uint8_t *p = r->data + FLIGHT_LOG_HEADER_SIZE, *end = r->data + r->size;
+    int64_t q[FLIGHT_LOG_FIELDS];
+    r->end = FLIGHT_LOG_HEADER_SIZE;
+    while (p < end) {
+        bool key = *p == 'K';
+        if (!key && r->num_keys == 0)
+            break;
+        const uint8_t *next = flight_log_decode(&codec, p, end, q);
+        if (!next)
+            break;
+        if (key) {
+            if (r->num_keys == cap) {
+                cap *= 2;
+                r->index = realloc(r->index, sizeof(struct flight_log_key) * cap);
+            }
+            r->index[r->num_keys++] = (struct flight_log_key){q[FLIGHT_LOG_TIME], p - r->data};
+        }
+        p = next;
+        r->end = p - r->data;
+    }
+}
+
+// Read the next record at the cursor.
+static bool flight_log_next(struct flight_log_reader *r, struct flight_log_record *rec) {
+    int64_t q[FLIGHT_LOG_FIELDS];
+    const uint8_t *p = flight_log_decode(&r->codec, r->data + r->pos, r->data + r->end, q);
+    if (!p)
+        return false;
+    r->pos = p - r->data;
+    flight_log_dequantize(q, rec);
+    return true;
+}
+
+// Put the cursor on the last record at or before t_ns, by way of the
+// keyframe before it.
+void flight_log_seek(struct flight_log_reader *r, Uint64 t_ns) {
+    size_t lo = 0, hi = r->num_keys;
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (r->index[mid].time_ns <= t_ns)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    r->pos = r->index[lo].offset;
+    r->codec = (struct flight_log_codec){0};
+    flight_log_next(r, &r->next);
+    r->prev = r->next;
+    r->at_end = false;
+    while (r->next.time_ns <= t_ns) {
+        r->prev = r->next;
+        if (!flight_log_next(r, &r->next)) {
+            r->next = r->prev;
+            r->at_end = true;
+            break;
+        }
+    }
+}
+
+bool flight_log_open(struct flight_log_reader *r, const char *path) {
+    *r = (struct flight_log_reader){0};
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "flight log: cannot open %s\n", path);
+        return false;
+    }
+    // logs run to a few MB an hour, simplest to hold one whole
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    r->data = malloc(size > 0 ? size : 1);
+    r->size = size > 0 && fread(r->data, 1, size, f) == (size_t)size ? size : 0;
+    fclose(f);
+
+    uint32_t version = 0;
+    if (r->size >= FLIGHT_LOG_HEADER_SIZE)
+        memcpy(&version, r->data + 4, 4);
+    if (r->size < FLIGHT_LOG_HEADER_SIZE || memcmp(r->data, FLIGHT_LOG_MAGIC, 4) != 0 ||
+        version != FLIGHT_LOG_VERSION) {
+        fprintf(stderr, "flight log: %s is not a version %d flight log\n", path,
+                FLIGHT_LOG_VERSION);
+        free(r->data);
+        return false;
+    }
+    memcpy(&r->start_wall_ns, r->data + 8, 8);
+    if (!flight_log_read_index(r)) {
+        fprintf(stderr, "flight log: %s was not closed, scanning for records\n", path);
+        flight_log_scan(r);
+    }
+    if (r->num_keys == 0) {
+        fprintf(stderr, "flight log: no records in %s\n", path);
+        free(r->data);
+        free(r->index);
+        return false;
+    }
+
+    // the last keyframe is close to the end, read on from it for the duration
+    flight_log_seek(r, UINT64_MAX);
+    r->duration_ns = r->next.time_ns;
+    flight_log_seek(r, 0);
+    return true;
+}
+
+void flight_log_close(struct flight_log_reader *r) {
+    free(r->data);
+    free(r->index);
+    *r = (struct flight_log_reader){0};
+}
+
+double flight_log_duration(const struct flight_log_reader *r) { return r->duration_ns * 1e-9; }
+
+// State t seconds into the log, interpolated between the records either
+// side, with the ECEF velocity in km/s and, if in is not NULL, the inputs
+// recorded then. Playing forward decodes on from the cursor; going back or
+// jumping more than a keyframe ahead seeks.
+void flight_log_at(struct flight_log_reader *r, double t, struct aircraft_state *ac,
+                   double vel[3], struct sim_input *in) {
+    Uint64 t_ns = t > 0 ? (Uint64)(t * 1e9) : 0;
+    if (t_ns < r->prev.time_ns || (!r->at_end && t_ns >= r->next.time_ns + FLIGHT_LOG_KEY_NS)) {
+        flight_log_seek(r, t_ns);
+    } else {
+        while (!r->at_end && r->next.time_ns <= t_ns) {
+            r->prev = r->next;
+            if (!flight_log_next(r, &r->next)) {
+                r->next = r->prev;
+                r->at_end = true;
+            }
+        }
+    }
+
+    const struct flight_log_record *a = &r->prev, *b = &r->next;
+    double f = 1, dt = (b->time_ns - a->time_ns) * 1e-9;
+    if (b->time_ns > a->time_ns) {
+        f = (double)(t_ns - a->time_ns) / (b->time_ns - a->time_ns);
+        f = f < 0 ? 0 : f > 1 ? 1 : f;
+    }
+    float max_speed = ac->max_speed; // not logged, the caller's aircraft keeps its own
+    *ac = b->ac;
+    ac->max_speed = max_speed;
+    for (int k = 0; k < 3; k++) {
+        ac->pos.raw[k] = a->ac.pos.raw[k] + (b->ac.pos.raw[k] - a->ac.pos.raw[k]) * f;
+        vel[k] = dt > 0 ? (b->ac.pos.raw[k] - a->ac.pos.raw[k]) / dt : 0;
+    }
+    ac->forward = sim_nlerp(a->ac.forward, b->ac.forward, f);
+    ac->up = sim_nlerp(a->ac.up, b->ac.up, f);
+    ac->right = glms_vec3_normalize(glms_vec3_cross(ac->forward, ac->up));
+    ecef_to_geodetic(ac->pos, &ac->lat, &ac->lon, &ac->height);
+    if (in)
+        *in = a->in;
+}
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef FLIGHT_PATH_H
+#define FLIGHT_PATH_H
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aircraft_state.h"
+
+// A flight path: aircraft poses at increasing times, linearly interpolated
+// in between. Used by the benchmark mode to fly the same route every run.
+//
+// Files are CSV with one sample per line:
+//
+//   time_s,lat_deg,lon_deg,height_m,heading_deg,pitch_deg,roll_deg
+//
+// Blank lines, '#' comments and a header line are skipped.
+
+struct flight_sample {
+    double time;                // s
+    double lat, lon, height;    // degrees, km
+    float heading, pitch, roll; // degrees
+};
+
+struct flight_path {
+    struct flight_sample *samples;
+    size_t count;
+};
+
+// Built-in route over the tile corner at 45N 73W, flown at 150 to 250 m/s:
+// a low pass, a climbing turn across the corner and a descending turn back
+// south, 40 s in all so a software-rendered run stays short. Longer routes
+// come from a file.
+static const struct flight_sample FLIGHT_PATH_DEFAULT[] = {
+    {0, 44.985, -73.035, 0.6, 45, 0, 0},
+    {5, 44.990, -73.028, 0.6, 45, 0, 0},
+    {10, 44.995, -73.021, 0.7, 45, 4, 0},
+    {15, 45.001, -73.011, 0.9, 60, 6, 20},
+    {20, 45.004, -72.997, 1.2, 80, 6, 25},
+    {25, 45.005, -72.982, 1.4, 90, 3, 0},
+    {30, 45.002, -72.968, 1.3, 120, -3, -20},
+    {35, 44.996, -72.959, 1.1, 150, -4, -25},
+    {40, 44.988, -72.954, 0.9, 160, -3, 0},
+};
+
+void flight_path_default(struct flight_path *fp) {
+    fp->count = sizeof(FLIGHT_PATH_DEFAULT) / sizeof(FLIGHT_PATH_DEFAULT[0]);
+    fp->samples = malloc(sizeof(FLIGHT_PATH_DEFAULT));
+    memcpy(fp->samples, FLIGHT_PATH_DEFAULT, sizeof(FLIGHT_PATH_DEFAULT));
+}
+
+bool flight_path_load(struct flight_path *fp, const char *path) {
+    *fp = (struct flight_path){0};
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "flight path: cannot open %s\n", path);
+        return false;
+    }
+    size_t cap = 0;
+    char line[256];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        struct flight_sample s;
+        double height_m;
+        if (sscanf(line, "%lf,%lf,%lf,%lf,%f,%f,%f", &s.time, &s.lat, &s.lon, &height_m,
+                   &s.heading, &s.pitch, &s.roll) != 7)
+            continue; // header, comment or blank
+        s.height = height_m / 1000;
+        if (fp->count > 0 && s.time <= fp->samples[fp->count - 1].time) {
+            fprintf(stderr, "flight path: %s:%d: time does not increase\n", path, lineno);
+            fclose(f);
+            free(fp->samples);
+            return false;
+        }
+        if (fp->count == cap) {
+            cap = cap ? cap * 2 : 256;
+            fp->samples = realloc(fp->samples, sizeof(struct flight_sample) * cap);
+        }
+        fp->samples[fp->count++] = s;
+    }
+    fclose(f);
+    if (fp->count == 0) {
+        fprintf(stderr, "flight path: no samples in %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+void flight_path_free(struct flight_path *fp) {
+    free(fp->samples);
+    *fp = (struct flight_path){0};
+}
+
+double flight_path_duration(const struct flight_path *fp) {
+    return fp->samples[fp->count - 1].time - fp->samples[0].time;
+}
+
+static double flight_path_lerp_angle(double a, double b, double t) {
+    return a + remainder(b - a, 360) * t;
+}
+
+// Pose t seconds into the path, clamped to its ends, and the ECEF velocity
+// in km/s at that point.
+void flight_path_at(const struct flight_path *fp, double t, struct aircraft_state *ac,
+                    double vel[3]) {
+    const struct flight_sample *s = fp->samples;
+    t += s[0].time;
+    // last sample at or before t, or the first
+    size_t lo = 0, hi = fp->count;
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (s[mid].time <= t)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    if (lo + 1 == fp->count && lo > 0)
+        lo--; // past the end: stay on the last segment
+    const struct flight_sample *a = &s[lo], *b = &s[lo + 1 < fp->count ? lo + 1 : lo];
+    double f = b->time > a->time ? (t - a->time) / (b->time - a->time) : 0;
+    f = f < 0 ? 0 : f > 1 ? 1 : f;
+
+    aircraft_set_pose(ac, a->lat + (b->lat - a->lat) * f,
+                      flight_path_lerp_angle(a->lon, b->lon, f),
+                      a->height + (b->height - a->height) * f,
+                      flight_path_lerp_angle(a->heading, b->heading, f),
+                      a->pitch + (b->pitch - a->pitch) * f,
+                      flight_path_lerp_angle(a->roll, b->roll, f));
+
+    double pa[3], pb[3];
+    geodetic_to_ecef_d(deg2rad(a->lat), deg2rad(a->lon), a->height, pa);
+    geodetic_to_ecef_d(deg2rad(b->lat), deg2rad(b->lon), b->height, pb);
+    for (int k = 0; k < 3; k++)
+        vel[k] = b->time > a->time ? (pb[k] - pa[k]) / (b->time - a->time) : 0;
+}
+
+#endif
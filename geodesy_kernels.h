@@ -0,0 +1,165 @@
+// Geodetic conversion kernels, instantiated by geodesy.h once per vector
+// width. The includer defines:
+//
+//   GEO_W          lanes per vector
+//   GEO_FN(name)   name with the variant suffix
+//   GEO_SQRT(v)    lane-wise square root of a geo_v
+//
+// Everything else is plain GCC vector arithmetic, so every width computes
+// exactly the same operations and branches become lane selects.
+
+typedef double GEO_FN(geo_v) __attribute__((vector_size(GEO_W * 8)));
+typedef long long GEO_FN(geo_m) __attribute__((vector_size(GEO_W * 8)));
+#define geo_v GEO_FN(geo_v)
+#define geo_m GEO_FN(geo_m)
+
+static inline geo_v GEO_FN(geo_splat)(double x) {
+    geo_v v;
+    for (int i = 0; i < GEO_W; i++)
+        v[i] = x;
+    return v;
+}
+#define S(x) GEO_FN(geo_splat)(x)
+
+static inline geo_v GEO_FN(geo_select)(geo_m m, geo_v a, geo_v b) {
+    return (geo_v)(((geo_m)a & m) | ((geo_m)b & ~m));
+}
+#define SELECT GEO_FN(geo_select)
+
+static inline geo_v GEO_FN(geo_load)(const double *p) {
+    geo_v v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void GEO_FN(geo_store)(double *p, geo_v v) { memcpy(p, &v, sizeof(v)); }
+
+// floor() of values in [0, 2^52)
+static inline geo_v GEO_FN(geo_floor)(geo_v x) {
+    geo_v t = (x + S(0x1p52)) - S(0x1p52);
+    return SELECT(t > x, t - S(1), t);
+}
+
+// Cephes sin/cos: reduce to octants of pi/4 in three parts, then the
+// polynomial on |z| <= pi/4 that fits the octant.
+static inline void GEO_FN(geo_sincos)(geo_v x, geo_v *s, geo_v *c) {
+    geo_m neg = x < S(0);
+    geo_v ax = SELECT(neg, -x, x);
+    geo_v j = GEO_FN(geo_floor)(ax * S(4 / M_PI));
+    geo_v odd = j - S(2) * GEO_FN(geo_floor)(j * S(0.5));
+    j += odd;
+    geo_v z = ((ax - j * S(7.85398125648498535156E-1)) - j * S(3.77489470793079817668E-8)) -
+              j * S(2.69515142907905952645E-15);
+    j -= S(8) * GEO_FN(geo_floor)(j * S(0.125));
+    geo_v zz = z * z;
+
+    geo_v ps = S(1.58962301576546568060E-10);
+    ps = ps * zz + S(-2.50507477628578072866E-8);
+    ps = ps * zz + S(2.75573136213857245213E-6);
+    ps = ps * zz + S(-1.98412698295895385996E-4);
+    ps = ps * zz + S(8.33333333332211858878E-3);
+    ps = ps * zz + S(-1.66666666666666307295E-1);
+    ps = z + z * zz * ps;
+
+    geo_v pc = S(-1.13585365213876817300E-11);
+    pc = pc * zz + S(2.08757008419747316778E-9);
+    pc = pc * zz + S(-2.75573141792967388112E-7);
+    pc = pc * zz + S(2.48015872888517045348E-5);
+    pc = pc * zz + S(-1.38888888888730564116E-3);
+    pc = pc * zz + S(4.16666666666665929218E-2);
+    pc = S(1) - S(0.5) * zz + zz * zz * pc;
+
+    // octants 2 and 6 swap the polynomials, 4 to 7 flip sin, 2 to 5 flip cos
+    geo_m swap = (j == S(2)) | (j == S(6));
+    geo_v sv = SELECT(swap, pc, ps), cv = SELECT(swap, ps, pc);
+    sv = SELECT(j >= S(4), -sv, sv);
+    cv = SELECT((j >= S(2)) & (j <= S(4)), -cv, cv);
+    *s = SELECT(neg, -sv, sv);
+    *c = cv;
+}
+
+// Cephes atan on [0, 1]
+static inline geo_v GEO_FN(geo_atan01)(geo_v x) {
+    geo_m big = x > S(0.66);
+    geo_v y = SELECT(big, S(M_PI_4), S(0));
+    x = SELECT(big, (x - S(1)) / (x + S(1)), x);
+    geo_v z = x * x;
+    geo_v p = S(-8.750608600031904122785E-1);
+    p = p * z + S(-1.615753718733365076637E1);
+    p = p * z + S(-7.500855792314704667340E1);
+    p = p * z + S(-1.228866684490136173410E2);
+    p = p * z + S(-6.485021904942025371773E1);
+    geo_v q = z + S(2.485846490142306297962E1);
+    q = q * z + S(1.650270098316988542046E2);
+    q = q * z + S(4.328810604912902668951E2);
+    q = q * z + S(4.853903996359136964868E2);
+    q = q * z + S(1.945506571482613964425E2);
+    z = x * (z * p / q) + x;
+    return y + SELECT(big, z + S(0.5 * 6.123233995736765886130E-17), z);
+}
+
+static inline geo_v GEO_FN(geo_atan2)(geo_v y, geo_v x) {
+    geo_v ax = SELECT(x < S(0), -x, x), ay = SELECT(y < S(0), -y, y);
+    geo_m steep = ay > ax;
+    geo_v num = SELECT(steep, ax, ay), den = SELECT(steep, ay, ax);
+    geo_v r = GEO_FN(geo_atan01)(SELECT(den > S(0), num / den, S(0)));
+    r = SELECT(steep, S(M_PI_2) - r, r);
+    r = SELECT(x < S(0), S(M_PI) - r, r);
+    return SELECT(y < S(0), -r, r);
+}
+
+static void GEO_FN(geodetic_to_ecef_kernel)(const double *lat, const double *lon,
+                                             const double *h, double *x, double *y, double *z,
+                                             size_t n) {
+    for (size_t i = 0; i + GEO_W <= n; i += GEO_W) {
+        geo_v sp, cp, sl, cl;
+        GEO_FN(geo_sincos)(GEO_FN(geo_load)(lat + i), &sp, &cp);
+        GEO_FN(geo_sincos)(GEO_FN(geo_load)(lon + i), &sl, &cl);
+        geo_v hv = GEO_FN(geo_load)(h + i);
+        geo_v nv = S(WGS84_A) / GEO_SQRT(S(1) - S(WGS84_E2) * sp * sp);
+        GEO_FN(geo_store)(x + i, (nv + hv) * cp * cl);
+        GEO_FN(geo_store)(y + i, (nv + hv) * cp * sl);
+        GEO_FN(geo_store)(z + i, (S(1 - WGS84_E2) * nv + hv) * sp);
+    }
+}
+
+// Bowring's method: start from the parametric latitude of the point's
+// direction and refine twice, which converges to well below a micrometer for
+// anything from the Earth's core to orbit. Height comes from the normal
+// through the final latitude, which stays accurate at the poles.
+static void GEO_FN(ecef_to_geodetic_kernel)(const double *x, const double *y, const double *z,
+                                             double *lat, double *lon, double *h, size_t n) {
+    const double a = WGS84_A, b = WGS84_B;
+    const double ep2 = (a * a - b * b) / (b * b);
+    for (size_t i = 0; i + GEO_W <= n; i += GEO_W) {
+        geo_v xv = GEO_FN(geo_load)(x + i), yv = GEO_FN(geo_load)(y + i);
+        geo_v zv = GEO_FN(geo_load)(z + i);
+        geo_v p = GEO_SQRT(xv * xv + yv * yv);
+
+        // parametric latitude as an unnormalized (sin, cos) pair
+        geo_v su = zv * S(a), cu = p * S(b);
+        geo_v num, den;
+        for (int it = 0; it < 2; it++) {
+            geo_v inv = S(1) / GEO_SQRT(su * su + cu * cu);
+            su *= inv;
+            cu *= inv;
+            num = zv + S(ep2 * b) * su * su * su;
+            den = p - S(WGS84_E2 * a) * cu * cu * cu;
+            // parametric latitude of the new estimate: tan u = (b / a) tan phi
+            su = num * S(b);
+            cu = den * S(a);
+        }
+        geo_v inv = S(1) / GEO_SQRT(num * num + den * den);
+        geo_v sp = num * inv, cp = den * inv;
+
+        GEO_FN(geo_store)(lat + i, GEO_FN(geo_atan2)(num, den));
+        GEO_FN(geo_store)(lon + i, GEO_FN(geo_atan2)(yv, xv));
+        GEO_FN(geo_store)(h + i,
+                          p * cp + zv * sp - S(a) * GEO_SQRT(S(1) - S(WGS84_E2) * sp * sp));
+    }
+}
+
+#undef geo_v
+#undef geo_m
+#undef S
+#undef SELECT
@@ -0,0 +1,404 @@
+#ifndef HUD_H
+#define HUD_H
+
+#include <GL/glew.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aircraft_state.h"
+
+// Head-up symbology: a primary flight display drawn as 2D vectors over the
+// scene.
+//
+// Everything a frame draws is appended to one array of vertices in screen
+// pixels, y down, and hud_flush() uploads it into an orphaned buffer and
+// draws it in a single call. A stroke is a quad a pixel wider than the line
+// all round. Each vertex carries its offset from the middle of the stroke
+// and the stroke's half extents, and hud.fs turns the distance to the edge
+// into coverage. That anti-aliases lines of any width without multisampling
+// or glLineWidth(), which core profiles limit to one pixel. Filled triangles
+// carry no offset and come out fully covered.
+//
+// Text is a stroke font on a 4 x 6 grid with the digits, compass points and
+// the few signs the tapes need.
+
+#define HUD_RGBA(r, g, b, a)                                                                  \
+    ((uint32_t)(r) | (uint32_t)(g) << 8 | (uint32_t)(b) << 16 | (uint32_t)(a) << 24)
+#define HUD_GREEN HUD_RGBA(0, 255, 64, 255)
+#define HUD_YELLOW HUD_RGBA(255, 255, 0, 255)
+#define HUD_BLACK HUD_RGBA(0, 0, 0, 255)
+#define HUD_SHADE HUD_RGBA(0, 0, 0, 96) // behind the tapes
+
+struct hud_vertex {
+    float x, y;   // pixels
+    float ex, ey; // offset from the middle of the stroke, across and along it
+    float hx, hy; // half width and half length of the stroke
+    uint32_t color;
+};
+
+struct hud {
+    GLuint shader, vao, vbo;
+    GLint screen_loc;
+    struct hud_vertex *verts;
+    size_t count, cap;
+};
+
+// What the display shows, see hud_flight_from().
+struct hud_flight {
+    float pitch, roll, heading; // radians, roll positive right wing down
+    float speed, altitude;      // kt over the ground, ft above the ellipsoid
+    float path_x, path_y;       // flight path marker, pixels from the screen centre
+    bool path_visible;
+    float focal; // pixels per unit of tangent from the view axis
+};
+
+void hud_set_program(struct hud *h, GLuint p) {
+    h->shader = p;
+    h->screen_loc = glGetUniformLocation(p, "screen");
+}
+
+void hud_init(struct hud *h, GLuint shader) {
+    *h = (struct hud){0};
+    hud_set_program(h, shader);
+    glGenVertexArrays(1, &h->vao);
+    glGenBuffers(1, &h->vbo);
+    glBindVertexArray(h->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, h->vbo);
+    GLsizei stride = sizeof(struct hud_vertex);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, stride,
+                          (void *)offsetof(struct hud_vertex, x));
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride,
+                          (void *)offsetof(struct hud_vertex, ex));
+    glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride,
+                          (void *)offsetof(struct hud_vertex, color));
+    for (int i = 0; i < 3; i++)
+        glEnableVertexAttribArray(i);
+    glBindVertexArray(0);
+}
+
+void hud_destroy(struct hud *h) {
+    glDeleteBuffers(1, &h->vbo);
+    glDeleteVertexArrays(1, &h->vao);
+    free(h->verts);
+    *h = (struct hud){0};
+}
+
+static struct hud_vertex *hud_reserve(struct hud *h, size_t n) {
+    if (h->count + n > h->cap) {
+        h->cap = h->cap ? h->cap * 2 : 4096;
+        while (h->count + n > h->cap)
+            h->cap *= 2;
+        h->verts = realloc(h->verts, sizeof(struct hud_vertex) * h->cap);
+    }
+    struct hud_vertex *v = &h->verts[h->count];
+    h->count += n;
+    return v;
+}
+
+void hud_triangle(struct hud *h, float x0, float y0, float x1, float y1, float x2, float y2,
+                  uint32_t color) {
+    struct hud_vertex *v = hud_reserve(h, 3);
+    v[0] = (struct hud_vertex){x0, y0, 0, 0, 1, 1, color};
+    v[1] = (struct hud_vertex){x1, y1, 0, 0, 1, 1, color};
+    v[2] = (struct hud_vertex){x2, y2, 0, 0, 1, 1, color};
+}
+
+void hud_rect(struct hud *h, float x0, float y0, float x1, float y1, uint32_t color) {
+    hud_triangle(h, x0, y0, x1, y0, x1, y1, color);
+    hud_triangle(h, x0, y0, x1, y1, x0, y1, color);
+}
+
+// A stroke of the given width in pixels. Its ends are square and reach half
+// the width past the end points, so strokes sharing a point join cleanly.
+void hud_line(struct hud *h, float x0, float y0, float x1, float y1, float width,
+              uint32_t color) {
+    float dx = x1 - x0, dy = y1 - y0;
+    float len = sqrtf(dx * dx + dy * dy);
+    float ux = len > 0 ? dx / len : 1, uy = len > 0 ? dy / len : 0;
+    float hx = width / 2, hy = len / 2 + width / 2;
+    float ax = hx + 1, ay = hy + 1; // room for the anti-aliased edge
+    float mx = (x0 + x1) / 2, my = (y0 + y1) / 2;
+
+    struct hud_vertex c[4];
+    for (int i = 0; i < 4; i++) {
+        float ex = i & 1 ? ax : -ax, ey = i & 2 ? ay : -ay;
+        c[i] = (struct hud_vertex){
+            mx - uy * ex + ux * ey, my + ux * ex + uy * ey, ex, ey, hx, hy, color,
+        };
+    }
+    struct hud_vertex *v = hud_reserve(h, 6);
+    v[0] = c[0], v[1] = c[1], v[2] = c[3];
+    v[3] = c[0], v[4] = c[3], v[5] = c[2];
+}
+
+void hud_circle(struct hud *h, float x, float y, float r, float width, uint32_t color) {
+    const int n = 16;
+    for (int i = 0; i < n; i++) {
+        float a0 = 2 * M_PI * i / n, a1 = 2 * M_PI * (i + 1) / n;
+        hud_line(h, x + r * cosf(a0), y + r * sinf(a0), x + r * cosf(a1), y + r * sinf(a1), width,
+                 color);
+    }
+}
+
+void hud_box(struct hud *h, float x0, float y0, float x1, float y1, float width, uint32_t color) {
+    hud_line(h, x0, y0, x1, y0, width, color);
+    hud_line(h, x1, y0, x1, y1, width, color);
+    hud_line(h, x1, y1, x0, y1, width, color);
+    hud_line(h, x0, y1, x0, y0, width, color);
+}
+
+// Polylines through grid points given as pairs of digits, x then y from the
+// top left, with '|' between polylines.
+static const struct {
+    char c;
+    const char *strokes;
+} HUD_FONT[] = {
+    {'0', "0040460600"},   {'1', "102026|1636"}, {'2', "004043030646"},
+    {'3', "00404606|0343"}, {'4', "000343|4046"}, {'5', "400003434606"},
+    {'6', "400006464303"}, {'7', "004046"},      {'8', "0040460600|0343"},
+    {'9', "430300404606"}, {'N', "06004640"},    {'E', "40000646|0333"},
+    {'S', "400003434606"}, {'W', "0006234640"},  {'-', "0343"},
+    {'.', "2526"},
+};
+
+static const char *hud_glyph(char c) {
+    for (size_t i = 0; i < sizeof(HUD_FONT) / sizeof(HUD_FONT[0]); i++)
+        if (HUD_FONT[i].c == c)
+            return HUD_FONT[i].strokes;
+    return ""; // blank
+}
+
+#define HUD_GLYPH_ADVANCE 6 // grid units, 4 for the glyph and 2 of space
+
+float hud_text_width(const char *s, float size) {
+    size_t n = strlen(s);
+    return n ? (n * HUD_GLYPH_ADVANCE - 2) * size / 6 : 0;
+}
+
+// Text size pixels tall, vertically centred on y. align is -1 to start at x,
+// 0 to centre on it and 1 to end there.
+void hud_text(struct hud *h, float x, float y, float size, int align, uint32_t color,
+              const char *s) {
+    float scale = size / 6;
+    x -= hud_text_width(s, size) * (align + 1) / 2;
+    y -= size / 2;
+    float width = size > 12 ? 2 : 1.5;
+    for (; *s; s++, x += HUD_GLYPH_ADVANCE * scale) {
+        const char *g = hud_glyph(*s);
+        for (; *g; g += 2) {
+            if (g[2] == '|')
+                g++; // the polyline ends at g, the next starts after the '|'
+            else if (g[2])
+                hud_line(h, x + (g[0] - '0') * scale, y + (g[1] - '0') * scale,
+                         x + (g[2] - '0') * scale, y + (g[3] - '0') * scale, width, color);
+        }
+    }
+}
+
+void hud_begin(struct hud *h) { h->count = 0; }
+
+// Draw everything added since hud_begin() over a w x h pixel viewport.
+void hud_flush(struct hud *h, int w, int hgt) {
+    if (h->count == 0)
+        return;
+    glBindBuffer(GL_ARRAY_BUFFER, h->vbo);
+    size_t bytes = sizeof(struct hud_vertex) * h->count;
+    glBufferData(GL_ARRAY_BUFFER, bytes, NULL, GL_STREAM_DRAW); // orphan last frame's
+    glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, h->verts);
+
+    glUseProgram(h->shader);
+    glUniform2f(h->screen_loc, w, hgt);
+    glBindVertexArray(h->vao);
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDrawArrays(GL_TRIANGLES, 0, h->count);
+    glDisable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+    glBindVertexArray(0);
+}
+
+// Attitude and motion as the display shows them: angles against the local
+// horizon and north, with the view looking along ac->forward as render()
+// sets it up. vel is in km/s ECEF.
+void hud_flight_from(struct hud_flight *f, const struct aircraft_state *ac, const double vel[3],
+                     float focal) {
+    double slat = sin(ac->lat), clat = cos(ac->lat), slon = sin(ac->lon), clon = cos(ac->lon);
+    vec3s east = {{-slon, clon, 0}};
+    vec3s north = {{-slat * clon, -slat * slon, clat}};
+    vec3s up = {{clat * clon, clat * slon, slat}};
+    // the camera basis of glms_look()
+    vec3s fw = glms_vec3_normalize(ac->forward);
+    vec3s right = glms_vec3_normalize(glms_vec3_cross(fw, ac->up));
+    vec3s cam_up = glms_vec3_cross(right, fw);
+
+    f->pitch = asinf(fmaxf(-1, fminf(1, glms_vec3_dot(fw, up))));
+    f->heading = atan2f(glms_vec3_dot(fw, east), glms_vec3_dot(fw, north));
+    if (f->heading < 0)
+        f->heading += 2 * M_PI;
+    f->roll = atan2f(-glms_vec3_dot(right, up), glms_vec3_dot(cam_up, up));
+    f->focal = focal;
+
+    double speed = sqrt(vel[0] * vel[0] + vel[1] * vel[1] + vel[2] * vel[2]);
+    f->speed = speed * 3600 / 1.852;
+    f->altitude = ac->height * 1000 / 0.3048;
+
+    vec3s v = {{vel[0], vel[1], vel[2]}};
+    float vx = glms_vec3_dot(v, right), vy = glms_vec3_dot(v, cam_up), vz = glms_vec3_dot(v, fw);
+    f->path_visible = speed > 1e-5 && vz > 0.1 * speed; // within about 84 degrees of the axis
+    if (f->path_visible) {
+        f->path_x = focal * vx / vz;
+        f->path_y = -focal * vy / vz;
+    }
+}
+
+// Pitch ladder, conformal with the scene: a rung lies where its elevation
+// straight ahead projects, on a line rotated with the horizon.
+static void hud_pitch_ladder(struct hud *h, const struct hud_flight *f, float cx, float cy,
+                             float unit, float reach) {
+    // toward the sky, and along the horizon to the right
+    float sx = -sinf(f->roll), sy = -cosf(f->roll);
+    float ax = cosf(f->roll), ay = -sinf(f->roll);
+    float pitch = f->pitch * (180 / M_PI);
+    for (int p = -90; p <= 90; p += 5) {
+        float rel = (p - pitch) * (M_PI / 180);
+        if (fabsf(rel) > 1.2f)
+            continue;
+        float d = f->focal * tanf(rel);
+        if (fabsf(d) > reach)
+            continue;
+        float mx = cx + sx * d, my = cy + sy * d;
+        if (p == 0) {
+            float half = 240 * unit, gap = 60 * unit;
+            for (int side = -1; side <= 1; side += 2)
+                hud_line(h, mx + ax * gap * side, my + ay * gap * side, mx + ax * half * side,
+                         my + ay * half * side, 2, HUD_GREEN);
+            continue;
+        }
+        float half = (p % 10 ? 45 : 60) * unit, gap = 25 * unit;
+        float tick = (p > 0 ? -8 : 8) * unit; // toward the horizon
+        for (int side = -1; side <= 1; side += 2) {
+            float x0 = mx + ax * gap * side, y0 = my + ay * gap * side;
+            float x1 = mx + ax * half * side, y1 = my + ay * half * side;
+            if (p > 0) {
+                hud_line(h, x0, y0, x1, y1, 1.5, HUD_GREEN);
+            } else { // dashed below the horizon
+                for (int k = 0; k < 3; k++) {
+                    float t0 = k / 3.0f, t1 = t0 + 0.2f;
+                    hud_line(h, x0 + (x1 - x0) * t0, y0 + (y1 - y0) * t0, x0 + (x1 - x0) * t1,
+                             y0 + (y1 - y0) * t1, 1.5, HUD_GREEN);
+                }
+            }
+            hud_line(h, x1, y1, x1 + sx * tick, y1 + sy * tick, 1.5, HUD_GREEN);
+            if (p % 10 == 0) {
+                char label[8];
+                snprintf(label, sizeof(label), "%d", abs(p));
+                float lx = x1 + ax * side * 14 * unit, ly = y1 + ay * side * 14 * unit;
+                hud_text(h, lx, ly, 10 * unit, -side, HUD_GREEN, label);
+            }
+        }
+    }
+}
+
+// Vertical tape centred on cy showing value, ticks every step and labels
+// every label_step. side is -1 for a tape left of centre, 1 for right.
+static void hud_tape(struct hud *h, float x, float cy, float half, float px_per_unit,
+                     float value, int step, int label_step, int side, float unit) {
+    float width = 70 * unit, inner = x - side * width / 2;
+    hud_rect(h, x - width / 2, cy - half, x + width / 2, cy + half, HUD_SHADE);
+    float lo = value - half / px_per_unit, hi = value + half / px_per_unit;
+    for (int v = (int)ceilf(lo / step) * step; v <= hi; v += step) {
+        float y = cy - (v - value) * px_per_unit;
+        bool major = v % label_step == 0;
+        float len = (major ? 12 : 6) * unit;
+        hud_line(h, inner, y, inner + side * len, y, 1.5, HUD_GREEN);
+        if (major && fabsf(y - cy) > 14 * unit) { // clear of the readout
+            char label[16];
+            snprintf(label, sizeof(label), "%d", v);
+            hud_text(h, inner + side * (len + 6 * unit), y, 10 * unit, -side, HUD_GREEN, label);
+        }
+    }
+    hud_line(h, inner, cy - half, inner, cy + half, 1.5, HUD_GREEN);
+
+    // current value, boxed and pointing into the centre
+    char label[16];
+    snprintf(label, sizeof(label), "%d", (int)lroundf(value));
+    float bh = 11 * unit, bw = width / 2 + 4 * unit;
+    float bx0 = side < 0 ? inner - bw * 2 : inner + 8 * unit, bx1 = bx0 + bw * 2 - 8 * unit;
+    hud_rect(h, bx0, cy - bh, bx1, cy + bh, HUD_BLACK);
+    hud_box(h, bx0, cy - bh, bx1, cy + bh, 1.5, HUD_GREEN);
+    float tip = side < 0 ? bx1 + 8 * unit : bx0 - 8 * unit;
+    float base = side < 0 ? bx1 : bx0;
+    hud_line(h, base, cy - 5 * unit, tip, cy, 1.5, HUD_GREEN);
+    hud_line(h, tip, cy, base, cy + 5 * unit, 1.5, HUD_GREEN);
+    hud_text(h, (bx0 + bx1) / 2, cy, 12 * unit, 0, HUD_GREEN, label);
+}
+
+static void hud_heading_tape(struct hud *h, const struct hud_flight *f, float cx, float y,
+                             float unit) {
+    float half = 200 * unit, px_per_deg = 6 * unit;
+    float heading = f->heading * (180 / M_PI);
+    hud_rect(h, cx - half, y - 24 * unit, cx + half, y + 16 * unit, HUD_SHADE);
+    hud_line(h, cx - half, y + 16 * unit, cx + half, y + 16 * unit, 1.5, HUD_GREEN);
+    float lo = heading - half / px_per_deg;
+    for (int d = (int)ceilf(lo / 5) * 5; d <= heading + half / px_per_deg; d += 5) {
+        float x = cx + (d - heading) * px_per_deg;
+        int deg = ((d % 360) + 360) % 360;
+        bool major = deg % 10 == 0;
+        hud_line(h, x, y + 16 * unit, x, y + (major ? 6 : 11) * unit, 1.5, HUD_GREEN);
+        if (major && fabsf(x - cx) > 36 * unit) { // clear of the readout
+            char label[8];
+            const char *cardinal[] = {"N", "E", "S", "W"};
+            if (deg % 90 == 0)
+                snprintf(label, sizeof(label), "%s", cardinal[deg / 90]);
+            else
+                snprintf(label, sizeof(label), "%02d", deg / 10);
+            hud_text(h, x, y - 6 * unit, 10 * unit, 0, HUD_GREEN, label);
+        }
+    }
+    char label[8];
+    snprintf(label, sizeof(label), "%03d", (int)lroundf(heading) % 360);
+    float bw = 24 * unit, bh = 10 * unit, by = y - 10 * unit;
+    hud_rect(h, cx - bw, by - bh, cx + bw, by + bh, HUD_BLACK);
+    hud_box(h, cx - bw, by - bh, cx + bw, by + bh, 1.5, HUD_GREEN);
+    hud_text(h, cx, by, 12 * unit, 0, HUD_GREEN, label);
+    hud_triangle(h, cx, y + 6 * unit, cx - 5 * unit, y + 16 * unit, cx + 5 * unit, y + 16 * unit,
+                 HUD_GREEN);
+}
+
+// Primary flight display over a w x h viewport: pitch ladder, heading tape,
+// speed and altitude tapes, flight path marker and the aircraft symbol.
+void hud_draw_pfd(struct hud *h, const struct hud_flight *f, int w, int hgt) {
+    float cx = w / 2.0f, cy = hgt / 2.0f;
+    float unit = fmaxf(0.75f, hgt / 768.0f);
+
+    hud_pitch_ladder(h, f, cx, cy, unit, hgt * 0.35f);
+    hud_heading_tape(h, f, cx, 40 * unit, unit);
+    float tape_x = fminf(300 * unit, w * 0.38f);
+    hud_tape(h, cx - tape_x, cy, 160 * unit, 3 * unit, f->speed, 10, 20, -1, unit);
+    hud_tape(h, cx + tape_x, cy, 160 * unit, 0.3f * unit, f->altitude, 100, 500, 1, unit);
+
+    if (f->path_visible) {
+        float x = cx + f->path_x, y = cy + f->path_y, r = 7 * unit;
+        hud_circle(h, x, y, r, 1.5, HUD_GREEN);
+        hud_line(h, x - r, y, x - 3 * r, y, 1.5, HUD_GREEN);
+        hud_line(h, x + r, y, x + 3 * r, y, 1.5, HUD_GREEN);
+        hud_line(h, x, y - r, x, y - 2 * r, 1.5, HUD_GREEN);
+    }
+
+    // aircraft symbol: two yellow chevrons outlined in black
+    for (int side = -1; side <= 1; side += 2) {
+        float x1 = cx + side * 100, x2 = cx + side * 70, y = cy + 50;
+        hud_triangle(h, cx, cy, x1, y, x2, y, HUD_YELLOW);
+        hud_line(h, cx, cy, x1, y, 2, HUD_BLACK);
+        hud_line(h, x1, y, x2, y, 2, HUD_BLACK);
+        hud_line(h, x2, y, cx, cy, 2, HUD_BLACK);
+    }
+}
+
+#endif
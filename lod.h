@@ -0,0 +1,139 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include <cglm/struct.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "aircraft_state.h"
+#include "cull.h"
+#include "tdb.h"
+
+// Chunked quadtree level of detail.
+//
+// Every tile is the root of a quadtree whose nodes are all drawn with the same
+// patch of patch_res x patch_res quads, so a node at level L has 2^L times the
+// sample density of the root. Nodes are split breadth first, closest first,
+// while they are nearer to the eye than factor times their own size and the
+// frame still has room for max_chunks patches. The triangle count per frame is
+// therefore bounded no matter how many tiles are in view. Children that fall
+// outside the view are dropped instead of spending the budget.
+
+struct lod_params {
+    int patch_res;
+    int max_chunks;
+    float factor;
+};
+
+struct lod_chunk {
+    int tile;
+    int level;
+    int mip;            // heightmap level whose spacing matches the patch
+    float u0, v0, size; // square covered within the tile, in [0, 1]
+    float dist;         // km from the eye
+};
+
+// Deepest level that still adds detail to the tile.
+static int lod_max_level(const struct lod_params *p, const struct tdb_entry *e) {
+    int res = e->xres > e->yres ? e->xres : e->yres;
+    int level = 0;
+    while (p->patch_res << level < res - 1)
+        level++;
+    return level;
+}
+
+// Coarsest mip level that still has a sample for every patch vertex.
+static int lod_chunk_mip(const struct lod_params *p, const struct tdb_entry *e,
+                         const struct lod_chunk *c) {
+    int res = e->xres > e->yres ? e->xres : e->yres;
+    float spacing = (res - 1) * c->size / p->patch_res;
+    int mip = 0;
+    while (spacing >= 2 && mip < tdb_pyramid_levels(e->xres, e->yres)) {
+        spacing *= 0.5f;
+        mip++;
+    }
+    return mip;
+}
+
+static float lod_chunk_distance(const struct tdb_entry *e, const struct lod_chunk *c,
+                                const double eye[3]) {
+    double lat = e->lat - (c->v0 + c->size * 0.5);
+    double lon = e->lon + (c->u0 + c->size * 0.5);
+    double center[3];
+    geodetic_to_ecef_d(glm_rad(lat), glm_rad(lon), 0, center);
+    double dx = eye[0] - center[0], dy = eye[1] - center[1], dz = eye[2] - center[2];
+    double d = sqrt(dx * dx + dy * dy + dz * dz) - M_SQRT1_2 * WGS84_A * glm_rad(c->size);
+    return d > 0 ? d : 0;
+}
+
+static int lod_chunk_cmp(const void *a, const void *b) {
+    const struct lod_chunk *ca = *(struct lod_chunk *const *)a;
+    const struct lod_chunk *cb = *(struct lod_chunk *const *)b;
+    return (ca->dist > cb->dist) - (ca->dist < cb->dist);
+}
+
+// Fill out with at most p->max_chunks patches covering the given root tiles,
+// skipping chunks cv culls when it is not NULL. Returns the number of chunks.
+int lod_select(const struct lod_params *p, const double eye[3], const struct tdb *db,
+               const int *roots, int num_roots, const struct cull_view *cv,
+               struct lod_chunk *out) {
+    const struct tdb_entry *entries = db->entries;
+    int n = 0;
+    for (int i = 0; i < num_roots && n < p->max_chunks; i++) {
+        out[n] = (struct lod_chunk){.tile = roots[i], .size = 1};
+        out[n].dist = lod_chunk_distance(&entries[roots[i]], &out[n], eye);
+        out[n].mip = lod_chunk_mip(p, &entries[roots[i]], &out[n]);
+        n++;
+    }
+
+    struct lod_chunk **split = malloc(sizeof(struct lod_chunk *) * p->max_chunks);
+    for (int level = 0;; level++) {
+        int num_split = 0;
+        for (int i = 0; i < n; i++) {
+            struct lod_chunk *c = &out[i];
+            float node_km = WGS84_A * glm_rad(c->size);
+            if (c->level == level && level < lod_max_level(p, &entries[c->tile]) &&
+                c->dist < p->factor * node_km)
+                split[num_split++] = c;
+        }
+        if (num_split == 0)
+            break;
+        qsort(split, num_split, sizeof(struct lod_chunk *), lod_chunk_cmp);
+
+        for (int i = 0; i < num_split && n + 3 <= p->max_chunks; i++) {
+            struct lod_chunk parent = *split[i];
+            const struct tdb_entry *e = &entries[parent.tile];
+            int hmin, hmax;
+            tdb_tile_range(db, parent.tile, &hmin, &hmax);
+
+            float half = parent.size * 0.5f;
+            int kept = 0;
+            for (int q = 0; q < 4; q++) {
+                struct lod_chunk child = {
+                    .tile = parent.tile,
+                    .level = level + 1,
+                    .u0 = parent.u0 + (q & 1) * half,
+                    .v0 = parent.v0 + (q >> 1) * half,
+                    .size = half,
+                };
+                if (cv && cull_box(cv, e->lat - child.v0, e->lon + child.u0, half, half,
+                                   hmin * 0.001, hmax * 0.001) != CULL_VISIBLE)
+                    continue;
+                child.dist = lod_chunk_distance(e, &child, eye);
+                child.mip = lod_chunk_mip(p, e, &child);
+                *(kept++ == 0 ? split[i] : &out[n++]) = child;
+            }
+            if (kept == 0)
+                split[i]->size = 0; // removed below
+        }
+    }
+    free(split);
+
+    int kept = 0;
+    for (int i = 0; i < n; i++)
+        if (out[i].size > 0)
+            out[kept++] = out[i];
+    return kept;
+}
+
+#endif
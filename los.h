@@ -0,0 +1,529 @@
+#ifndef LOS_H
+#define LOS_H
+
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "aircraft_state.h"
+#include "terrain.h"
+
+// Rays against the terrain, for picking and line of sight.
+//
+// The surface is the one terrain_height_at() describes: bilinear between
+// samples, and the ellipsoid itself wherever there is no tile. Rays are
+// straight lines in ECEF, marched in geodetic coordinates.
+//
+// Every tile gets a max-height quadtree over its cells, the quads between
+// four samples. A node at level l covers 2^l x 2^l cells. Levels from
+// LOS_STORED_LEVEL up are stored; the two below are taken from the samples
+// when reached. From each point on the ray, the largest node under it whose
+// maximum is below the ray bounds a safe step: to where the ray leaves the
+// node's footprint or comes down to its maximum, whichever is nearer. Only
+// cells the ray dips into are walked finely, and the crossing is refined by
+// bisection.
+//
+// A tree is built the first time a ray enters its tile, from the samples the
+// ray reads anyway. Once trees take more than LOS_TREE_BUDGET bytes, the
+// least recently used ones that no ray holds are freed.
+//
+// Latitude and longitude are taken to change linearly over a step, so steps
+// are capped at LOS_MAX_STEP, which keeps the error to a couple of meters.
+// The ray's altitude also curves upward, away from the ellipsoid. Ignoring
+// that only makes a step shorter than it could be.
+//
+// Batches are split across a pool of worker threads, and the calling thread
+// works alongside them.
+
+#define LOS_STORED_LEVEL 2
+#define LOS_MAX_LEVELS 16
+#define LOS_MAX_WORKERS 8
+#define LOS_MAX_STEP 5.0  // km
+#define LOS_NUDGE 0.0005  // km past a node edge, into the next
+#define LOS_FINE_STEPS 4  // per cell, where the ray is below a cell's maximum
+#define LOS_BISECTIONS 16 // 23 m down to under a millimeter at 3"
+#define LOS_CHUNK 64      // rays a worker takes at a time
+
+#define LOS_TREE_BUDGET (64 << 20) // bytes of quadtrees kept
+
+struct los_ray {
+    double origin[3]; // km ECEF
+    double dir[3];    // unit length
+    double length;    // km to give up at, INFINITY for none
+};
+
+struct los_hit {
+    bool hit;
+    double t;        // km along the ray
+    double lat, lon; // degrees
+    float height;    // km
+};
+
+struct los_tree {
+    _Atomic(int16_t *) max; // node maxima in meters, levels LOS_STORED_LEVEL and up, or NULL
+    atomic_int readers;
+    atomic_uint_fast64_t used; // los clock when last acquired
+    int cells_x, cells_y;
+    int top; // level with a single node
+    int w[LOS_MAX_LEVELS], h[LOS_MAX_LEVELS];
+    size_t offset[LOS_MAX_LEVELS];
+    size_t size; // bytes of max
+};
+
+// A tree evicted while a ray still read it, freed once its tile has none.
+struct los_retired {
+    int16_t *max;
+    size_t tile;
+};
+
+struct los;
+typedef void (*los_job_fn)(struct los *l, size_t begin, size_t end);
+
+struct los {
+    struct terrain *terrain;
+    struct los_tree *trees;
+    float max_height; // km, over every tile
+    atomic_size_t tree_bytes;
+    atomic_uint_fast64_t clock; // ticks on every tree acquired
+    pthread_mutex_t evict_lock; // also guards retired
+    struct los_retired *retired;
+    size_t num_retired, retired_cap;
+
+    pthread_t workers[LOS_MAX_WORKERS];
+    int num_workers;
+    pthread_mutex_t lock;
+    pthread_cond_t start, done;
+    uint64_t generation; // bumped for every job
+    int busy;            // workers still on the current job
+    bool quit;
+
+    // the current job
+    los_job_fn job;
+    size_t job_size, job_chunk;
+    atomic_size_t next;
+    const struct los_ray *rays;
+    struct los_hit *hits;
+};
+
+// Highest sample in meters under node (x, y) of the given level, from the
+// tree's maxima max and the tile samples s.
+static int los_node_max(const struct los_tree *tr, const int16_t *max, const struct tdb_entry *e,
+                        const int16_t *s, int level, int x, int y) {
+    if (level >= LOS_STORED_LEVEL)
+        return max[tr->offset[level] + (size_t)y * tr->w[level] + x];
+    int n = 1 << level;
+    int x0 = x * n, y0 = y * n;
+    int x1 = x0 + n < e->xres - 1 ? x0 + n : e->xres - 1;
+    int y1 = y0 + n < e->yres - 1 ? y0 + n : e->yres - 1;
+    int m = INT16_MIN;
+    for (int yy = y0; yy <= y1; yy++)
+        for (int xx = x0; xx <= x1; xx++) {
+            int v = s[(size_t)yy * e->xres + xx] >> 1;
+            m = v > m ? v : m;
+        }
+    return m;
+}
+
+// Shape of the tree of tile e, without its maxima.
+static void los_layout_tree(struct los_tree *tr, const struct tdb_entry *e) {
+    tr->cells_x = e->xres > 1 ? e->xres - 1 : 1;
+    tr->cells_y = e->yres > 1 ? e->yres - 1 : 1;
+    size_t total = 0;
+    int level = 0;
+    for (;; level++) {
+        tr->w[level] = (tr->cells_x + (1 << level) - 1) >> level;
+        tr->h[level] = (tr->cells_y + (1 << level) - 1) >> level;
+        tr->offset[level] = total;
+        if (level >= LOS_STORED_LEVEL)
+            total += (size_t)tr->w[level] * tr->h[level];
+        if (level >= LOS_STORED_LEVEL && tr->w[level] == 1 && tr->h[level] == 1)
+            break;
+    }
+    tr->top = level;
+    tr->size = sizeof(int16_t) * total;
+}
+
+// Maxima of the tree of tile e with samples s into max: each level from the
+// one below, the first from the samples.
+static void los_build_tree(const struct los_tree *tr, const struct tdb_entry *e,
+                           const int16_t *s, int16_t *max) {
+    for (int l = LOS_STORED_LEVEL; l <= tr->top; l++) {
+        int16_t *dst = max + tr->offset[l];
+        for (int y = 0; y < tr->h[l]; y++) {
+            for (int x = 0; x < tr->w[l]; x++) {
+                int m = INT16_MIN;
+                for (int cy = 2 * y; cy <= 2 * y + 1 && cy < tr->h[l - 1]; cy++)
+                    for (int cx = 2 * x; cx <= 2 * x + 1 && cx < tr->w[l - 1]; cx++) {
+                        int c = los_node_max(tr, max, e, s, l - 1, cx, cy);
+                        m = c > m ? c : m;
+                    }
+                dst[(size_t)y * tr->w[l] + x] = m;
+            }
+        }
+    }
+}
+
+// Free the least recently used trees no ray holds until the rest fit in
+// LOS_TREE_BUDGET. One thread evicts at a time, the others go on.
+static void los_evict(struct los *l) {
+    if (pthread_mutex_trylock(&l->evict_lock) != 0)
+        return;
+    size_t kept = 0;
+    for (size_t k = 0; k < l->num_retired; k++) {
+        struct los_retired *r = &l->retired[k];
+        if (atomic_load(&l->trees[r->tile].readers) == 0) {
+            free(r->max);
+            atomic_fetch_sub(&l->tree_bytes, l->trees[r->tile].size);
+        } else {
+            l->retired[kept++] = *r;
+        }
+    }
+    l->num_retired = kept;
+
+    size_t n = l->terrain->db->num_tiles;
+    while (atomic_load(&l->tree_bytes) > LOS_TREE_BUDGET) {
+        size_t oldest = n;
+        uint64_t oldest_used = UINT64_MAX;
+        for (size_t i = 0; i < n; i++) {
+            struct los_tree *tr = &l->trees[i];
+            uint64_t used = atomic_load(&tr->used);
+            if (used < oldest_used && atomic_load(&tr->max) && atomic_load(&tr->readers) == 0) {
+                oldest = i;
+                oldest_used = used;
+            }
+        }
+        if (oldest == n)
+            break; // everything left is in use
+        struct los_tree *tr = &l->trees[oldest];
+        int16_t *max = atomic_exchange(&tr->max, NULL);
+        // a ray may have taken it between the check and the exchange; it goes
+        // back, or if another ray has built a new one meanwhile, waits in
+        // retired until no ray reads the tile
+        int16_t *none = NULL;
+        if (atomic_load(&tr->readers) > 0) {
+            if (!atomic_compare_exchange_strong(&tr->max, &none, max)) {
+                if (l->num_retired == l->retired_cap) {
+                    l->retired_cap = l->retired_cap ? l->retired_cap * 2 : 16;
+                    l->retired = realloc(l->retired, l->retired_cap * sizeof(struct los_retired));
+                }
+                l->retired[l->num_retired++] = (struct los_retired){max, oldest};
+            }
+            continue;
+        }
+        free(max);
+        atomic_fetch_sub(&l->tree_bytes, tr->size);
+    }
+    pthread_mutex_unlock(&l->evict_lock);
+}
+
+// Maxima of tile i's tree, whose samples are s, built if need be and held
+// until los_release_tree().
+static const int16_t *los_acquire_tree(struct los *l, int i, const int16_t *s) {
+    struct los_tree *tr = &l->trees[i];
+    atomic_fetch_add(&tr->readers, 1);
+    atomic_store(&tr->used, atomic_fetch_add(&l->clock, 1));
+    int16_t *max = atomic_load(&tr->max);
+    if (max)
+        return max;
+
+    max = malloc(tr->size);
+    los_build_tree(tr, &l->terrain->db->entries[i], s, max);
+    int16_t *built = NULL;
+    if (!atomic_compare_exchange_strong(&tr->max, &built, max)) {
+        free(max); // another ray got there first
+        return built;
+    }
+    if (atomic_fetch_add(&l->tree_bytes, tr->size) + tr->size > LOS_TREE_BUDGET)
+        los_evict(l);
+    return max;
+}
+
+static void los_release_tree(struct los *l, int i) {
+    atomic_fetch_sub(&l->trees[i].readers, 1);
+    // trees held while others were built can leave the budget exceeded
+    if (atomic_load(&l->tree_bytes) > LOS_TREE_BUDGET)
+        los_evict(l);
+}
+
+// The tile samples and tree a ray is reading, held until it moves on to
+// another tile. tile is -1 after a tile whose samples could not be had.
+struct los_cursor {
+    int tile;
+    const int16_t *samples, *max;
+};
+
+static void los_cursor_set(struct los *l, struct los_cursor *c, int tile) {
+    if (c->tile == tile)
+        return;
+    if (c->tile >= 0) {
+        los_release_tree(l, c->tile);
+        terrain_release(l->terrain, c->tile);
+    }
+    c->samples = tile >= 0 ? terrain_acquire(l->terrain, tile) : NULL;
+    c->tile = c->samples ? tile : -1;
+    c->max = c->samples ? los_acquire_tree(l, tile, c->samples) : NULL;
+}
+
+static void los_work(struct los *l) {
+    size_t i;
+    while ((i = atomic_fetch_add(&l->next, l->job_chunk)) < l->job_size)
+        l->job(l, i, i + l->job_chunk < l->job_size ? i + l->job_chunk : l->job_size);
+}
+
+static void *los_worker(void *arg) {
+    struct los *l = arg;
+    uint64_t seen = 0;
+    pthread_mutex_lock(&l->lock);
+    for (;;) {
+        while (!l->quit && l->generation == seen)
+            pthread_cond_wait(&l->start, &l->lock);
+        if (l->quit)
+            break;
+        seen = l->generation;
+        pthread_mutex_unlock(&l->lock);
+        los_work(l);
+        pthread_mutex_lock(&l->lock);
+        if (--l->busy == 0)
+            pthread_cond_signal(&l->done);
+    }
+    pthread_mutex_unlock(&l->lock);
+    return NULL;
+}
+
+// Run job over [0, n) in chunks across the pool and this thread, returning
+// when all of it is done. One job at a time.
+static void los_run(struct los *l, los_job_fn job, size_t n, size_t chunk) {
+    pthread_mutex_lock(&l->lock);
+    l->job = job;
+    l->job_size = n;
+    l->job_chunk = chunk;
+    atomic_store(&l->next, 0);
+    l->busy = l->num_workers;
+    l->generation++;
+    pthread_cond_broadcast(&l->start);
+    pthread_mutex_unlock(&l->lock);
+
+    los_work(l);
+
+    pthread_mutex_lock(&l->lock);
+    while (l->busy > 0)
+        pthread_cond_wait(&l->done, &l->lock);
+    pthread_mutex_unlock(&l->lock);
+}
+
+// Start the pool for the terrain t, which must outlive l.
+bool los_init(struct los *l, struct terrain *t) {
+    *l = (struct los){.terrain = t};
+    const struct tdb *db = t->db;
+    l->trees = calloc(db->num_tiles ? db->num_tiles : 1, sizeof(struct los_tree));
+    for (size_t i = 0; i < db->num_tiles; i++) {
+        los_layout_tree(&l->trees[i], &db->entries[i]);
+        int lo, hi; // conservative without a pyramid
+        tdb_tile_range(db, i, &lo, &hi);
+        l->max_height = fmaxf(l->max_height, hi * 0.001f);
+    }
+    pthread_mutex_init(&l->lock, NULL);
+    pthread_mutex_init(&l->evict_lock, NULL);
+    pthread_cond_init(&l->start, NULL);
+    pthread_cond_init(&l->done, NULL);
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+    l->num_workers = cpus < 1 ? 1 : cpus > LOS_MAX_WORKERS ? LOS_MAX_WORKERS : cpus;
+    for (int i = 0; i < l->num_workers; i++)
+        pthread_create(&l->workers[i], NULL, los_worker, l);
+    return true;
+}
+
+void los_destroy(struct los *l) {
+    pthread_mutex_lock(&l->lock);
+    l->quit = true;
+    pthread_cond_broadcast(&l->start);
+    pthread_mutex_unlock(&l->lock);
+    for (int i = 0; i < l->num_workers; i++)
+        pthread_join(l->workers[i], NULL);
+    pthread_cond_destroy(&l->start);
+    pthread_cond_destroy(&l->done);
+    pthread_mutex_destroy(&l->lock);
+    pthread_mutex_destroy(&l->evict_lock);
+    for (size_t i = 0; l->trees && i < l->terrain->db->num_tiles; i++)
+        free(atomic_load(&l->trees[i].max));
+    for (size_t k = 0; k < l->num_retired; k++)
+        free(l->retired[k].max);
+    free(l->retired);
+    free(l->trees);
+    *l = (struct los){0};
+}
+
+// A point on the ray and how its latitude and longitude change along it.
+struct los_point {
+    double lat, lon, h; // degrees, km
+    double dlat, dlon;  // degrees per km along the ray
+    double climb;       // km of height per km along the ray, ignoring curvature
+};
+
+static void los_point_at(const struct los_ray *r, double t, struct los_point *p) {
+    dvec3s x = {{r->origin[0] + r->dir[0] * t, r->origin[1] + r->dir[1] * t,
+                 r->origin[2] + r->dir[2] * t}};
+    double lat, lon;
+    ecef_to_geodetic(x, &lat, &lon, &p->h);
+    double slat = sin(lat), clat = cos(lat), slon = sin(lon), clon = cos(lon);
+    double east = -slon * r->dir[0] + clon * r->dir[1];
+    double north = -slat * clon * r->dir[0] - slat * slon * r->dir[1] + clat * r->dir[2];
+    p->climb = clat * clon * r->dir[0] + clat * slon * r->dir[1] + slat * r->dir[2];
+
+    double q = 1 - WGS84_E2 * slat * slat;
+    double n = WGS84_A / sqrt(q);      // prime vertical radius
+    double m = n * (1 - WGS84_E2) / q; // meridian radius
+    p->dlat = north / (m + p->h) * (180 / M_PI);
+    p->dlon = east / ((n + p->h) * fmax(clat, 1e-9)) * (180 / M_PI);
+    p->lat = lat * (180 / M_PI);
+    p->lon = lon * (180 / M_PI);
+}
+
+// Distance along the ray to the edge of box (south, north, west, east).
+static double los_exit(const struct los_point *p, const double box[4]) {
+    double t = INFINITY;
+    if (p->dlat > 0)
+        t = fmin(t, (box[1] - p->lat) / p->dlat);
+    else if (p->dlat < 0)
+        t = fmin(t, (box[0] - p->lat) / p->dlat);
+    if (p->dlon > 0)
+        t = fmin(t, (box[3] - p->lon) / p->dlon);
+    else if (p->dlon < 0)
+        t = fmin(t, (box[2] - p->lon) / p->dlon);
+    return t > 0 ? t : 0;
+}
+
+// Terrain height in km under p, 0 off the tiles.
+static float los_ground(struct los *l, struct los_cursor *c, const struct los_point *p) {
+    int i = terrain_tile_at(l->terrain, p->lat, p->lon);
+    if (i >= 0)
+        los_cursor_set(l, c, i);
+    if (i < 0 || c->tile < 0)
+        return 0;
+    float h;
+    terrain_sample_scalar(c->samples, &l->terrain->db->entries[i], &p->lat, &p->lon, &h, 1);
+    return h;
+}
+
+// First point where the ray meets the terrain, if it does within its length.
+bool los_cast(struct los *l, const struct los_ray *r, struct los_hit *hit) {
+    const struct tdb_entry *entries = l->terrain->db->entries;
+    struct los_cursor cur = {.tile = -1};
+    struct los_point p;
+    double t = 0, t_above = -1; // t_above: last point known to be above ground
+    *hit = (struct los_hit){0};
+
+    while (t <= r->length) {
+        los_point_at(r, t, &p);
+        if (p.h > l->max_height && p.climb >= 0)
+            break; // clear of every tile for good
+        int i = terrain_tile_at(l->terrain, p.lat, p.lon);
+        if (i >= 0) {
+            los_cursor_set(l, &cur, i);
+            i = cur.tile; // the ellipsoid stands in for a tile that cannot be read
+        }
+
+        double box[4], top = 0; // the node's footprint and maximum
+        bool fine = false;
+        if (i < 0) {
+            double s = floor(p.lat), w = floor(p.lon);
+            box[0] = s, box[1] = s + 1, box[2] = w, box[3] = w + 1;
+            fine = p.h <= 0;
+        } else {
+            const struct tdb_entry *e = &entries[i];
+            const struct los_tree *tr = &l->trees[i];
+            int cx = (p.lon - e->lon) * tr->cells_x, cy = (e->lat - p.lat) * tr->cells_y;
+            cx = cx < 0 ? 0 : cx >= tr->cells_x ? tr->cells_x - 1 : cx;
+            cy = cy < 0 ? 0 : cy >= tr->cells_y ? tr->cells_y - 1 : cy;
+            int level = tr->top;
+            for (; level >= 0; level--) {
+                int m = los_node_max(tr, cur.max, e, cur.samples, level, cx >> level,
+                                     cy >> level);
+                if (m * 0.001 < p.h) {
+                    top = m * 0.001;
+                    break;
+                }
+            }
+            fine = level < 0;
+            level = level < 0 ? 0 : level;
+            // footprint of the node, clipped to the tile
+            int x0 = cx >> level << level, y0 = cy >> level << level;
+            int x1 = x0 + (1 << level), y1 = y0 + (1 << level);
+            x1 = x1 < tr->cells_x ? x1 : tr->cells_x;
+            y1 = y1 < tr->cells_y ? y1 : tr->cells_y;
+            box[0] = e->lat - (double)y1 / tr->cells_y;
+            box[1] = e->lat - (double)y0 / tr->cells_y;
+            box[2] = e->lon + (double)x0 / tr->cells_x;
+            box[3] = e->lon + (double)x1 / tr->cells_x;
+        }
+
+        double step;
+        if (fine) {
+            if (p.h <= los_ground(l, &cur, &p)) {
+                hit->hit = true;
+                break;
+            }
+            // a fraction of the cell, across or down through it
+            double cell = (box[1] - box[0]) * (M_PI / 180) * WGS84_A;
+            step = fmin(los_exit(&p, box) + LOS_NUDGE, cell / LOS_FINE_STEPS);
+        } else {
+            step = los_exit(&p, box) + LOS_NUDGE;
+            if (p.climb < 0)
+                step = fmin(step, (p.h - top) / -p.climb + LOS_NUDGE);
+        }
+        t_above = t;
+        t += fmax(fmin(step, LOS_MAX_STEP), LOS_NUDGE);
+    }
+
+    if (hit->hit) {
+        // the surface lies between t_above and t
+        double lo = t_above < 0 ? t : t_above, hi = t;
+        for (int k = 0; k < LOS_BISECTIONS && lo < hi; k++) {
+            double mid = (lo + hi) / 2;
+            los_point_at(r, mid, &p);
+            if (p.h <= los_ground(l, &cur, &p))
+                hi = mid;
+            else
+                lo = mid;
+        }
+        los_point_at(r, hi, &p);
+        hit->t = hi;
+        hit->lat = p.lat;
+        hit->lon = p.lon;
+        hit->height = los_ground(l, &cur, &p);
+    }
+    los_cursor_set(l, &cur, -1);
+    return hit->hit;
+}
+
+// Whether b can be seen from a, both in km ECEF.
+bool los_visible(struct los *l, const double a[3], const double b[3]) {
+    struct los_ray r;
+    double len = sqrt((b[0] - a[0]) * (b[0] - a[0]) + (b[1] - a[1]) * (b[1] - a[1]) +
+                      (b[2] - a[2]) * (b[2] - a[2]));
+    for (int k = 0; k < 3; k++) {
+        r.origin[k] = a[k];
+        r.dir[k] = len > 0 ? (b[k] - a[k]) / len : 0;
+    }
+    r.length = len - LOS_NUDGE; // b itself may sit on the ground
+    struct los_hit hit;
+    return !los_cast(l, &r, &hit);
+}
+
+static void los_cast_job(struct los *l, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++)
+        los_cast(l, &l->rays[i], &l->hits[i]);
+}
+
+// los_cast() for n rays across the pool.
+void los_cast_batch(struct los *l, const struct los_ray *rays, struct los_hit *hits, size_t n) {
+    l->rays = rays;
+    l->hits = hits;
+    los_run(l, los_cast_job, n, LOS_CHUNK);
+}
+
+#endif
@@ -21,38 +21,206 @@
 #include "cimgui_impl.h"
 
 #include "aircraft_state.h"
+#include "cull.h"
+#include "flight_log.h"
+#include "flight_path.h"
+#include "hud.h"
+#include "lod.h"
+#include "los.h"
 #include "mesh.h"
+#include "netin.h"
+#include "overlay.h"
+#include "profiler.h"
+#include "program_cache.h"
+#include "sim.h"
+#include "taws.h"
+#include "tdb.h"
+#include "terrain.h"
+#include "tile_cache.h"
+
+#define TILE_CACHE_CAPACITY 32
+#define LOD_PATCH_RES 64
+#define LOD_MAX_CHUNKS 1024
+#define TILE_PREFETCH_LOOKAHEAD 0.5 // degrees
+#define TILE_PREFETCH_RADIUS 2.0    // degrees
+#define CHUNK_TEXELS 4              // RGBA32F texels per instance, see terrain.vs
+#define PICK_EYE_HEIGHT 0.002       // km, an observer standing at the picked point
 
 struct tile {
     int16_t lat, lon, xres, yres;
-    int16_t *data;
-    GLuint tex;
+    float min_h, max_h;  // km
+    double center[3];    // ECEF bounding sphere
+    double radius;
+};
+
+// A tile that survived culling, waiting for its turn at the cache
+struct tile_candidate {
+    int tile;
+    double dist; // km from the eye to its bounding sphere
 };
 
 struct {
-    struct mesh mesh;
+    struct mesh patch;      // skirted, for LOD chunks
+    struct mesh flat_patch; // no skirts, for whole tiles at full resolution
     GLuint shader;
+    struct {
+        GLint mvp, log_depth, grid_res, skirts;
+        GLint aircraft_height, taws_level, taws_clearance;
+        GLint grid_spacing;
+    } loc;
+    GLuint chunk_buf, chunk_tex; // per instance parameters as a buffer texture
+    float *chunk_data;
+    size_t chunk_cap; // instances chunks and chunk_data have room for
+    struct tdb db;
     struct tile *tiles;
     size_t num_tiles;
+    struct tile_cache cache;
+    struct terrain heights; // CPU height queries
+    int *visible;
+    struct tile_candidate *candidates;
+    struct lod_chunk *chunks;
+    int num_chunks;
+    size_t triangles;
+    int tiles_drawn, frustum_culled, horizon_culled;
 } terrain_model;
 
 struct {
     struct mesh mesh;
     GLuint shader;
+    struct {
+        GLint mvp, log_depth;
+    } loc;
+    // procedural path: a full-screen pass with no vertex data
+    GLuint graticule, empty_vao;
+    struct {
+        GLint eye, eye_c, forward, ray_x, ray_y, log_depth, spacing;
+    } graticule_loc;
 } ellipsoid_model;
 
+struct {
+    struct overlay data;
+    struct overlay_view view;
+    struct overlay_gatherer gatherer;
+    bool gatherer_started; // only once features were loaded
+    bool dirty;            // view changed since the last upload
+    GLuint shader, vao;
+    struct {
+        GLint mvp, offset, log_depth;
+        GLint aircraft_height, taws_level, taws_clearance;
+    } loc;
+    GLuint feature_buf, feature_tex; // instance parameters as a buffer texture
+} overlay_model;
+
 static SDL_Window *window;
 static SDL_GLContext glctx;
 static SDL_Joystick *joy;
-static Uint64 last_tick;
 static float mouse_dx, mouse_dy;
 static ImGuiIO *igIO;
 
 static float far_z = 1000;
+static bool camera_relative = true;
+static float upload_budget_mb = 8;
+static bool lod_enabled = true;
+static struct lod_params lod_params = {
+    .patch_res = LOD_PATCH_RES,
+    .max_chunks = 512,
+    .factor = 2.0,
+};
+static float ground_height = NAN; // km, terrain below the aircraft
+static double velocity[3];        // km/s, from the simulation
+static struct taws taws;
+static struct taws_params taws_params;
+static bool taws_enabled = true;
 static bool draw_ellipsoid = true;
+static bool procedural_ellipsoid = true; // graticule.fs rather than the wireframe mesh
+static float grid_spacing = 60;          // arc-minutes between graticule lines
+static bool terrain_grid;
+static const char *overlay_path; // --overlay, else overlay.csv if there is one
+static bool draw_overlay = true;
+static float overlay_range = 40; // km around the aircraft
+static struct hud hud;
+static struct los los;
+static struct {
+    bool valid;
+    double lat, lon; // degrees
+    float height;    // km
+    float slope;     // degrees
+    double range;    // km from where it was picked
+    bool in_sight;   // from the aircraft, updated every frame
+} pick;
+static bool draw_hud = true;
 static bool draw_ui = false;
 static bool freecam = true;
+static bool level_requested;
+static struct sim sim;
+static struct netin netin = {.fd = -1};
+static bool net_input; // aircraft state from UDP instead of the local sim
+static int net_port = NETIN_DEFAULT_PORT;
+static bool net_live;      // this frame was drawn from a network sample
+static Uint64 net_recv_ns; // arrival of that sample
+static struct flight_log_writer recorder;
+static const char *record_path = "flight.svfl";
+static bool recording;
+static struct flight_log_reader replay;
+static bool replaying;     // aircraft state from a flight log
+static double replay_time; // s into the log
+static float replay_speed = 1;
+static bool replay_paused;
+static Uint64 last_update_ns;
+
+enum {
+    PROF_FRAME,
+    PROF_UPDATE,
+    PROF_CULL,
+    PROF_UPLOAD,
+    PROF_UI,
+    PROF_TERRAIN_GPU,
+    PROF_ELLIPSOID_GPU,
+    PROF_OVERLAY_GPU,
+    PROF_HUD_GPU,
+    PROF_IMGUI_GPU,
+    PROF_TRIANGLES,
+    PROF_TILES_RESIDENT,
+    PROF_COUNT,
+};
+
+static const struct profiler_desc profile_series[PROF_COUNT] = {
+    [PROF_FRAME] = {"frame", PROFILER_CPU},
+    [PROF_UPDATE] = {"update", PROFILER_CPU},
+    [PROF_CULL] = {"cull", PROFILER_CPU},
+    [PROF_UPLOAD] = {"tile upload", PROFILER_CPU},
+    [PROF_UI] = {"ui", PROFILER_CPU},
+    [PROF_TERRAIN_GPU] = {"terrain", PROFILER_GPU},
+    [PROF_ELLIPSOID_GPU] = {"ellipsoid", PROFILER_GPU},
+    [PROF_OVERLAY_GPU] = {"overlay", PROFILER_GPU},
+    [PROF_HUD_GPU] = {"hud", PROFILER_GPU},
+    [PROF_IMGUI_GPU] = {"imgui", PROFILER_GPU},
+    [PROF_TRIANGLES] = {"triangles", PROFILER_COUNTER},
+    [PROF_TILES_RESIDENT] = {"tiles resident", PROFILER_COUNTER},
+};
+
+static struct profiler profiler;
+static Uint64 last_frame_ns;
+static const char *profile_path; // statistics written here on exit
+static long frame_limit = -1;    // quit after this many frames
 
+#define BENCH_FRAME_DT (1.0 / 30) // s of flight per benchmark frame
+
+// Headless benchmark: a scripted flight rendered offscreen at a fixed size
+struct {
+    bool enabled;
+    const char *path_file; // NULL for the built-in route
+    struct flight_path path;
+    int width, height;
+    GLuint fbo, color, depth;
+    const char *hash_file; // per-frame image hashes, which also waits for streaming
+    FILE *hashes;
+    long frame;
+    float *frame_ms;
+    Uint64 start_ns;
+} bench = {.width = 1280, .height = 720};
+
+// the state being drawn, interpolated from the simulation every frame
 static struct aircraft_state ac = {
     .max_speed = 200,
     .throttle = 0,
@@ -62,61 +230,18 @@ static struct aircraft_state ac = {
     .right = {0, 0, 1},
 };
 
-#define FREE_CAM_MOUSE_SENS 0.1
-#define FREE_CAM_SPEED 1
-#define FREE_CAM_FAST_MULTIPLIER 100
-
-GLuint compile_shader(const char *path, GLenum type) {
-    FILE *f = fopen(path, "rb");
-    if (!f) {
-        fprintf(stderr, "Missing shader %s\n", path);
-        exit(1);
-    }
-
-    fseek(f, 0, SEEK_END);
-    long sz = ftell(f);
-    fseek(f, 0, SEEK_SET);
+#define NEAR_Z 0.001 // km, logarithmic depth keeps precision this close
 
-    char *src = malloc(sz + 1);
-    fread(src, 1, sz, f);
-    fclose(f);
-    src[sz] = 0;
-
-    GLuint sh = glCreateShader(type);
-    glShaderSource(sh, 1, (const char **)&src, NULL);
-    glCompileShader(sh);
-
-    GLint ok;
-    glGetShaderiv(sh, GL_COMPILE_STATUS, &ok);
-    if (!ok) {
-        char log[2048];
-        glGetShaderInfoLog(sh, sizeof(log), NULL, log);
-        fprintf(stderr, "Shader compile error in %s:\n%s\n", path, log);
-        exit(1);
-    }
-    free(src);
-    return sh;
-}
+static struct program_cache programs;
+static struct program_watch shader_watch;
+static bool watch_shaders;
+static int terrain_watch_id = -1, ellipsoid_watch_id = -1, graticule_watch_id = -1;
+static int hud_watch_id = -1, overlay_watch_id = -1;
 
 GLuint load_program(const char *vs, const char *fs) {
-    GLuint v = compile_shader(vs, GL_VERTEX_SHADER);
-    GLuint f = compile_shader(fs, GL_FRAGMENT_SHADER);
-
-    GLuint p = glCreateProgram();
-    glAttachShader(p, v);
-    glAttachShader(p, f);
-    glLinkProgram(p);
-
-    GLint ok;
-    glGetProgramiv(p, GL_LINK_STATUS, &ok);
-    if (!ok) {
-        char log[2048];
-        glGetProgramInfoLog(p, sizeof(log), NULL, log);
-        fprintf(stderr, "Link error:\n%s\n", log);
+    GLuint p = program_cache_load(&programs, vs, fs);
+    if (!p)
         exit(1);
-    }
-    glDeleteShader(v);
-    glDeleteShader(f);
     return p;
 }
 
@@ -128,56 +253,96 @@ vec4s get_joystick_inputs() {
     return (vec4s){pitch, yaw, roll, throttle};
 }
 
-void update(float dt) {
+// Hand this frame's inputs to the simulation and take the aircraft state to
+// draw. Everything downstream of the flight model runs here, off the sim thread.
+void update(void) {
     const bool *keys = SDL_GetKeyboardState(NULL);
-    if (!igIO->WantCaptureMouse && SDL_GetWindowRelativeMouseMode(window)) {
-        if (freecam) {
-            vec3s move = {0};
-            if (keys[SDL_SCANCODE_W])
-                move.z += 1;
-            if (keys[SDL_SCANCODE_S])
-                move.z -= 1;
-            if (keys[SDL_SCANCODE_A])
-                move.x -= 1;
-            if (keys[SDL_SCANCODE_D])
-                move.x += 1;
-            if (keys[SDL_SCANCODE_SPACE])
-                move.y += 1;
-            if (keys[SDL_SCANCODE_LCTRL])
-                move.y -= 1;
-
-            // pitch
-            float pitch_angle = -mouse_dy * FREE_CAM_MOUSE_SENS * dt;
-            ac.forward = glms_vec3_rotate(ac.forward, pitch_angle, ac.right);
-            ac.right = glms_vec3_normalize(glms_vec3_cross(ac.forward, ac.up));
-            // yaw
-            float yaw_angle = -mouse_dx * FREE_CAM_MOUSE_SENS * dt;
-            ac.forward = glms_vec3_rotate(ac.forward, yaw_angle, ac.up);
-
-            vec3s world_move = glms_vec3_add(
-                glms_vec3_scale(ac.forward, move.z),
-                glms_vec3_add(glms_vec3_scale(ac.right, move.x), glms_vec3_scale(ac.up, move.y)));
-
-            float speed = FREE_CAM_SPEED;
-            if (keys[SDL_SCANCODE_LSHIFT])
-                speed *= FREE_CAM_FAST_MULTIPLIER;
-            float ds = speed * dt;
-            world_move = glms_vec3_scale(world_move, ds);
-
-            ac.pos = glms_vec3_add(ac.pos, world_move);
-        } else {
-            aircraft_update(&ac, dt);
+    vec4s joy_inputs = get_joystick_inputs();
+    struct sim_input in = {
+        .active = !igIO->WantCaptureMouse && SDL_GetWindowRelativeMouseMode(window),
+        .freecam = freecam,
+        .move = {keys[SDL_SCANCODE_D] - keys[SDL_SCANCODE_A],
+                 keys[SDL_SCANCODE_SPACE] - keys[SDL_SCANCODE_LCTRL],
+                 keys[SDL_SCANCODE_W] - keys[SDL_SCANCODE_S]},
+        .fast = keys[SDL_SCANCODE_LSHIFT],
+        .look = {mouse_dx, mouse_dy},
+        .stick = {joy_inputs.x, joy_inputs.y, joy_inputs.z, joy_inputs.w},
+        .level = level_requested,
+    };
+    level_requested = false;
+    sim_set_input(&sim, &in);
+
+    Uint64 now = SDL_GetTicksNS();
+    double dt = last_update_ns ? (now - last_update_ns) * 1e-9 : 0;
+    last_update_ns = now;
+    bool was_live = net_live;
+    net_live = !bench.enabled && !replaying && net_input &&
+               netin_state(&netin, now, &ac, velocity, &net_recv_ns);
+    if (bench.enabled) {
+        // the script on a fixed clock replaces the input, the rest runs as usual
+        if (replaying)
+            flight_log_at(&replay, bench.frame * BENCH_FRAME_DT, &ac, velocity, NULL);
+        else
+            flight_path_at(&bench.path, bench.frame * BENCH_FRAME_DT, &ac, velocity);
+    } else if (replaying) {
+        if (!replay_paused)
+            replay_time = fmin(replay_time + dt * replay_speed, flight_log_duration(&replay));
+        flight_log_at(&replay, replay_time, &ac, velocity, NULL);
+    } else {
+        if (was_live && !net_live)
+            sim_teleport(&sim, &ac); // fly on locally from where the source left off
+        if (!net_live)
+            sim_read(&sim, now, &ac, velocity);
+        if (recording)
+            flight_log_append(&recorder, now, &ac, &in, net_live);
+    }
 
-            vec4s joy_inputs = get_joystick_inputs();
-            aircraft_pitch(&ac, 0.5 * glm_rad(joy_inputs.x));
-            aircraft_yaw(&ac, 0.5 * glm_rad(joy_inputs.y));
-            aircraft_roll(&ac, 0.5 * glm_rad(joy_inputs.z));
-            ac.throttle = joy_inputs.w;
-        }
+    struct terrain *heights = &terrain_model.heights;
+    if (heights->db) {
+        ground_height = terrain_height_at(heights, glm_deg(ac.lat), glm_deg(ac.lon));
+        terrain_trim(heights, glm_deg(ac.lat), glm_deg(ac.lon), TILE_PREFETCH_RADIUS + 1);
+    }
+    if (taws_enabled && heights->db)
+        taws_submit(&taws, &taws_params, ac.pos, velocity);
+    if (draw_overlay && overlay_model.gatherer_started) {
+        struct overlay_gatherer *g = &overlay_model.gatherer;
+        overlay_submit(g, glm_deg(ac.lat), glm_deg(ac.lon), overlay_range);
+        if (bench.hash_file) // frames must not depend on the gatherer's timing
+            overlay_wait(g);
+        overlay_model.dirty |= overlay_take(g, &overlay_model.view);
+    }
+    if (pick.valid) {
+        double target[3];
+        geodetic_to_ecef_d(glm_rad(pick.lat), glm_rad(pick.lon), pick.height + PICK_EYE_HEIGHT,
+                           target);
+        pick.in_sight = los_visible(&los, ac.pos.raw, target);
     }
+}
 
-    ecef_to_geodetic(ac.pos, &ac.lat, &ac.lon,
-                     &ac.height); // TODO change where/how geodetic is stored
+// Inspect the terrain under a point in the window.
+void pick_terrain(float x, float y) {
+    int w, h;
+    SDL_GetWindowSize(window, &w, &h);
+    // same camera as render()
+    float ty = tanf(glm_rad(60.0f) / 2), tx = ty * w / h;
+    float nx = 2 * x / w - 1, ny = 1 - 2 * y / h;
+    vec3s f = glms_vec3_normalize(ac.forward);
+    vec3s r = glms_vec3_normalize(glms_vec3_cross(f, ac.up));
+    vec3s u = glms_vec3_cross(r, f);
+    vec3s d = glms_vec3_add(f, glms_vec3_add(glms_vec3_scale(r, nx * tx),
+                                             glms_vec3_scale(u, ny * ty)));
+    d = glms_vec3_normalize(d);
+
+    struct los_ray ray = {{ac.pos.x, ac.pos.y, ac.pos.z}, {d.x, d.y, d.z}, far_z};
+    struct los_hit hit;
+    pick.valid = los_cast(&los, &ray, &hit);
+    if (pick.valid) {
+        pick.lat = hit.lat;
+        pick.lon = hit.lon;
+        pick.height = hit.height;
+        pick.slope = glm_deg(terrain_slope_at(&terrain_model.heights, hit.lat, hit.lon));
+        pick.range = hit.t;
+    }
 }
 
 void render_ui() {
@@ -195,15 +360,98 @@ void render_ui() {
         igText("LAT: %.5f°", glm_deg(ac.lat));
         igText("LON: %.5f°", glm_deg(ac.lon));
         igText("HGT: %.2fm", ac.height * 1000);
-        igText("X:   %.2f", ac.pos.x);
-        igText("Y:   %.2f", ac.pos.y);
-        igText("Z:   %.2f", ac.pos.z);
+        if (isnan(ground_height))
+            igText("AGL: ---");
+        else
+            igText("AGL: %.2fm", (ac.height - ground_height) * 1000);
+        igText("X:   %.4f", ac.pos.x);
+        igText("Y:   %.4f", ac.pos.y);
+        igText("Z:   %.4f", ac.pos.z);
+        if (pick.valid) {
+            igSeparator();
+            igText("PICK: %.5f° %.5f°", pick.lat, pick.lon);
+            igText("ELEV: %.1fm RNG: %.2fkm", pick.height * 1000, pick.range);
+            igText("SLOPE: %.1f°", pick.slope);
+            igText("LOS:  %s", pick.in_sight ? "CLEAR" : "MASKED");
+        }
         igEnd();
 
         igSetNextWindowSize((ImVec2_c){0, 0}, ImGuiCond_Always);
         igBegin("Settings", NULL, 0);
         igCheckbox("Draw Ellipsoid", &draw_ellipsoid);
+        igCheckbox("Procedural Ellipsoid", &procedural_ellipsoid);
+        igCheckbox("Terrain Grid", &terrain_grid);
+        igCheckbox("Draw HUD", &draw_hud);
+        if (overlay_model.data.count) {
+            igCheckbox("Draw Overlay", &draw_overlay);
+            igSliderFloat("Overlay Range km", &overlay_range, 5, 200, "%.0f", 0);
+            igText("Overlay: %zu of %zu features, gathered in %.2f ms", overlay_model.view.count,
+                   overlay_model.data.count, overlay_model.view.query_ms);
+        }
+        igSliderFloat("Grid Spacing '", &grid_spacing, 1, 600, "%.0f",
+                      ImGuiSliderFlags_Logarithmic);
+        igCheckbox("Camera-Relative Rendering", &camera_relative);
         igSliderFloat("Far Z", &far_z, 1, 10000, "%.2f", 0);
+        igSliderFloat("Upload MB/frame", &upload_budget_mb, 1, 64, "%.0f", 0);
+        igCheckbox("LOD Terrain", &lod_enabled);
+        igSliderFloat("LOD Factor", &lod_params.factor, 0.5, 8, "%.2f", 0);
+        igSliderInt("LOD Max Chunks", &lod_params.max_chunks, 16, LOD_MAX_CHUNKS, "%d", 0);
+        igText("Chunks: %d Triangles: %.2fM", terrain_model.num_chunks,
+               terrain_model.triangles / 1e6);
+        igText("Tiles drawn: %d culled: %d frustum, %d horizon", terrain_model.tiles_drawn,
+               terrain_model.frustum_culled, terrain_model.horizon_culled);
+        igText("Sim: %d Hz, %.0f ms skipped after stalls", SIM_RATE,
+               atomic_load(&sim.skipped_ns) / 1e6);
+        if (igCheckbox("Network Input", &net_input)) {
+            if (net_input && netin.fd < 0)
+                net_input = netin_start(&netin, net_port);
+        }
+        if (net_input) {
+            float mean, max;
+            netin_latency(&netin, &mean, &max);
+            igText("UDP :%d %s, %lu packets, %lu dropped, %lu bad", netin.port,
+                   net_live ? "live" : "waiting", atomic_load(&netin.packets),
+                   atomic_load(&netin.dropped), atomic_load(&netin.malformed));
+            igText("Packet to pixel: %.1f ms mean, %.1f ms max", mean, max);
+        }
+        igSeparator();
+        if (igCheckbox("Record Flight", &recording)) {
+            if (recording)
+                recording = flight_log_create(&recorder, record_path);
+            else
+                flight_log_finish(&recorder);
+        }
+        if (recording)
+            igText("%s: %lu records, %.1f KB%s", record_path, recorder.records,
+                   recorder.offset / 1024.0, atomic_load(&recorder.failed) ? ", write failed" : "");
+        if (replay.data) {
+            if (igCheckbox("Replay", &replaying) && !replaying)
+                sim_teleport(&sim, &ac); // take over from the replayed state
+            float t = replay_time;
+            if (igSliderFloat("Replay s", &t, 0, flight_log_duration(&replay), "%.1f", 0))
+                replay_time = t;
+            igSliderFloat("Replay Speed", &replay_speed, 0.25, 16, "%.2fx",
+                          ImGuiSliderFlags_Logarithmic);
+            igCheckbox("Pause Replay", &replay_paused);
+        }
+        igSeparator();
+        igCheckbox("TAWS", &taws_enabled);
+        igSliderFloat("Look-ahead s", &taws_params.horizon, 10, 120, "%.0f", 0);
+        igSliderFloat("Clearance km", &taws_params.clearance, 0.05, 1, "%.2f", 0);
+        igSliderInt("Corridor Lanes", &taws_params.lanes, 1, 128, "%d", 0);
+        struct taws_result tr = taws_result(&taws);
+        const char *levels[] = {"CLEAR", "CAUTION TERRAIN", "WARNING PULL UP"};
+        igText("TAWS: %s", taws_enabled ? levels[tr.level] : "OFF");
+        igText("Conflict in %.1fs, min clearance %.0fm", tr.time_to_conflict,
+               tr.min_clearance * 1000);
+        igText("Corridor: %d points in %.2f ms", tr.points, tr.eval_ms);
+        igSeparator();
+        struct tile_cache_stats *cs = &terrain_model.cache.stats;
+        igText("Tiles resident: %d/%d", tile_cache_resident(&terrain_model.cache),
+               terrain_model.cache.capacity);
+        igText("Cache hits: %lu misses: %lu", cs->hits, cs->misses);
+        igText("Evictions: %lu uploads: %lu (%.1f MB)", cs->evictions, cs->uploads,
+               cs->upload_bytes / (1024.0 * 1024.0));
         igEnd();
 
         igSetNextWindowPos((ImVec2_c){w - 10, 10}, ImGuiCond_Always, (ImVec2_c){1, 0});
@@ -216,214 +464,592 @@ void render_ui() {
         igText("ROLL: %.2f", ji.z);
         igText("THROTTLE: %.2f", ji.w);
         igEnd();
+
+        igSetNextWindowSize((ImVec2_c){0, 0}, ImGuiCond_Always);
+        igBegin("Profiler", NULL, 0);
+        float frames[PROFILER_HISTORY];
+        int n = profiler_history(&profiler, PROF_FRAME, frames);
+        struct profiler_stats st;
+        profiler_stats(&profiler, PROF_FRAME, &st);
+        char overlay[64];
+        snprintf(overlay, sizeof(overlay), "%.2f ms p50, %.2f ms p99", st.p50, st.p99);
+        igPlotLines_FloatPtr("##frame", frames, n, 0, overlay, 0, st.max * 1.2f,
+                             (ImVec2_c){360, 80}, sizeof(float));
+        for (int i = 0; i < PROF_COUNT; i++) {
+            profiler_stats(&profiler, i, &st);
+            if (profile_series[i].kind == PROFILER_COUNTER)
+                igText("%-14s %10.0f p50 %10.0f max", profile_series[i].name, st.p50, st.max);
+            else
+                igText("%-14s %3s %6.2f p50 %6.2f p95 %6.2f p99 ms", profile_series[i].name,
+                       profile_series[i].kind == PROFILER_GPU ? "gpu" : "cpu", st.p50, st.p95,
+                       st.p99);
+        }
+        if (!profiler.gpu)
+            igText("GPU timer queries unavailable");
+        if (igButton("Dump", (ImVec2_c){0, 0}))
+            profiler_dump(&profiler, profile_path ? profile_path : "profile.json");
+        igEnd();
     }
     igRender();
+    profiler_begin(&profiler, PROF_IMGUI_GPU);
     ImGui_ImplOpenGL3_RenderDrawData(igGetDrawData());
+    profiler_end(&profiler, PROF_IMGUI_GPU);
 }
 
 void load_tdb(const char *path) {
-    FILE *fp = fopen(path, "rb");
-    if (!fp) {
-        fprintf(stderr, "Failed to open %s\n", path);
+    if (!tdb_open(&terrain_model.db, path))
         return;
-    }
 
-    terrain_model.num_tiles = 0;
-    while (1) {
-        terrain_model.tiles =
-            realloc(terrain_model.tiles, sizeof(struct tile) * (terrain_model.num_tiles + 1));
-        struct tile *t = &terrain_model.tiles[terrain_model.num_tiles];
-        if (fread(&t->lat, sizeof(int16_t), 1, fp) != 1)
-            break;
-        if (fread(&t->lon, sizeof(int16_t), 1, fp) != 1)
-            break;
-        if (fread(&t->xres, sizeof(int16_t), 1, fp) != 1)
-            break;
-        if (fread(&t->yres, sizeof(int16_t), 1, fp) != 1)
-            break;
-        t->data = malloc(sizeof(int16_t) * t->xres * t->yres);
-        if (fread(t->data, sizeof(int16_t), t->xres * t->yres, fp) != t->xres * t->yres)
-            break;
-
-        terrain_model.num_tiles++;
-    }
-    printf("Number of tiles: %zu\n", terrain_model.num_tiles);
+    // tile data stays in the mapping until the cache asks for it
+    struct tdb *db = &terrain_model.db;
+    terrain_model.num_tiles = db->num_tiles;
+    terrain_model.tiles = malloc(sizeof(struct tile) * db->num_tiles);
+    for (size_t i = 0; i < db->num_tiles; i++) {
+        struct tdb_entry *e = &db->entries[i];
+        struct tile *t = &terrain_model.tiles[i];
+        *t = (struct tile){
+            .lat = e->lat,
+            .lon = e->lon,
+            .xres = e->xres,
+            .yres = e->yres,
+        };
+        int hmin, hmax;
+        tdb_tile_range(db, i, &hmin, &hmax);
+        t->min_h = hmin / 1000.0f;
+        t->max_h = hmax / 1000.0f;
+
+        // sphere through the corners of the tile at mid height, grown to
+        // reach the top and bottom of the terrain
+        double mid = (t->min_h + t->max_h) / 2;
+        geodetic_to_ecef_d(glm_rad(t->lat - 0.5), glm_rad(t->lon + 0.5), mid, t->center);
+        for (int c = 0; c < 4; c++) {
+            double corner[3], d2 = 0;
+            geodetic_to_ecef_d(glm_rad(t->lat - (c >> 1)), glm_rad(t->lon + (c & 1)), mid, corner);
+            for (int k = 0; k < 3; k++)
+                d2 += (corner[k] - t->center[k]) * (corner[k] - t->center[k]);
+            if (sqrt(d2) > t->radius)
+                t->radius = sqrt(d2);
+        }
+        t->radius += (t->max_h - t->min_h) / 2 + 1;
+    }
+    printf("Number of tiles: %zu (tdb v%u)\n", terrain_model.num_tiles, db->version);
 }
 
+static float log_depth_coef() { return 2.0 / log2(far_z + 1.0); }
+
 void render_ellipsoid(mat4s view, mat4s proj) {
     mat4s model = GLMS_MAT4_IDENTITY;
     mat4s mvp = glms_mat4_mulN((mat4s *[]){&proj, &view, &model}, 3);
 
     glUseProgram(ellipsoid_model.shader);
-    glUniformMatrix4fv(glGetUniformLocation(ellipsoid_model.shader, "mvp"), 1, GL_FALSE,
-                       (float *)mvp.raw);
+    glUniformMatrix4fv(ellipsoid_model.loc.mvp, 1, GL_FALSE, (float *)mvp.raw);
+    glUniform1f(ellipsoid_model.loc.log_depth, log_depth_coef());
     glBindVertexArray(ellipsoid_model.mesh.vao);
     glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-    glDrawElements(GL_TRIANGLES, ellipsoid_model.mesh.index_count, GL_UNSIGNED_INT, 0);
+    glDrawElements(GL_TRIANGLES, ellipsoid_model.mesh.index_count, ellipsoid_model.mesh.index_type,
+                   0);
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 }
 
-#define TILE_RES 1200
-void make_terrain() {
-    // TODO account for tiles of smaller dimensions
-    int vcount = TILE_RES * TILE_RES;
-    float *verts = malloc(sizeof(float) * vcount);
-    int quads = (TILE_RES - 1) * (TILE_RES - 1);
-    int icount = quads * 6;
-    unsigned int *indices = malloc(sizeof(unsigned int) * icount);
-    int idx = 0;
-    for (int y = 0; y < TILE_RES - 1; y++) {
-        for (int x = 0; x < TILE_RES - 1; x++) {
-            int i = y * TILE_RES + x;
-            indices[idx++] = i;
-            indices[idx++] = i + TILE_RES;
-            indices[idx++] = i + 1;
-            indices[idx++] = i + 1;
-            indices[idx++] = i + TILE_RES;
-            indices[idx++] = i + TILE_RES + 1;
-        }
-    }
-    terrain_model.mesh = (struct mesh){
-        .index_count = icount,
-    };
-    glGenVertexArrays(1, &terrain_model.mesh.vao);
-    glBindVertexArray(terrain_model.mesh.vao);
+// The ellipsoid and graticule ray traced per pixel: no vertices and the same
+// cost wherever the camera is, where the mesh costs as much as the terrain.
+void render_graticule(mat4s proj) {
+    // the camera basis of glms_look(), and the ray through each screen edge
+    vec3s f = glms_vec3_normalize(ac.forward);
+    vec3s r = glms_vec3_normalize(glms_vec3_cross(f, ac.up));
+    vec3s u = glms_vec3_cross(r, f);
+    vec3s ray_x = glms_vec3_scale(r, 1 / proj.raw[0][0]);
+    vec3s ray_y = glms_vec3_scale(u, 1 / proj.raw[1][1]);
+    // a float eye is only good to half a meter, too coarse for its height
+    double eye_c = (ac.pos.x * ac.pos.x + ac.pos.y * ac.pos.y) / (WGS84_A * WGS84_A) +
+                   ac.pos.z * ac.pos.z / (WGS84_B * WGS84_B) - 1;
+
+    glUseProgram(ellipsoid_model.graticule);
+    glUniform3f(ellipsoid_model.graticule_loc.eye, ac.pos.x, ac.pos.y, ac.pos.z);
+    glUniform1f(ellipsoid_model.graticule_loc.eye_c, eye_c);
+    glUniform3fv(ellipsoid_model.graticule_loc.forward, 1, f.raw);
+    glUniform3fv(ellipsoid_model.graticule_loc.ray_x, 1, ray_x.raw);
+    glUniform3fv(ellipsoid_model.graticule_loc.ray_y, 1, ray_y.raw);
+    glUniform1f(ellipsoid_model.graticule_loc.log_depth, log_depth_coef());
+    glUniform1f(ellipsoid_model.graticule_loc.spacing, grid_spacing);
+    glBindVertexArray(ellipsoid_model.empty_vao);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glDisable(GL_BLEND);
+}
 
-    glGenBuffers(1, &terrain_model.mesh.vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, terrain_model.mesh.vbo);
-    glBufferData(GL_ARRAY_BUFFER, vcount * sizeof(float), verts, GL_STATIC_DRAW);
+// Patches along each side of tile t when it is drawn at full resolution.
+static int terrain_patches(const struct tile *t) {
+    int res = t->xres > t->yres ? t->xres : t->yres;
+    return (res - 1 + LOD_PATCH_RES - 1) / LOD_PATCH_RES;
+}
+
+// Make room for n instances in chunks and chunk_data.
+static void terrain_reserve(size_t n) {
+    if (n <= terrain_model.chunk_cap)
+        return;
+    terrain_model.chunk_cap = n;
+    terrain_model.chunks = realloc(terrain_model.chunks, sizeof(struct lod_chunk) * n);
+    terrain_model.chunk_data =
+        realloc(terrain_model.chunk_data, sizeof(float) * 4 * CHUNK_TEXELS * n);
+}
 
-    glGenBuffers(1, &terrain_model.mesh.ebo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, terrain_model.mesh.ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, icount * sizeof(unsigned int), indices, GL_STATIC_DRAW);
+// Use program p for the terrain, with its constant uniforms set.
+static void terrain_set_program(GLuint p) {
+    terrain_model.shader = p;
+    glUseProgram(p);
+    glUniform1f(glGetUniformLocation(p, "B"), WGS84_B);
+    glUniform1f(glGetUniformLocation(p, "E2"), WGS84_E2);
+    glUniform1i(glGetUniformLocation(p, "heightmap"), 0);
+    glUniform1i(glGetUniformLocation(p, "chunks"), 1);
+    glUniform1i(glGetUniformLocation(p, "normals"), 2);
+    terrain_model.loc.mvp = glGetUniformLocation(p, "mvp");
+    terrain_model.loc.log_depth = glGetUniformLocation(p, "log_depth");
+    terrain_model.loc.grid_res = glGetUniformLocation(p, "grid_res");
+    terrain_model.loc.skirts = glGetUniformLocation(p, "skirts");
+    terrain_model.loc.aircraft_height = glGetUniformLocation(p, "aircraft_height");
+    terrain_model.loc.taws_level = glGetUniformLocation(p, "taws_level");
+    terrain_model.loc.taws_clearance = glGetUniformLocation(p, "taws_clearance");
+    terrain_model.loc.grid_spacing = glGetUniformLocation(p, "grid_spacing");
+}
 
-    free(verts);
-    free(indices);
+static void ellipsoid_set_program(GLuint p) {
+    ellipsoid_model.shader = p;
+    ellipsoid_model.loc.mvp = glGetUniformLocation(p, "mvp");
+    ellipsoid_model.loc.log_depth = glGetUniformLocation(p, "log_depth");
+}
 
-    terrain_model.shader = load_program("shaders/terrain.vs", "shaders/terrain.fs");
-    glUseProgram(terrain_model.shader);
-    glUniform1f(glGetUniformLocation(terrain_model.shader, "A"), WGS84_A);
-    glUniform1f(glGetUniformLocation(terrain_model.shader, "B"), WGS84_B);
-    glUniform1f(glGetUniformLocation(terrain_model.shader, "E2"), WGS84_E2);
+static void graticule_set_program(GLuint p) {
+    ellipsoid_model.graticule = p;
+    glUseProgram(p);
+    glUniform1f(glGetUniformLocation(p, "A"), WGS84_A);
+    glUniform1f(glGetUniformLocation(p, "B"), WGS84_B);
+    glUniform1f(glGetUniformLocation(p, "E2"), WGS84_E2);
+    ellipsoid_model.graticule_loc.eye = glGetUniformLocation(p, "eye");
+    ellipsoid_model.graticule_loc.eye_c = glGetUniformLocation(p, "eye_c");
+    ellipsoid_model.graticule_loc.forward = glGetUniformLocation(p, "forward");
+    ellipsoid_model.graticule_loc.ray_x = glGetUniformLocation(p, "ray_x");
+    ellipsoid_model.graticule_loc.ray_y = glGetUniformLocation(p, "ray_y");
+    ellipsoid_model.graticule_loc.log_depth = glGetUniformLocation(p, "log_depth");
+    ellipsoid_model.graticule_loc.spacing = glGetUniformLocation(p, "spacing");
+}
 
-    // Load heightmaps
-    load_tdb("terrain.tdb");
-    for (int i = 0; i < terrain_model.num_tiles; i++) {
-        struct tile *t = &terrain_model.tiles[i];
-        glGenTextures(1, &t->tex);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, t->tex);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_R16I, t->xres, t->yres, 0, GL_RED_INTEGER, GL_SHORT,
-                     t->data);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        // glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        // glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+static void overlay_set_program(GLuint p) {
+    overlay_model.shader = p;
+    glUseProgram(p);
+    glUniform1i(glGetUniformLocation(p, "features"), 0);
+    overlay_model.loc.mvp = glGetUniformLocation(p, "mvp");
+    overlay_model.loc.offset = glGetUniformLocation(p, "offset");
+    overlay_model.loc.log_depth = glGetUniformLocation(p, "log_depth");
+    overlay_model.loc.aircraft_height = glGetUniformLocation(p, "aircraft_height");
+    overlay_model.loc.taws_level = glGetUniformLocation(p, "taws_level");
+    overlay_model.loc.taws_clearance = glGetUniformLocation(p, "taws_clearance");
+}
+
+// Swap in programs the watcher relinked since the last frame.
+static void reload_programs() {
+    GLuint p;
+    if ((p = program_watch_poll(&shader_watch, terrain_watch_id))) {
+        glDeleteProgram(terrain_model.shader);
+        terrain_set_program(p);
+    }
+    if ((p = program_watch_poll(&shader_watch, ellipsoid_watch_id))) {
+        glDeleteProgram(ellipsoid_model.shader);
+        ellipsoid_set_program(p);
+    }
+    if ((p = program_watch_poll(&shader_watch, graticule_watch_id))) {
+        glDeleteProgram(ellipsoid_model.graticule);
+        graticule_set_program(p);
+    }
+    if ((p = program_watch_poll(&shader_watch, hud_watch_id))) {
+        glDeleteProgram(hud.shader);
+        hud_set_program(&hud, p);
     }
+    if ((p = program_watch_poll(&shader_watch, overlay_watch_id))) {
+        glDeleteProgram(overlay_model.shader);
+        overlay_set_program(p);
+    }
+}
+
+void make_terrain() {
+    terrain_set_program(load_program("shaders/terrain.vs", "shaders/terrain.fs"));
+
+    // Load heightmaps, textures are streamed in by the tile cache
+    load_tdb("terrain.tdb");
+    tile_cache_init(&terrain_model.cache, &terrain_model.db, TILE_CACHE_CAPACITY);
+    terrain_init(&terrain_model.heights, &terrain_model.db);
+    taws_params = TAWS_DEFAULT_PARAMS;
+    taws_init(&taws, &terrain_model.heights);
+    los_init(&los, &terrain_model.heights);
+    terrain_model.visible = malloc(sizeof(int) * terrain_model.num_tiles);
+    terrain_model.candidates = malloc(sizeof(struct tile_candidate) * terrain_model.num_tiles);
+    terrain_reserve(LOD_MAX_CHUNKS);
+
+    glGenBuffers(1, &terrain_model.chunk_buf);
+    glGenTextures(1, &terrain_model.chunk_tex);
+    glBindBuffer(GL_TEXTURE_BUFFER, terrain_model.chunk_buf);
+    glBindTexture(GL_TEXTURE_BUFFER, terrain_model.chunk_tex);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, terrain_model.chunk_buf);
+
+    // one skirted patch shared by every LOD chunk; full resolution tiles have
+    // no neighbours at another level and need no skirts
+    terrain_model.patch = gen_grid(LOD_PATCH_RES, 1);
+    terrain_model.flat_patch = gen_grid(LOD_PATCH_RES, 0);
+}
+
+// Instance parameters of one patch for terrain.vs. With camera-relative
+// rendering the corner is taken relative to the eye in double precision and
+// the shader only ever sees offsets of a few hundred km at most.
+static void terrain_instance(float *out, const struct tile *t, float u0, float v0, float size,
+                             int layer, int mip, float skirt_depth) {
+    double phi = deg2rad(t->lat - v0), lam = deg2rad(t->lon + u0);
+    double o[3];
+    geodetic_to_ecef_d(phi, lam, 0, o);
+    if (camera_relative)
+        for (int k = 0; k < 3; k++)
+            o[k] -= ac.pos.raw[k];
+    float data[4 * CHUNK_TEXELS] = {
+        o[0], o[1], o[2], WGS84_A / sqrt(1.0 - WGS84_E2 * sin(phi) * sin(phi)),
+        sin(phi), cos(phi), sin(lam), cos(lam),
+        u0, v0, size, skirt_depth,
+        layer, mip, t->xres, t->yres,
+    };
+    memcpy(out, data, sizeof(data));
+}
+
+static int compare_candidates(const void *a, const void *b) {
+    double x = ((const struct tile_candidate *)a)->dist;
+    double y = ((const struct tile_candidate *)b)->dist;
+    return (x > y) - (x < y);
 }
 
-void render_terrain(mat4s view, mat4s proj) {
+// view carries only the camera rotation, the eye translation is applied per
+// patch origin in terrain_instance()
+void render_terrain(mat4s view, mat4s proj, const struct cull_view *cv) {
+    if (!camera_relative)
+        view = glms_translate(view, glms_vec3_negate(dvec3_to_vec3(ac.pos)));
     mat4s model = GLMS_MAT4_IDENTITY;
     mat4s mvp = glms_mat4_mulN((mat4s *[]){&proj, &view, &model}, 3);
 
-    // draw
-    glUseProgram(terrain_model.shader);
-    glUniformMatrix4fv(glGetUniformLocation(terrain_model.shader, "mvp"), 1, GL_FALSE,
-                       (float *)mvp.raw);
+    // stream tiles around and ahead of the aircraft along its ground track
+    struct tile_cache *cache = &terrain_model.cache;
+    double slat = sin(ac.lat), clat = cos(ac.lat), slon = sin(ac.lon), clon = cos(ac.lon);
+    vec3s east = {-slon, clon, 0};
+    vec3s north = {-slat * clon, -slat * slon, clat};
+    tile_cache_prefetch(cache, glm_deg(ac.lat), glm_deg(ac.lon), glms_vec3_dot(ac.forward, north),
+                        glms_vec3_dot(ac.forward, east), TILE_PREFETCH_LOOKAHEAD,
+                        TILE_PREFETCH_RADIUS);
+    cache->upload_budget = upload_budget_mb * 1024 * 1024;
+    profiler_begin(&profiler, PROF_UPLOAD);
+    tile_cache_update(cache);
+    if (bench.hashes)
+        tile_cache_settle(cache); // the image must not depend on loader timing
+    profiler_end(&profiler, PROF_UPLOAD);
+
+    profiler_begin(&profiler, PROF_CULL);
+
+    int num_candidates = 0;
+    terrain_model.frustum_culled = terrain_model.horizon_culled = 0;
     for (int i = 0; i < terrain_model.num_tiles; i++) {
         struct tile *t = &terrain_model.tiles[i];
-        // TODO better distance determination
-        float dist = glms_vec2_distance((vec2s){glm_deg(ac.lat), glm_deg(ac.lon)},
-                                        (vec2s){(float)t->lat - 0.5, (float)t->lon + 0.5});
-        if (dist < 1.5) {
-            glUniform1f(glGetUniformLocation(terrain_model.shader, "lat"), t->lat);
-            glUniform1f(glGetUniformLocation(terrain_model.shader, "lon"), t->lon);
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, t->tex);
-            glBindVertexArray(terrain_model.mesh.vao);
-            glDrawElements(GL_TRIANGLES, terrain_model.mesh.index_count, GL_UNSIGNED_INT, 0);
+        enum cull_result r = cull_sphere_outside(cv, t->center, t->radius)
+                                 ? CULL_FRUSTUM
+                                 : cull_box(cv, t->lat, t->lon, 1, 1, t->min_h, t->max_h);
+        if (r == CULL_FRUSTUM) {
+            terrain_model.frustum_culled++;
+        } else if (r == CULL_HORIZON) {
+            terrain_model.horizon_culled++;
+        } else {
+            double d2 = 0;
+            for (int k = 0; k < 3; k++)
+                d2 += (t->center[k] - ac.pos.raw[k]) * (t->center[k] - ac.pos.raw[k]);
+            terrain_model.candidates[num_candidates++] =
+                (struct tile_candidate){i, fmax(sqrt(d2) - t->radius, 0)};
         }
     }
-}
-
-void draw_triangle(vec2s v0, vec2s v1, vec2s v2, vec3s color) {
-    glUseProgram(0);
-    glBindVertexArray(0);
-    int w, h;
-    SDL_GetWindowSizeInPixels(window, &w, &h);
 
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    glOrtho(0, w, h, 0, -1, 1);
+    // Only the nearest tiles the cache can hold ask for a slot, so a wide view
+    // at altitude cannot evict what is under the aircraft. Farther tiles are
+    // drawn if they happen to be resident.
+    qsort(terrain_model.candidates, num_candidates, sizeof(struct tile_candidate),
+          compare_candidates);
+    int num_visible = 0;
+    for (int i = 0; i < num_candidates; i++) {
+        int tile = terrain_model.candidates[i].tile;
+        int layer = i < cache->capacity ? tile_cache_get(cache, tile)
+                                        : tile_cache_layer(cache, tile);
+        if (layer >= 0)
+            terrain_model.visible[num_visible++] = tile;
+    }
+    terrain_model.tiles_drawn = num_visible;
+
+    // every visible patch becomes one instance of a single draw
+    struct lod_chunk *chunks = terrain_model.chunks;
+    int n;
+    if (lod_enabled) {
+        n = lod_select(&lod_params, ac.pos.raw, &terrain_model.db, terrain_model.visible,
+                       num_visible, cv, chunks);
+    } else {
+        // full resolution: whole tiles cut into patches that sample the base level
+        size_t total = 0;
+        for (int i = 0; i < num_visible; i++) {
+            int k = terrain_patches(&terrain_model.tiles[terrain_model.visible[i]]);
+            total += k * k;
+        }
+        terrain_reserve(total);
+        chunks = terrain_model.chunks;
+        n = 0;
+        for (int i = 0; i < num_visible; i++) {
+            int k = terrain_patches(&terrain_model.tiles[terrain_model.visible[i]]);
+            for (int c = 0; c < k * k; c++)
+                chunks[n++] = (struct lod_chunk){
+                    .tile = terrain_model.visible[i],
+                    .u0 = (float)(c % k) / k,
+                    .v0 = (float)(c / k) / k,
+                    .size = 1.0f / k,
+                };
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        struct lod_chunk *c = &chunks[i];
+        // skirts deep enough to hide cracks against a coarser neighbour
+        float skirt_depth = lod_enabled ? 0.02 * WGS84_A * glm_rad(c->size) : 0;
+        terrain_instance(terrain_model.chunk_data + i * 4 * CHUNK_TEXELS,
+                         &terrain_model.tiles[c->tile], c->u0, c->v0, c->size,
+                         tile_cache_layer(cache, c->tile), c->mip, skirt_depth);
+    }
+    struct mesh *mesh = lod_enabled ? &terrain_model.patch : &terrain_model.flat_patch;
+    terrain_model.num_chunks = n;
+    terrain_model.triangles = (size_t)n * mesh->index_count / 3;
+    profiler_end(&profiler, PROF_CULL);
+    if (n == 0)
+        return;
 
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
+    glBindBuffer(GL_TEXTURE_BUFFER, terrain_model.chunk_buf);
+    size_t bytes = sizeof(float) * 4 * CHUNK_TEXELS * n;
+    glBufferData(GL_TEXTURE_BUFFER, bytes, NULL, GL_STREAM_DRAW); // orphan last frame's
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, terrain_model.chunk_data);
 
-    glPushMatrix();
+    glUseProgram(terrain_model.shader);
+    glUniformMatrix4fv(terrain_model.loc.mvp, 1, GL_FALSE, (float *)mvp.raw);
+    glUniform1f(terrain_model.loc.log_depth, log_depth_coef());
+    glUniform1i(terrain_model.loc.grid_res, LOD_PATCH_RES);
+    glUniform1i(terrain_model.loc.skirts, lod_enabled);
+    glUniform1f(terrain_model.loc.aircraft_height, ac.height);
+    glUniform1i(terrain_model.loc.taws_level, taws_enabled ? (int)taws_result(&taws).level : -1);
+    glUniform1f(terrain_model.loc.taws_clearance, taws_params.clearance);
+    glUniform1f(terrain_model.loc.grid_spacing, terrain_grid ? grid_spacing : 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_BUFFER, terrain_model.chunk_tex);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, cache->normal_tex);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, cache->tex);
+    glBindVertexArray(mesh->vao);
+    glDrawElementsInstanced(GL_TRIANGLES, mesh->index_count, mesh->index_type, 0, n);
+}
 
-    glBegin(GL_TRIANGLES);
-    glColor3f(color.r, color.g, color.b);
-    glVertex2fv(v0.raw);
-    glVertex2fv(v1.raw);
-    glVertex2fv(v2.raw);
-    glEnd();
+// Features near the aircraft, one instanced draw of boxes made up in
+// overlay.vs. Their positions are relative to the view's anchor, which is
+// taken relative to the eye in double precision like terrain_instance().
+void render_overlay(mat4s view, mat4s proj) {
+    struct overlay_view *v = &overlay_model.view;
+    if (v->count == 0)
+        return;
+    if (overlay_model.dirty) {
+        glBindBuffer(GL_TEXTURE_BUFFER, overlay_model.feature_buf);
+        glBufferData(GL_TEXTURE_BUFFER, sizeof(float) * 4 * OVERLAY_TEXELS * v->count,
+                     v->instances, GL_STATIC_DRAW);
+        overlay_model.dirty = false;
+    }
+    double offset[3];
+    for (int k = 0; k < 3; k++)
+        offset[k] = v->anchor[k] - (camera_relative ? ac.pos.raw[k] : 0);
+    if (!camera_relative)
+        view = glms_translate(view, glms_vec3_negate(dvec3_to_vec3(ac.pos)));
+    mat4s mvp = glms_mat4_mul(proj, view);
+
+    glUseProgram(overlay_model.shader);
+    glUniformMatrix4fv(overlay_model.loc.mvp, 1, GL_FALSE, (float *)mvp.raw);
+    glUniform3f(overlay_model.loc.offset, offset[0], offset[1], offset[2]);
+    glUniform1f(overlay_model.loc.log_depth, log_depth_coef());
+    glUniform1f(overlay_model.loc.aircraft_height, ac.height);
+    glUniform1i(overlay_model.loc.taws_level, taws_enabled ? (int)taws_result(&taws).level : -1);
+    glUniform1f(overlay_model.loc.taws_clearance, taws_params.clearance);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, overlay_model.feature_tex);
+    glBindVertexArray(overlay_model.vao);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 30, v->count);
+}
 
-    glPopMatrix();
+// Size in pixels of what render() draws into: the window, or the offscreen
+// target in benchmark mode.
+void render_size(int *w, int *h) {
+    if (bench.enabled) {
+        *w = bench.width;
+        *h = bench.height;
+    } else {
+        SDL_GetWindowSizeInPixels(window, w, h);
+    }
 }
 
 void render() {
+    reload_programs();
     int w, h;
-    SDL_GetWindowSizeInPixels(window, &w, &h);
+    render_size(&w, &h);
+    if (bench.enabled)
+        glBindFramebuffer(GL_FRAMEBUFFER, bench.fbo);
     glViewport(0, 0, w, h);
     glClearColor(0.1, 0.2, 0.7, 1.0);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    mat4s view = glms_look(GLMS_VEC3_ZERO, ac.forward, ac.up);
-    view = glms_translate(view, glms_vec3_negate(ac.pos));
-    mat4s proj = glms_perspective(glm_rad(60.0f), (float)w / (float)h, 0.1f, far_z);
+    mat4s rot = glms_look(GLMS_VEC3_ZERO, ac.forward, ac.up);
+    mat4s view = glms_translate(rot, glms_vec3_negate(dvec3_to_vec3(ac.pos)));
+    mat4s proj = glms_perspective(glm_rad(60.0f), (float)w / (float)h, NEAR_Z, far_z);
 
-    render_terrain(view, proj);
-    if (draw_ellipsoid)
-        render_ellipsoid(view, proj);
-    if (draw_ui)
+    struct cull_view cv;
+    cull_view_init(&cv, ac.pos.raw, glms_mat4_mul(proj, rot));
+
+    profiler_begin(&profiler, PROF_TERRAIN_GPU);
+    render_terrain(rot, proj, &cv);
+    profiler_end(&profiler, PROF_TERRAIN_GPU);
+    if (draw_overlay) {
+        profiler_begin(&profiler, PROF_OVERLAY_GPU);
+        render_overlay(rot, proj);
+        profiler_end(&profiler, PROF_OVERLAY_GPU);
+    }
+    if (draw_ellipsoid) {
+        profiler_begin(&profiler, PROF_ELLIPSOID_GPU);
+        if (procedural_ellipsoid)
+            render_graticule(proj);
+        else
+            render_ellipsoid(view, proj);
+        profiler_end(&profiler, PROF_ELLIPSOID_GPU);
+    }
+    if (draw_hud) {
+        profiler_begin(&profiler, PROF_HUD_GPU);
+        struct hud_flight flight;
+        hud_flight_from(&flight, &ac, velocity, proj.raw[1][1] * h / 2);
+        hud_begin(&hud);
+        hud_draw_pfd(&hud, &flight, w, h);
+        hud_flush(&hud, w, h);
+        profiler_end(&profiler, PROF_HUD_GPU);
+    }
+    if (draw_ui) {
+        profiler_begin(&profiler, PROF_UI);
         render_ui();
+        profiler_end(&profiler, PROF_UI);
+    }
 
-    // render aircraft symbol
-    vec2s o = {w / 2.0, h / 2.0};
-    vec2s tri[] = {
-        o,
-        {o.x - 100, o.y + 50},
-        {o.x - 70, o.y + 50},
-    };
-    vec2s tri2[] = {
-        o,
-        {o.x + 100, o.y + 50},
-        {o.x + 70, o.y + 50},
-    };
+    if (bench.enabled)
+        glFinish(); // count the GPU's share of the frame, with no vsync to wait on
+    else
+        SDL_GL_SwapWindow(window);
+}
 
-    vec3s yellow = {1, 1, 0};
-    vec3s black = {0, 0, 0};
-    draw_triangle(tri[0], tri[1], tri[2], yellow);
-    draw_triangle(tri2[0], tri2[1], tri2[2], yellow);
+static bool bench_init(void) {
+    // a log given with --replay is flown instead of a path
+    if (!replaying && !bench.path_file)
+        flight_path_default(&bench.path);
+    else if (!replaying && !flight_path_load(&bench.path, bench.path_file))
+        return false;
+    if (bench.hash_file && !(bench.hashes = fopen(bench.hash_file, "w"))) {
+        fprintf(stderr, "bench: cannot write %s\n", bench.hash_file);
+        return false;
+    }
+    double duration =
+        replaying ? flight_log_duration(&replay) : flight_path_duration(&bench.path);
+    long frames = duration / BENCH_FRAME_DT + 1;
+    if (frame_limit <= 0 || frame_limit > frames)
+        frame_limit = frames;
+    bench.frame_ms = malloc(sizeof(float) * frame_limit);
+
+    // no multisampling, so images are the same on any driver that rasterizes alike
+    glGenRenderbuffers(1, &bench.color);
+    glBindRenderbuffer(GL_RENDERBUFFER, bench.color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, bench.width, bench.height);
+    glGenRenderbuffers(1, &bench.depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, bench.depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, bench.width, bench.height);
+    glGenFramebuffers(1, &bench.fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, bench.fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, bench.color);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, bench.depth);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "bench: offscreen framebuffer incomplete\n");
+        return false;
+    }
+    bench.start_ns = SDL_GetTicksNS();
+    return true;
+}
 
-    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-    glLineWidth(2);
-    draw_triangle(tri[0], tri[1], tri[2], black);
-    draw_triangle(tri2[0], tri2[1], tri2[2], black);
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+// FNV-1a over the finished frame
+static uint64_t bench_frame_hash(void) {
+    size_t size = (size_t)bench.width * bench.height * 4;
+    uint8_t *pixels = malloc(size);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, bench.fbo);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, bench.width, bench.height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; i++)
+        h = (h ^ pixels[i]) * 0x100000001b3ull;
+    free(pixels);
+    return h;
+}
+
+static int bench_cmp(const void *a, const void *b) {
+    float x = *(const float *)a, y = *(const float *)b;
+    return (x > y) - (x < y);
+}
 
-    SDL_GL_SwapWindow(window);
+static void bench_report(void) {
+    long n = bench.frame;
+    if (n == 0)
+        return;
+    double wall = (SDL_GetTicksNS() - bench.start_ns) * 1e-9;
+    qsort(bench.frame_ms, n, sizeof(float), bench_cmp);
+    double sum = 0;
+    for (long i = 0; i < n; i++)
+        sum += bench.frame_ms[i];
+    struct tile_cache_stats *cs = &terrain_model.cache.stats;
+    printf("bench: %ld frames at %dx%d, %.1f s of flight in %.1f s\n", n, bench.width,
+           bench.height, n * BENCH_FRAME_DT, wall);
+    printf("frame ms: mean %.2f p50 %.2f p95 %.2f p99 %.2f max %.2f\n", sum / n,
+           bench.frame_ms[(n - 1) * 50 / 100], bench.frame_ms[(n - 1) * 95 / 100],
+           bench.frame_ms[(n - 1) * 99 / 100], bench.frame_ms[n - 1]);
+    printf("tiles streamed: %lu (%.1f MB uploaded), %lu evictions, %lu misses\n", cs->uploads,
+           cs->upload_bytes / (1024.0 * 1024.0), cs->evictions, cs->misses);
 }
 
 SDL_AppResult SDL_AppIterate(void *appstate) {
+    Uint64 start = SDL_GetTicksNS();
     SDL_GetRelativeMouseState(&mouse_dx, &mouse_dy);
-    uint32_t now = SDL_GetTicks();
-    float dt = (now - last_tick) / 1000.0f;
-    last_tick = now;
-
-    update(dt);
+    profiler_begin(&profiler, PROF_UPDATE);
+    update();
+    profiler_end(&profiler, PROF_UPDATE);
     render();
-
+    Uint64 now = SDL_GetTicksNS();
+    if (net_live)
+        netin_record_latency(&netin, net_recv_ns, now);
+
+    if (last_frame_ns)
+        profiler_set(&profiler, PROF_FRAME, (now - last_frame_ns) * 1e-6);
+    last_frame_ns = now;
+    profiler_set(&profiler, PROF_TRIANGLES, terrain_model.triangles);
+    profiler_set(&profiler, PROF_TILES_RESIDENT, tile_cache_resident(&terrain_model.cache));
+    profiler_frame(&profiler);
+
+    if (bench.enabled) {
+        bench.frame_ms[bench.frame] = (now - start) * 1e-6;
+        if (bench.hashes)
+            fprintf(bench.hashes, "%ld %016lx\n", bench.frame, bench_frame_hash());
+        bench.frame++;
+    }
+    if (frame_limit >= 0 && profiler.frames >= (uint64_t)frame_limit) {
+        bench_report();
+        return SDL_APP_SUCCESS;
+    }
     return SDL_APP_CONTINUE;
 }
 
@@ -438,8 +1064,7 @@ SDL_AppResult SDL_AppEvent(void *appstate, SDL_Event *e) {
             freecam = !freecam;
         }
         if (e->key.scancode == SDL_SCANCODE_N) {
-            ac.up = glms_vec3_normalize(ac.pos);
-            ac.right = glms_vec3_normalize(glms_cross(ac.forward, ac.up));
+            level_requested = true;
         }
         if (e->key.scancode == SDL_SCANCODE_ESCAPE) {
             if (SDL_GetWindowRelativeMouseMode(window)) {
@@ -455,6 +1080,11 @@ SDL_AppResult SDL_AppEvent(void *appstate, SDL_Event *e) {
             }
         }
         return SDL_APP_CONTINUE;
+    case SDL_EVENT_MOUSE_BUTTON_DOWN:
+        if (e->button.button == SDL_BUTTON_LEFT && !SDL_GetWindowRelativeMouseMode(window) &&
+            !igIO->WantCaptureMouse && terrain_model.heights.db)
+            pick_terrain(e->button.x, e->button.y);
+        return SDL_APP_CONTINUE;
     case SDL_EVENT_JOYSTICK_ADDED:
         joy = SDL_OpenJoystick(e->jdevice.which);
         return SDL_APP_CONTINUE;
@@ -464,26 +1094,89 @@ SDL_AppResult SDL_AppEvent(void *appstate, SDL_Event *e) {
 }
 
 SDL_AppResult SDL_AppInit(void **appstate, int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--udp") == 0) {
+            net_input = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                net_port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            profile_path = argv[++i];
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frame_limit = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            bench.enabled = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                bench.path_file = argv[++i];
+        } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc &&
+                   sscanf(argv[i + 1], "%dx%d", &bench.width, &bench.height) == 2) {
+            i++;
+        } else if (strcmp(argv[i], "--hashes") == 0 && i + 1 < argc) {
+            bench.hash_file = argv[++i];
+        } else if (strcmp(argv[i], "--record") == 0) {
+            recording = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                record_path = argv[++i];
+        } else if (strcmp(argv[i], "--overlay") == 0 && i + 1 < argc) {
+            overlay_path = argv[++i];
+        } else if (strcmp(argv[i], "--watch-shaders") == 0) {
+            watch_shaders = true;
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            if (!flight_log_open(&replay, argv[++i]))
+                return SDL_APP_FAILURE;
+            replaying = true;
+        } else {
+            fprintf(stderr,
+                    "usage: %s [--udp [port]] [--profile out.json|out.csv] [--frames n]\n"
+                    "          [--record [out.svfl]] [--replay in.svfl] [--overlay in.csv]\n"
+                    "          [--watch-shaders]\n"
+                    "          [--bench [path.csv] [--size WxH] [--hashes out.txt]]\n",
+                    argv[0]);
+            return SDL_APP_FAILURE;
+        }
+    }
+    if (net_input && !netin_start(&netin, net_port))
+        return SDL_APP_FAILURE;
+    if (recording && !flight_log_create(&recorder, record_path))
+        return SDL_APP_FAILURE;
+
+    // the benchmark needs no display: the offscreen driver makes its context
+    // through EGL, which Mesa backs with llvmpipe when there is no GPU
+    if (bench.enabled)
+        SDL_SetHint(SDL_HINT_VIDEO_DRIVER, "offscreen");
     SDL_Init(SDL_INIT_VIDEO | SDL_INIT_GAMEPAD);
-    last_tick = SDL_GetTicks();
 
     SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
-    SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, 1);
-    SDL_GL_SetAttribute(SDL_GL_MULTISAMPLESAMPLES, 4);
-
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 2);
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_COMPATIBILITY);
+    if (!bench.enabled) {
+        SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, 1);
+        SDL_GL_SetAttribute(SDL_GL_MULTISAMPLESAMPLES, 4);
+    }
 
-    window =
-        SDL_CreateWindow("synvis", 1024, 768,
-                         SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE | SDL_WINDOW_HIGH_PIXEL_DENSITY);
-    SDL_SetWindowRelativeMouseMode(window, true);
+    // nothing draws with the fixed function pipeline, see hud.h
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_FORWARD_COMPATIBLE_FLAG);
+
+    window = SDL_CreateWindow("synvis", 1024, 768,
+                              SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE |
+                                  SDL_WINDOW_HIGH_PIXEL_DENSITY |
+                                  (bench.enabled ? SDL_WINDOW_HIDDEN : 0));
+    if (!window) {
+        fprintf(stderr, "Failed to create window: %s\n", SDL_GetError());
+        return SDL_APP_FAILURE;
+    }
+    if (!bench.enabled)
+        SDL_SetWindowRelativeMouseMode(window, true);
 
-    SDL_GL_SetSwapInterval(1);
     glctx = SDL_GL_CreateContext(window);
-    if (glewInit() != GLEW_OK) {
-        fprintf(stderr, "Failed to initialize GLEW\n");
+    SDL_GL_SetSwapInterval(bench.enabled ? 0 : 1);
+    glewExperimental = GL_TRUE; // otherwise GLEW skips entry points of core contexts
+    GLenum glew = glewInit();
+    // a GLX build of GLEW has loaded the core entry points before it finds
+    // no GLX display under the offscreen driver's EGL context; nothing here
+    // needs GLX
+    if (glew != GLEW_OK && !(bench.enabled && glew == GLEW_ERROR_NO_GLX_DISPLAY)) {
+        fprintf(stderr, "Failed to initialize GLEW: %s\n", glewGetErrorString(glew));
         return 1;
     }
     glEnable(GL_DEPTH_TEST);
@@ -500,16 +1193,92 @@ SDL_AppResult SDL_AppInit(void **appstate, int argc, char *argv[]) {
     ImGui_ImplSDL3_InitForOpenGL(window, glctx);
     ImGui_ImplOpenGL3_Init("#version 330");
 
+    program_cache_init(&programs, PROGRAM_CACHE_DIR);
     make_terrain();
     ellipsoid_model.mesh = gen_ellipsoid(WGS84_A, WGS84_B);
-    ellipsoid_model.shader = load_program("shaders/ellipsoid.vs", "shaders/ellipsoid.fs");
+    ellipsoid_set_program(load_program("shaders/ellipsoid.vs", "shaders/ellipsoid.fs"));
+    graticule_set_program(load_program("shaders/graticule.vs", "shaders/graticule.fs"));
+    glGenVertexArrays(1, &ellipsoid_model.empty_vao);
+    hud_init(&hud, load_program("shaders/hud.vs", "shaders/hud.fs"));
+    overlay_set_program(load_program("shaders/overlay.vs", "shaders/overlay.fs"));
+    glGenVertexArrays(1, &overlay_model.vao);
+    glGenBuffers(1, &overlay_model.feature_buf);
+    glGenTextures(1, &overlay_model.feature_tex);
+    glBindBuffer(GL_TEXTURE_BUFFER, overlay_model.feature_buf);
+    glBindTexture(GL_TEXTURE_BUFFER, overlay_model.feature_tex);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, overlay_model.feature_buf);
+    // optional, the view stays empty without it; only a file asked for by
+    // name is worth an error when it cannot be read
+    const char *path = overlay_path ? overlay_path : "overlay.csv";
+    if ((overlay_path || SDL_GetPathInfo(path, NULL)) && overlay_load(&overlay_model.data, path)) {
+        printf("Overlay: %zu features from %s\n", overlay_model.data.count, path);
+        overlay_gatherer_init(&overlay_model.gatherer, &overlay_model.data, &terrain_model.heights);
+        overlay_model.gatherer_started = true;
+    }
+    printf("Shaders: %u cached, %u compiled in %.1f ms\n", atomic_load(&programs.hits),
+           atomic_load(&programs.misses), atomic_load(&programs.load_ns) * 1e-6);
+    if (watch_shaders) {
+        terrain_watch_id =
+            program_watch_add(&shader_watch, "shaders/terrain.vs", "shaders/terrain.fs");
+        ellipsoid_watch_id =
+            program_watch_add(&shader_watch, "shaders/ellipsoid.vs", "shaders/ellipsoid.fs");
+        graticule_watch_id =
+            program_watch_add(&shader_watch, "shaders/graticule.vs", "shaders/graticule.fs");
+        hud_watch_id = program_watch_add(&shader_watch, "shaders/hud.vs", "shaders/hud.fs");
+        overlay_watch_id =
+            program_watch_add(&shader_watch, "shaders/overlay.vs", "shaders/overlay.fs");
+        program_watch_start(&shader_watch, &programs, window, glctx);
+    }
 
+    profiler_init(&profiler, profile_series, PROF_COUNT);
+    if (bench.enabled) {
+        if (bench.hash_file)
+            taws_enabled = false; // its alert tint arrives asynchronously
+        if (!bench_init())
+            return SDL_APP_FAILURE;
+    } else {
+        sim_start(&sim, &ac);
+    }
     return 0;
 }
 
 void SDL_AppQuit(void *appstate, SDL_AppResult result) {
-    // TODO: cleanup tiles
+    if (profile_path)
+        profiler_dump(&profiler, profile_path);
+    profiler_destroy(&profiler);
+    if (bench.hashes)
+        fclose(bench.hashes);
+    flight_path_free(&bench.path);
+    free(bench.frame_ms);
+    glDeleteFramebuffers(1, &bench.fbo);
+    glDeleteRenderbuffers(1, &bench.color);
+    glDeleteRenderbuffers(1, &bench.depth);
+    flight_log_finish(&recorder);
+    flight_log_close(&replay);
+    sim_stop(&sim);
+    netin_stop(&netin);
+    tile_cache_destroy(&terrain_model.cache);
+    taws_destroy(&taws);
+    if (overlay_model.gatherer_started)
+        overlay_gatherer_destroy(&overlay_model.gatherer);
+    los_destroy(&los);
+    terrain_destroy(&terrain_model.heights);
+    tdb_close(&terrain_model.db);
+    free(terrain_model.tiles);
+    free(terrain_model.visible);
+    free(terrain_model.candidates);
+    free(terrain_model.chunks);
+    free(terrain_model.chunk_data);
+    glDeleteBuffers(1, &terrain_model.chunk_buf);
+    glDeleteTextures(1, &terrain_model.chunk_tex);
+    overlay_destroy(&overlay_model.data);
+    overlay_view_destroy(&overlay_model.view);
+    glDeleteBuffers(1, &overlay_model.feature_buf);
+    glDeleteTextures(1, &overlay_model.feature_tex);
+    glDeleteVertexArrays(1, &overlay_model.vao);
     SDL_CloseJoystick(joy);
+    program_watch_stop(&shader_watch);
+    hud_destroy(&hud);
     SDL_GL_DestroyContext(glctx);
     SDL_DestroyWindow(window);
     SDL_Quit();
@@ -5,12 +5,19 @@
 #include <cglm/struct.h>
 #include <cglm/util.h>
 #include <malloc.h>
+#include <stdbool.h>
+#include <stdint.h>
 
 struct mesh {
     GLuint vao, vbo, ebo;
     GLsizei index_count;
+    GLenum index_type;
 };
 
+// Quads per band of gen_grid(). A band row touches band + 1 new vertices and
+// reuses the band + 1 of the row above, which fits the post-transform cache.
+#define GRID_BAND 16
+
 struct mesh gen_plane(float w, float h, int resx, int resz) {
     int vx = resx + 1;
     int vz = resz + 1;
@@ -45,6 +52,7 @@ struct mesh gen_plane(float w, float h, int resx, int resz) {
 
     struct mesh m = {
         .index_count = resx * resz * 6,
+        .index_type = GL_UNSIGNED_INT,
     };
     glGenVertexArrays(1, &m.vao);
     glBindVertexArray(m.vao);
@@ -68,6 +76,50 @@ struct mesh gen_plane(float w, float h, int resx, int resz) {
     return m;
 }
 
+// Index-only grid of res x res quads plus border rings, for shaders that
+// derive positions from gl_VertexID. Quads are emitted in vertical bands of
+// GRID_BAND columns, row by row within a band, so consecutive rows share
+// vertices while they are still in the vertex cache. Indices are 16-bit
+// whenever the grid has at most 65536 vertices.
+struct mesh gen_grid(int res, int border) {
+    int vx = res + 1 + 2 * border;
+    int quads = (vx - 1) * (vx - 1);
+    int icount = quads * 6;
+    bool small = vx * vx <= 65536;
+    size_t isize = small ? sizeof(uint16_t) : sizeof(unsigned int);
+    void *indices = malloc(isize * icount);
+    int idx = 0;
+    for (int x0 = 0; x0 < vx - 1; x0 += GRID_BAND) {
+        int x1 = x0 + GRID_BAND < vx - 1 ? x0 + GRID_BAND : vx - 1;
+        for (int y = 0; y < vx - 1; y++) {
+            for (int x = x0; x < x1; x++) {
+                int i = y * vx + x;
+                unsigned quad[] = {i, i + vx, i + 1, i + 1, i + vx, i + vx + 1};
+                for (int k = 0; k < 6; k++, idx++) {
+                    if (small)
+                        ((uint16_t *)indices)[idx] = quad[k];
+                    else
+                        ((unsigned int *)indices)[idx] = quad[k];
+                }
+            }
+        }
+    }
+
+    struct mesh m = {
+        .index_count = icount,
+        .index_type = small ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT,
+    };
+    glGenVertexArrays(1, &m.vao);
+    glBindVertexArray(m.vao);
+
+    glGenBuffers(1, &m.ebo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m.ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, icount * isize, indices, GL_STATIC_DRAW);
+
+    free(indices);
+    return m;
+}
+
 struct mesh gen_ellipsoid(double a, double b) {
     const double e2 = 1.0 - (b * b) / (a * a);
 
@@ -127,6 +179,7 @@ struct mesh gen_ellipsoid(double a, double b) {
 
     struct mesh m = {
         .index_count = icount,
+        .index_type = GL_UNSIGNED_INT,
     };
     glGenVertexArrays(1, &m.vao);
     glBindVertexArray(m.vao);
@@ -0,0 +1,284 @@
+#ifndef NETIN_H
+#define NETIN_H
+
+#include <SDL3/SDL_timer.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "aircraft_state.h"
+
+// Aircraft state from an external simulator or avionics bus over UDP.
+//
+// A receiver thread parses position/attitude packets and pushes them through
+// a single producer, single consumer ring; the render thread drains it each
+// frame and dead-reckons from the last two samples to the present, so the
+// picture moves smoothly between packets. Two layouts are accepted, told
+// apart by their first four bytes:
+//
+//   "SYNV"  simple binary, little endian, 52 bytes (udp_send.py sends it)
+//             0 char[4]  magic
+//             4 u32      sequence number
+//             8 u64      sender time in ns, any epoch
+//            16 f64 x3   lat, lon in degrees, height in m above the ellipsoid
+//            40 f32 x3   heading, pitch, roll in degrees
+//   "DATA"  X-Plane data output, reading groups 17 (pitch, roll, heading)
+//           and 20 (lat, lon, altitude in ft)
+//
+// Sender timestamps are mapped onto the local clock through the smallest
+// receive minus send difference seen, which removes network and scheduling
+// jitter from the sample times. X-Plane sends none, so its samples are timed
+// on arrival.
+
+#define NETIN_DEFAULT_PORT 49003
+#define NETIN_RING 256                  // samples, a power of two
+#define NETIN_EXTRAPOLATE_NS 500000000  // dead-reckon at most this far past a sample
+#define NETIN_STALE_NS 2000000000       // a source silent this long is lost
+#define NETIN_OFFSET_RELAX_NS 10000     // clock offset drift allowed per packet
+#define NETIN_LATENCY_WINDOW 256
+
+#define NETIN_SYNV_SIZE 52
+
+struct netin_sample {
+    Uint64 recv_ns;             // local arrival time
+    Uint64 time_ns;             // local time the sample describes
+    double lat, lon, height;    // degrees, km
+    float heading, pitch, roll; // degrees
+};
+
+struct netin {
+    int fd;
+    uint16_t port;
+    pthread_t thread;
+    atomic_bool quit;
+
+    struct netin_sample ring[NETIN_RING];
+    atomic_size_t head, tail; // head written by the receiver, tail by the reader
+
+    // receiver only
+    struct netin_sample xplane; // groups arrive in separate packets as often as not
+    bool have_offset;
+    int64_t offset_ns; // local minus sender clock
+
+    // reader only
+    struct netin_sample prev, last;
+    int samples;
+    float latency_ms[NETIN_LATENCY_WINDOW]; // packet to pixel
+    int latency_count, latency_next;
+
+    atomic_uint_fast64_t packets, dropped, malformed;
+};
+
+static bool netin_push(struct netin *n, const struct netin_sample *s) {
+    size_t head = atomic_load_explicit(&n->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&n->tail, memory_order_acquire) == NETIN_RING) {
+        atomic_fetch_add(&n->dropped, 1);
+        return false;
+    }
+    n->ring[head & (NETIN_RING - 1)] = *s;
+    atomic_store_explicit(&n->head, head + 1, memory_order_release);
+    return true;
+}
+
+static bool netin_pop(struct netin *n, struct netin_sample *s) {
+    size_t tail = atomic_load_explicit(&n->tail, memory_order_relaxed);
+    if (tail == atomic_load_explicit(&n->head, memory_order_acquire))
+        return false;
+    *s = n->ring[tail & (NETIN_RING - 1)];
+    atomic_store_explicit(&n->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+static bool netin_parse_synv(struct netin *n, const uint8_t *p, size_t len, Uint64 recv_ns,
+                             struct netin_sample *s) {
+    if (len < NETIN_SYNV_SIZE)
+        return false;
+    uint64_t sent;
+    double geo[3];
+    float att[3];
+    memcpy(&sent, p + 8, sizeof(sent));
+    memcpy(geo, p + 16, sizeof(geo));
+    memcpy(att, p + 40, sizeof(att));
+
+    int64_t offset = (int64_t)(recv_ns - sent);
+    if (!n->have_offset || offset < n->offset_ns + NETIN_OFFSET_RELAX_NS)
+        n->offset_ns = offset;
+    else
+        n->offset_ns += NETIN_OFFSET_RELAX_NS;
+    n->have_offset = true;
+
+    *s = (struct netin_sample){
+        .recv_ns = recv_ns,
+        .time_ns = sent + n->offset_ns,
+        .lat = geo[0],
+        .lon = geo[1],
+        .height = geo[2] / 1000,
+        .heading = att[0],
+        .pitch = att[1],
+        .roll = att[2],
+    };
+    return true;
+}
+
+static bool netin_parse_xplane(struct netin *n, const uint8_t *p, size_t len, Uint64 recv_ns,
+                               struct netin_sample *s) {
+    // "DATA" plus one byte, then 36 byte groups of an index and eight floats
+    bool any = false;
+    for (size_t off = 5; off + 36 <= len; off += 36) {
+        int32_t index;
+        float v[8];
+        memcpy(&index, p + off, sizeof(index));
+        memcpy(v, p + off + 4, sizeof(v));
+        if (index == 17) {
+            n->xplane.pitch = v[0];
+            n->xplane.roll = v[1];
+            n->xplane.heading = v[2];
+            any = true;
+        } else if (index == 20) {
+            n->xplane.lat = v[0];
+            n->xplane.lon = v[1];
+            n->xplane.height = v[2] * 0.0003048;
+            any = true;
+        }
+    }
+    if (!any)
+        return false;
+    *s = n->xplane;
+    s->recv_ns = s->time_ns = recv_ns;
+    return true;
+}
+
+static void *netin_worker(void *arg) {
+    struct netin *n = arg;
+    uint8_t buf[2048];
+    while (!atomic_load(&n->quit)) {
+        ssize_t len = recv(n->fd, buf, sizeof(buf), 0);
+        if (len < 0)
+            continue; // timeout, look at quit again
+        Uint64 now = SDL_GetTicksNS();
+        atomic_fetch_add(&n->packets, 1);
+
+        struct netin_sample s;
+        bool ok = false;
+        if (len >= 4 && memcmp(buf, "SYNV", 4) == 0)
+            ok = netin_parse_synv(n, buf, len, now, &s);
+        else if (len >= 5 && memcmp(buf, "DATA", 4) == 0)
+            ok = netin_parse_xplane(n, buf, len, now, &s);
+        if (ok)
+            netin_push(n, &s);
+        else
+            atomic_fetch_add(&n->malformed, 1);
+    }
+    return NULL;
+}
+
+bool netin_start(struct netin *n, uint16_t port) {
+    *n = (struct netin){.port = port};
+    n->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (n->fd < 0) {
+        perror("netin: socket");
+        return false;
+    }
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (bind(n->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "netin: cannot bind UDP port %u: %s\n", port, strerror(errno));
+        close(n->fd);
+        n->fd = -1;
+        return false;
+    }
+    // wake up now and then to notice netin_stop()
+    struct timeval tv = {.tv_usec = 100000};
+    setsockopt(n->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    pthread_create(&n->thread, NULL, netin_worker, n);
+    return true;
+}
+
+void netin_stop(struct netin *n) {
+    if (n->fd < 0)
+        return;
+    atomic_store(&n->quit, true);
+    pthread_join(n->thread, NULL);
+    close(n->fd);
+    n->fd = -1;
+}
+
+static double netin_wrap180(double deg) { return remainder(deg, 360); }
+
+// Drain the ring and dead-reckon the newest sample to now_ns. Fills vel in
+// km/s and the arrival time of the newest sample for latency accounting.
+// Returns false before the first sample or once the source has gone quiet.
+bool netin_state(struct netin *n, Uint64 now_ns, struct aircraft_state *ac, double vel[3],
+                 Uint64 *recv_ns) {
+    struct netin_sample s;
+    while (netin_pop(n, &s)) {
+        if (n->samples > 0 && s.time_ns <= n->last.time_ns)
+            continue; // reordered or duplicated
+        n->prev = n->last;
+        n->last = s;
+        n->samples++;
+    }
+    if (n->samples == 0 || now_ns - n->last.recv_ns > NETIN_STALE_NS)
+        return false;
+
+    const struct netin_sample *a = &n->prev, *b = &n->last;
+    double rate[6] = {0};
+    if (n->samples > 1 && b->time_ns - a->time_ns < NETIN_STALE_NS) {
+        double dt = (b->time_ns - a->time_ns) * 1e-9;
+        rate[0] = (b->lat - a->lat) / dt;
+        rate[1] = netin_wrap180(b->lon - a->lon) / dt;
+        rate[2] = (b->height - a->height) / dt;
+        rate[3] = netin_wrap180(b->heading - a->heading) / dt;
+        rate[4] = (b->pitch - a->pitch) / dt;
+        rate[5] = netin_wrap180(b->roll - a->roll) / dt;
+    }
+    double t = now_ns > b->time_ns ? (now_ns - b->time_ns) * 1e-9 : 0;
+    if (t > NETIN_EXTRAPOLATE_NS * 1e-9)
+        t = NETIN_EXTRAPOLATE_NS * 1e-9;
+
+    aircraft_set_pose(ac, b->lat + rate[0] * t, netin_wrap180(b->lon + rate[1] * t),
+                      b->height + rate[2] * t, b->heading + rate[3] * t, b->pitch + rate[4] * t,
+                      b->roll + rate[5] * t);
+
+    double lat = deg2rad(b->lat), lon = deg2rad(b->lon);
+    double v_north = deg2rad(rate[0]) * (WGS84_A + b->height);
+    double v_east = deg2rad(rate[1]) * (WGS84_A + b->height) * cos(lat);
+    vel[0] = -sin(lon) * v_east - sin(lat) * cos(lon) * v_north + cos(lat) * cos(lon) * rate[2];
+    vel[1] = cos(lon) * v_east - sin(lat) * sin(lon) * v_north + cos(lat) * sin(lon) * rate[2];
+    vel[2] = cos(lat) * v_north + sin(lat) * rate[2];
+    *recv_ns = b->recv_ns;
+    return true;
+}
+
+// Record that the sample received at recv_ns reached the screen at shown_ns.
+void netin_record_latency(struct netin *n, Uint64 recv_ns, Uint64 shown_ns) {
+    n->latency_ms[n->latency_next] = (shown_ns - recv_ns) * 1e-6f;
+    n->latency_next = (n->latency_next + 1) % NETIN_LATENCY_WINDOW;
+    if (n->latency_count < NETIN_LATENCY_WINDOW)
+        n->latency_count++;
+}
+
+// Mean and worst packet to pixel latency over the last NETIN_LATENCY_WINDOW frames.
+void netin_latency(const struct netin *n, float *mean_ms, float *max_ms) {
+    *mean_ms = *max_ms = 0;
+    for (int i = 0; i < n->latency_count; i++) {
+        *mean_ms += n->latency_ms[i];
+        if (n->latency_ms[i] > *max_ms)
+            *max_ms = n->latency_ms[i];
+    }
+    if (n->latency_count)
+        *mean_ms /= n->latency_count;
+}
+
+#endif
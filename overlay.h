@@ -0,0 +1,422 @@
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "aircraft_state.h"
+#include "terrain.h"
+
+// Obstacles and airports drawn over the terrain.
+//
+// Files are CSV with one feature per line:
+//
+//   kind,lat_deg,lon_deg,height_m,length_m,width_m,heading_deg
+//
+// kind is tower, building or runway. The position is the center of the
+// feature's footprint and height is above the ground there. Length runs
+// along heading, in degrees true. Blank lines, '#' comments and a header
+// line are skipped. overlay.py converts runways from OurAirports.
+//
+// Features are sorted by cell of a lat/lon grid, row by row, so the cells of
+// one row near a point hold one run of features, found by binary search.
+// overlay_gather() collects the features within range of the aircraft,
+// stands them on the terrain and writes their instance parameters for
+// overlay.vs. Queries reach OVERLAY_MARGIN further than the range, and are
+// only repeated once the aircraft has moved that far.
+//
+// The render thread hands that work to a gatherer thread, as it does TAWS:
+// overlay_submit() passes on the aircraft position without blocking and
+// overlay_take() swaps in the last view finished, so the frame that crosses
+// the margin does not stall on a large range.
+
+#define OVERLAY_CELLS_PER_DEG 8
+#define OVERLAY_ROWS (180 * OVERLAY_CELLS_PER_DEG)
+#define OVERLAY_COLS (360 * OVERLAY_CELLS_PER_DEG)
+#define OVERLAY_KM_PER_DEG (WGS84_A * M_PI / 180)
+#define OVERLAY_MARGIN 0.25 // of the range
+#define OVERLAY_TEXELS 4    // RGBA32F texels per instance, see overlay.vs
+
+enum overlay_kind {
+    OVERLAY_TOWER,
+    OVERLAY_BUILDING,
+    OVERLAY_RUNWAY,
+    OVERLAY_KINDS,
+};
+
+static const char *const OVERLAY_KIND_NAMES[OVERLAY_KINDS] = {"tower", "building", "runway"};
+
+struct overlay_feature {
+    double lat, lon;     // degrees, center of the footprint
+    float height;        // km above the ground
+    float length, width; // km
+    float heading;       // radians true, along the length
+    uint32_t cell;       // row * OVERLAY_COLS + column
+    uint8_t kind;
+};
+
+struct overlay {
+    struct overlay_feature *features; // by cell
+    size_t count;
+};
+
+// Features within range of the aircraft, ready to draw.
+struct overlay_view {
+    double lat, lon;  // degrees, where the features were gathered
+    double range;     // km, 0 before the first query
+    double anchor[3]; // km ECEF on the ellipsoid under (lat, lon)
+    uint32_t *selected;
+    size_t count, cap;
+    // ground points, the center of a feature or both ends of a runway
+    double *point_lat, *point_lon;
+    float *ground;
+    size_t point_cap;
+    float *instances; // 4 * OVERLAY_TEXELS per selected feature
+    double query_ms;
+};
+
+static inline uint32_t overlay_cell(double lat, double lon) {
+    int row = floor((lat + 90) * OVERLAY_CELLS_PER_DEG);
+    int col = floor((lon + 180) * OVERLAY_CELLS_PER_DEG);
+    row = row < 0 ? 0 : row >= OVERLAY_ROWS ? OVERLAY_ROWS - 1 : row;
+    col = ((col % OVERLAY_COLS) + OVERLAY_COLS) % OVERLAY_COLS;
+    return (uint32_t)row * OVERLAY_COLS + col;
+}
+
+static int overlay_compare(const void *a, const void *b) {
+    uint32_t x = ((const struct overlay_feature *)a)->cell;
+    uint32_t y = ((const struct overlay_feature *)b)->cell;
+    return (x > y) - (x < y);
+}
+
+// Sort features into cells once they are all added.
+void overlay_index(struct overlay *o) {
+    for (size_t i = 0; i < o->count; i++)
+        o->features[i].cell = overlay_cell(o->features[i].lat, o->features[i].lon);
+    qsort(o->features, o->count, sizeof(struct overlay_feature), overlay_compare);
+}
+
+bool overlay_load(struct overlay *o, const char *path) {
+    *o = (struct overlay){0};
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "overlay: cannot open %s\n", path);
+        return false;
+    }
+    size_t cap = 0;
+    char line[256];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        char kind[16];
+        double lat, lon, height, length, width, heading;
+        if (sscanf(line, "%15[^,],%lf,%lf,%lf,%lf,%lf,%lf", kind, &lat, &lon, &height, &length,
+                   &width, &heading) != 7)
+            continue; // header, comment or blank
+        int k = 0;
+        while (k < OVERLAY_KINDS && strcmp(kind, OVERLAY_KIND_NAMES[k]) != 0)
+            k++;
+        if (k == OVERLAY_KINDS || fabs(lat) > 90 || fabs(lon) > 180) {
+            fprintf(stderr, "overlay: %s:%d: skipped %s feature\n", path, lineno, kind);
+            continue;
+        }
+        if (o->count == cap) {
+            cap = cap ? cap * 2 : 1024;
+            o->features = realloc(o->features, sizeof(struct overlay_feature) * cap);
+        }
+        o->features[o->count++] = (struct overlay_feature){
+            .lat = lat,
+            .lon = lon,
+            .height = height / 1000,
+            .length = length / 1000,
+            .width = width / 1000,
+            .heading = deg2rad(heading),
+            .kind = k,
+        };
+    }
+    fclose(f);
+    if (o->count == 0) {
+        fprintf(stderr, "overlay: no features in %s\n", path);
+        return false;
+    }
+    overlay_index(o);
+    return true;
+}
+
+void overlay_destroy(struct overlay *o) {
+    free(o->features);
+    *o = (struct overlay){0};
+}
+
+void overlay_view_destroy(struct overlay_view *v) {
+    free(v->selected);
+    free(v->point_lat);
+    free(v->point_lon);
+    free(v->ground);
+    free(v->instances);
+    *v = (struct overlay_view){0};
+}
+
+// First feature with a cell of at least key.
+static size_t overlay_lower_bound(const struct overlay *o, uint32_t key) {
+    size_t lo = 0, hi = o->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (o->features[mid].cell < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// Ground distance in km, flat over the few hundred km of a query.
+static inline double overlay_distance(double lat0, double lon0, double lat, double lon) {
+    double dlon = remainder(lon - lon0, 360);
+    double dn = (lat - lat0) * OVERLAY_KM_PER_DEG;
+    double de = dlon * OVERLAY_KM_PER_DEG * cos(deg2rad(lat0));
+    return sqrt(dn * dn + de * de);
+}
+
+static void overlay_select(struct overlay_view *v, size_t i) {
+    if (v->count == v->cap) {
+        v->cap = v->cap ? v->cap * 2 : 1024;
+        v->selected = realloc(v->selected, sizeof(uint32_t) * v->cap);
+    }
+    v->selected[v->count++] = i;
+}
+
+// Features of columns c0 to c1 in row, at most radius km from (lat, lon).
+static void overlay_query_run(const struct overlay *o, struct overlay_view *v, int row, int c0,
+                              int c1, double lat, double lon, double radius) {
+    uint32_t end = (uint32_t)row * OVERLAY_COLS + c1;
+    for (size_t i = overlay_lower_bound(o, (uint32_t)row * OVERLAY_COLS + c0);
+         i < o->count && o->features[i].cell <= end; i++)
+        if (overlay_distance(lat, lon, o->features[i].lat, o->features[i].lon) <= radius)
+            overlay_select(v, i);
+}
+
+// Replace the view's features with those at most radius km from (lat, lon).
+void overlay_query(const struct overlay *o, struct overlay_view *v, double lat, double lon,
+                   double radius) {
+    v->count = 0;
+    double dlat = radius / OVERLAY_KM_PER_DEG;
+    int r0 = floor((lat - dlat + 90) * OVERLAY_CELLS_PER_DEG);
+    int r1 = floor((lat + dlat + 90) * OVERLAY_CELLS_PER_DEG);
+    r0 = r0 < 0 ? 0 : r0;
+    r1 = r1 >= OVERLAY_ROWS ? OVERLAY_ROWS - 1 : r1;
+    // widest at the row nearest a pole
+    double polemost = fmin(fabs(lat) + dlat, 90);
+    double dlon = fmin(radius / (OVERLAY_KM_PER_DEG * cos(deg2rad(polemost))), 180);
+    int c0 = floor((lon - dlon + 180) * OVERLAY_CELLS_PER_DEG);
+    int c1 = floor((lon + dlon + 180) * OVERLAY_CELLS_PER_DEG);
+    for (int row = r0; row <= r1; row++) {
+        if (c1 - c0 + 1 >= OVERLAY_COLS) {
+            overlay_query_run(o, v, row, 0, OVERLAY_COLS - 1, lat, lon, radius);
+        } else if (c0 < 0) { // across the antimeridian
+            overlay_query_run(o, v, row, 0, c1, lat, lon, radius);
+            overlay_query_run(o, v, row, c0 + OVERLAY_COLS, OVERLAY_COLS - 1, lat, lon, radius);
+        } else if (c1 >= OVERLAY_COLS) {
+            overlay_query_run(o, v, row, 0, c1 - OVERLAY_COLS, lat, lon, radius);
+            overlay_query_run(o, v, row, c0, OVERLAY_COLS - 1, lat, lon, radius);
+        } else {
+            overlay_query_run(o, v, row, c0, c1, lat, lon, radius);
+        }
+    }
+}
+
+// (lat, lon) moved d km along heading.
+static inline void overlay_offset(double lat, double lon, float heading, double d,
+                                  double *out_lat, double *out_lon) {
+    *out_lat = lat + d * cos(heading) / OVERLAY_KM_PER_DEG;
+    *out_lon = lon + d * sin(heading) / (OVERLAY_KM_PER_DEG * cos(deg2rad(lat)));
+}
+
+// Ground heights under the selected features: one point at the center, or
+// the two ends of a runway, which is laid along the line between them.
+static void overlay_anchor(const struct overlay *o, struct overlay_view *v, struct terrain *t) {
+    if (v->point_cap < v->count * 2) {
+        v->point_cap = v->count * 2;
+        v->point_lat = realloc(v->point_lat, sizeof(double) * v->point_cap);
+        v->point_lon = realloc(v->point_lon, sizeof(double) * v->point_cap);
+        v->ground = realloc(v->ground, sizeof(float) * v->point_cap);
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < v->count; i++) {
+        const struct overlay_feature *f = &o->features[v->selected[i]];
+        if (f->kind == OVERLAY_RUNWAY) {
+            overlay_offset(f->lat, f->lon, f->heading, -f->length / 2, &v->point_lat[n],
+                           &v->point_lon[n]);
+            n++;
+            overlay_offset(f->lat, f->lon, f->heading, f->length / 2, &v->point_lat[n],
+                           &v->point_lon[n]);
+            n++;
+        } else {
+            v->point_lat[n] = f->lat;
+            v->point_lon[n++] = f->lon;
+        }
+    }
+    terrain_heights(t, v->point_lat, v->point_lon, v->ground, n);
+    for (size_t i = 0; i < n; i++)
+        if (isnan(v->ground[i]))
+            v->ground[i] = 0; // no tile, the sea
+}
+
+// Instance parameters of the selected features for overlay.vs, relative to
+// the view's anchor.
+static void overlay_instances(const struct overlay *o, struct overlay_view *v) {
+    v->instances = realloc(v->instances, sizeof(float) * 4 * OVERLAY_TEXELS * v->cap);
+    const float *ground = v->ground;
+    for (size_t i = 0; i < v->count; i++) {
+        const struct overlay_feature *f = &o->features[v->selected[i]];
+        float h = ground[0], rise = 0;
+        if (f->kind == OVERLAY_RUNWAY) {
+            h = (ground[0] + ground[1]) / 2;
+            rise = ground[1] - ground[0];
+            ground += 2;
+        } else {
+            ground++;
+        }
+        double phi = deg2rad(f->lat), lam = deg2rad(f->lon), p[3];
+        geodetic_to_ecef_d(phi, lam, h, p);
+        float data[4 * OVERLAY_TEXELS] = {
+            p[0] - v->anchor[0], p[1] - v->anchor[1], p[2] - v->anchor[2], f->kind,
+            sin(phi), cos(phi), sin(lam), cos(lam),
+            f->length, f->width, f->height, f->heading,
+            h, rise, 0, 0,
+        };
+        memcpy(v->instances + i * 4 * OVERLAY_TEXELS, data, sizeof(data));
+    }
+}
+
+// Whether a view gathered for range km around (lat, lon) still covers range
+// km around (to_lat, to_lon).
+static inline bool overlay_covers(double lat, double lon, double range, double to_lat,
+                                  double to_lon, double to_range) {
+    return range == to_range &&
+           overlay_distance(lat, lon, to_lat, to_lon) <= range * OVERLAY_MARGIN;
+}
+
+// Replace the view with the features within range km of (lat, lon) in
+// degrees.
+void overlay_gather(const struct overlay *o, struct overlay_view *v, struct terrain *t,
+                    double lat, double lon, double range) {
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    v->lat = lat;
+    v->lon = lon;
+    v->range = range;
+    geodetic_to_ecef_d(deg2rad(lat), deg2rad(lon), 0, v->anchor);
+    overlay_query(o, v, lat, lon, range * (1 + OVERLAY_MARGIN));
+    overlay_anchor(o, v, t);
+    overlay_instances(o, v);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    v->query_ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) * 1e-6;
+}
+
+struct overlay_gatherer {
+    const struct overlay *data;
+    struct terrain *terrain;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond, idle;
+    bool quit, pending, busy, ready;
+    double lat, lon, range;   // latest request, range 0 before the first
+    struct overlay_view done; // finished, until overlay_take() swaps it out
+    struct overlay_view work; // only touched by the worker
+};
+
+static void *overlay_worker(void *arg) {
+    struct overlay_gatherer *g = arg;
+    pthread_mutex_lock(&g->lock);
+    for (;;) {
+        while (!g->pending && !g->quit)
+            pthread_cond_wait(&g->cond, &g->lock);
+        if (g->quit)
+            break;
+        double lat = g->lat, lon = g->lon, range = g->range;
+        g->pending = false;
+        g->busy = true;
+        pthread_mutex_unlock(&g->lock);
+
+        overlay_gather(g->data, &g->work, g->terrain, lat, lon, range);
+
+        pthread_mutex_lock(&g->lock);
+        struct overlay_view v = g->done;
+        g->done = g->work;
+        g->work = v;
+        g->ready = true;
+        g->busy = false;
+        if (!g->pending)
+            pthread_cond_broadcast(&g->idle);
+    }
+    pthread_mutex_unlock(&g->lock);
+    return NULL;
+}
+
+// Start gathering views of o over the terrain t, which must outlive g.
+void overlay_gatherer_init(struct overlay_gatherer *g, const struct overlay *o,
+                           struct terrain *t) {
+    *g = (struct overlay_gatherer){.data = o, .terrain = t};
+    pthread_mutex_init(&g->lock, NULL);
+    pthread_cond_init(&g->cond, NULL);
+    pthread_cond_init(&g->idle, NULL);
+    pthread_create(&g->thread, NULL, overlay_worker, g);
+}
+
+void overlay_gatherer_destroy(struct overlay_gatherer *g) {
+    pthread_mutex_lock(&g->lock);
+    g->quit = true;
+    pthread_cond_signal(&g->cond);
+    pthread_mutex_unlock(&g->lock);
+    pthread_join(g->thread, NULL);
+    pthread_mutex_destroy(&g->lock);
+    pthread_cond_destroy(&g->cond);
+    pthread_cond_destroy(&g->idle);
+    overlay_view_destroy(&g->done);
+    overlay_view_destroy(&g->work);
+}
+
+// Ask for the features within range km of (lat, lon) unless the latest
+// request already covers them. Never waits for a gather.
+void overlay_submit(struct overlay_gatherer *g, double lat, double lon, double range) {
+    pthread_mutex_lock(&g->lock);
+    if (!overlay_covers(g->lat, g->lon, g->range, lat, lon, range)) {
+        g->lat = lat;
+        g->lon = lon;
+        g->range = range;
+        g->pending = true;
+        pthread_cond_signal(&g->cond);
+    }
+    pthread_mutex_unlock(&g->lock);
+}
+
+// Block until every request so far is gathered.
+void overlay_wait(struct overlay_gatherer *g) {
+    pthread_mutex_lock(&g->lock);
+    while (g->pending || g->busy)
+        pthread_cond_wait(&g->idle, &g->lock);
+    pthread_mutex_unlock(&g->lock);
+}
+
+// Swap a newly finished view into v. Returns whether there was one.
+bool overlay_take(struct overlay_gatherer *g, struct overlay_view *v) {
+    pthread_mutex_lock(&g->lock);
+    bool ready = g->ready;
+    if (ready) {
+        struct overlay_view old = *v;
+        *v = g->done;
+        g->done = old;
+        g->ready = false;
+    }
+    pthread_mutex_unlock(&g->lock);
+    return ready;
+}
+
+#endif
@@ -0,0 +1,60 @@
+import csv
+import math
+import os
+
+DATA_DIR = "data"
+
+# runways.csv from https://ourairports.com/data/, to the feature CSV read by
+# overlay.h. Obstacles use the same columns and can be appended by hand:
+#   kind,lat_deg,lon_deg,height_m,length_m,width_m,heading_deg
+RUNWAYS = os.path.join(DATA_DIR, "runways.csv")
+FT = 0.3048
+RUNWAY_HEIGHT_M = 0.5  # above the ground line between the thresholds
+EARTH_RADIUS_M = 6371008.8
+
+
+def bearing(lat1: float, lon1: float, lat2: float, lon2: float) -> float:
+    p1, p2 = math.radians(lat1), math.radians(lat2)
+    dl = math.radians(lon2 - lon1)
+    y = math.sin(dl) * math.cos(p2)
+    x = math.cos(p1) * math.sin(p2) - math.sin(p1) * math.cos(p2) * math.cos(dl)
+    return math.degrees(math.atan2(y, x)) % 360
+
+
+def distance(lat1: float, lon1: float, lat2: float, lon2: float) -> float:
+    p1, p2 = math.radians(lat1), math.radians(lat2)
+    dp, dl = p2 - p1, math.radians(lon2 - lon1)
+    a = math.sin(dp / 2) ** 2 + math.cos(p1) * math.cos(p2) * math.sin(dl / 2) ** 2
+    return 2 * EARTH_RADIUS_M * math.asin(math.sqrt(a))
+
+
+def number(row: dict, key: str) -> float | None:
+    try:
+        return float(row[key])
+    except (KeyError, ValueError):
+        return None
+
+
+count = skipped = 0
+with open(RUNWAYS, newline="") as f, open("overlay.csv", "w") as out:
+    out.write("kind,lat_deg,lon_deg,height_m,length_m,width_m,heading_deg\n")
+    for row in csv.DictReader(f):
+        ends = [number(row, k) for k in
+                ("le_latitude_deg", "le_longitude_deg", "he_latitude_deg", "he_longitude_deg")]
+        width_ft = number(row, "width_ft")
+        # runways without both thresholds have no place to go
+        if row.get("closed") == "1" or None in ends or not width_ft:
+            skipped += 1
+            continue
+        lat1, lon1, lat2, lon2 = ends
+        length = distance(lat1, lon1, lat2, lon2)
+        if length == 0:
+            skipped += 1
+            continue
+        out.write(
+            f"runway,{(lat1 + lat2) / 2:.7f},{(lon1 + lon2) / 2:.7f},{RUNWAY_HEIGHT_M},"
+            f"{length:.1f},{width_ft * FT:.1f},{bearing(lat1, lon1, lat2, lon2):.2f}\n"
+        )
+        count += 1
+
+print(f"{count} runways, {skipped} skipped")
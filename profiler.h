@@ -0,0 +1,215 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <GL/glew.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Per-frame timings and counters with rolling percentiles.
+//
+// Every series keeps its value for each of the last PROFILER_HISTORY frames.
+// CPU scopes are timed with the monotonic clock and add up if a scope runs
+// more than once in a frame; frames in which a scope did not run leave no
+// sample rather than a zero. GPU scopes use GL_TIME_ELAPSED queries in
+// PROFILER_QUERY_FRAMES sets used round robin, and a result is only picked
+// up once the GPU has it, so timing never stalls the pipeline; GPU history
+// lags the CPU by a frame or two. Elapsed-time queries cannot nest, so GPU
+// scopes must not overlap each other. Counters are values set once a frame.
+
+#define PROFILER_MAX_SERIES 32
+#define PROFILER_HISTORY 512 // frames
+#define PROFILER_QUERY_FRAMES 2
+
+enum profiler_kind { PROFILER_CPU, PROFILER_GPU, PROFILER_COUNTER };
+
+struct profiler_desc {
+    const char *name;
+    enum profiler_kind kind;
+};
+
+struct profiler_series {
+    struct profiler_desc desc;
+    float history[PROFILER_HISTORY]; // ms for scopes
+    int count, next;                 // filled entries and the slot written next
+    double value;                    // this frame so far
+    bool ran;                        // CPU scope began this frame
+    uint64_t start_ns;
+    GLuint queries[PROFILER_QUERY_FRAMES];
+    bool issued[PROFILER_QUERY_FRAMES];
+};
+
+struct profiler {
+    struct profiler_series series[PROFILER_MAX_SERIES];
+    int num_series;
+    uint64_t frames;
+    bool gpu; // timer queries available
+};
+
+struct profiler_stats {
+    int samples;
+    float mean, p50, p95, p99, max;
+};
+
+static inline uint64_t profiler_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Set up series in the order given, their indices are the ids used below.
+// Needs a current GL context for GPU series.
+void profiler_init(struct profiler *p, const struct profiler_desc *desc, int n) {
+    *p = (struct profiler){.num_series = n < PROFILER_MAX_SERIES ? n : PROFILER_MAX_SERIES};
+    p->gpu = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+    for (int i = 0; i < p->num_series; i++) {
+        struct profiler_series *s = &p->series[i];
+        s->desc = desc[i];
+        if (s->desc.kind == PROFILER_GPU && p->gpu)
+            glGenQueries(PROFILER_QUERY_FRAMES, s->queries);
+    }
+}
+
+void profiler_destroy(struct profiler *p) {
+    for (int i = 0; i < p->num_series; i++)
+        if (p->series[i].desc.kind == PROFILER_GPU && p->gpu)
+            glDeleteQueries(PROFILER_QUERY_FRAMES, p->series[i].queries);
+}
+
+void profiler_begin(struct profiler *p, int id) {
+    struct profiler_series *s = &p->series[id];
+    if (s->desc.kind == PROFILER_GPU) {
+        if (p->gpu) {
+            int q = p->frames % PROFILER_QUERY_FRAMES;
+            glBeginQuery(GL_TIME_ELAPSED, s->queries[q]);
+        }
+    } else {
+        s->start_ns = profiler_now_ns();
+        s->ran = true;
+    }
+}
+
+void profiler_end(struct profiler *p, int id) {
+    struct profiler_series *s = &p->series[id];
+    if (s->desc.kind == PROFILER_GPU) {
+        if (p->gpu) {
+            glEndQuery(GL_TIME_ELAPSED);
+            s->issued[p->frames % PROFILER_QUERY_FRAMES] = true;
+        }
+    } else {
+        s->value += (profiler_now_ns() - s->start_ns) * 1e-6;
+    }
+}
+
+void profiler_set(struct profiler *p, int id, double value) { p->series[id].value = value; }
+
+static void profiler_push(struct profiler_series *s, float v) {
+    s->history[s->next] = v;
+    s->next = (s->next + 1) % PROFILER_HISTORY;
+    if (s->count < PROFILER_HISTORY)
+        s->count++;
+}
+
+// Close the frame: counters and the CPU scopes that ran record this frame's values, GPU scopes
+// whatever finished queries the oldest set holds.
+void profiler_frame(struct profiler *p) {
+    for (int i = 0; i < p->num_series; i++) {
+        struct profiler_series *s = &p->series[i];
+        if (s->desc.kind != PROFILER_GPU) {
+            if (s->desc.kind == PROFILER_COUNTER || s->ran)
+                profiler_push(s, s->value);
+            s->value = 0;
+            s->ran = false;
+            continue;
+        }
+        // the set the next frame reuses
+        int q = (p->frames + 1) % PROFILER_QUERY_FRAMES;
+        if (!p->gpu || !s->issued[q])
+            continue;
+        GLint ready = 0;
+        glGetQueryObjectiv(s->queries[q], GL_QUERY_RESULT_AVAILABLE, &ready);
+        if (!ready)
+            continue; // overwritten next frame, the sample is lost rather than waited for
+        GLuint64 ns;
+        glGetQueryObjectui64v(s->queries[q], GL_QUERY_RESULT, &ns);
+        s->issued[q] = false;
+        profiler_push(s, ns * 1e-6);
+    }
+    p->frames++;
+}
+
+static int profiler_cmp(const void *a, const void *b) {
+    float x = *(const float *)a, y = *(const float *)b;
+    return (x > y) - (x < y);
+}
+
+void profiler_stats(const struct profiler *p, int id, struct profiler_stats *st) {
+    const struct profiler_series *s = &p->series[id];
+    *st = (struct profiler_stats){.samples = s->count};
+    if (!s->count)
+        return;
+    float sorted[PROFILER_HISTORY];
+    memcpy(sorted, s->history, sizeof(float) * s->count);
+    qsort(sorted, s->count, sizeof(float), profiler_cmp);
+    double sum = 0;
+    for (int i = 0; i < s->count; i++)
+        sum += sorted[i];
+    st->mean = sum / s->count;
+    st->p50 = sorted[(s->count - 1) * 50 / 100];
+    st->p95 = sorted[(s->count - 1) * 95 / 100];
+    st->p99 = sorted[(s->count - 1) * 99 / 100];
+    st->max = sorted[s->count - 1];
+}
+
+// Values of series id, oldest first, for plotting; returns how many.
+int profiler_history(const struct profiler *p, int id, float *out) {
+    const struct profiler_series *s = &p->series[id];
+    int first = s->count < PROFILER_HISTORY ? 0 : s->next;
+    for (int i = 0; i < s->count; i++)
+        out[i] = s->history[(first + i) % PROFILER_HISTORY];
+    return s->count;
+}
+
+// Write the statistics of every series to path, as JSON if it ends in .json
+// and CSV otherwise.
+bool profiler_dump(const struct profiler *p, const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "profiler: cannot write %s\n", path);
+        return false;
+    }
+    static const char *kinds[] = {"cpu", "gpu", "counter"};
+    size_t len = strlen(path);
+    bool json = len >= 5 && strcmp(path + len - 5, ".json") == 0;
+    if (json)
+        fprintf(f, "{\n  \"frames\": %lu,\n  \"series\": [\n", (unsigned long)p->frames);
+    else
+        fprintf(f, "name,kind,unit,samples,mean,p50,p95,p99,max\n");
+    for (int i = 0; i < p->num_series; i++) {
+        const struct profiler_desc *d = &p->series[i].desc;
+        const char *unit = d->kind == PROFILER_COUNTER ? "" : "ms";
+        struct profiler_stats st;
+        profiler_stats(p, i, &st);
+        if (json)
+            fprintf(f,
+                    "    {\"name\": \"%s\", \"kind\": \"%s\", \"unit\": \"%s\", \"samples\": %d, "
+                    "\"mean\": %g, \"p50\": %g, \"p95\": %g, \"p99\": %g, \"max\": %g}%s\n",
+                    d->name, kinds[d->kind], unit, st.samples, st.mean, st.p50, st.p95, st.p99,
+                    st.max, i + 1 < p->num_series ? "," : "");
+        else
+            fprintf(f, "%s,%s,%s,%d,%g,%g,%g,%g,%g\n", d->name, kinds[d->kind], unit, st.samples,
+                    st.mean, st.p50, st.p95, st.p99, st.max);
+    }
+    if (json)
+        fprintf(f, "  ]\n}\n");
+    bool ok = !ferror(f);
+    ok &= fclose(f) == 0;
+    if (!ok)
+        fprintf(stderr, "profiler: error writing %s\n", path);
+    return ok;
+}
+
+#endif
@@ -0,0 +1,364 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <GL/glew.h>
+#include <SDL3/SDL.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// Linked shader programs, kept on disk as driver binaries so later launches
+// skip compiling and linking. llvmpipe in particular spends a good part of a
+// cold start in its shader compiler.
+//
+// Each program is keyed by an FNV-1a hash over its vertex and fragment
+// sources and the GL vendor, renderer and version strings, so editing a
+// shader or changing driver misses the cache. Entries are one file each:
+//
+//   <dir>/<key as 16 hex digits>.bin
+//      0 char[4]  "SVPB"
+//      4 u32      binary format from glGetProgramBinary
+//      8 u64      key
+//     16          binary
+//
+// A driver may still reject a binary it wrote, say after an update that kept
+// the version string. The program is then compiled from source and the entry
+// rewritten. Without ARB_get_program_binary every load compiles.
+//
+// The watcher reloads programs whose source files change while running. A
+// thread polls their modification times and relinks on a second GL context
+// that shares objects with the main one, so the main thread only picks up
+// the new program name. That context is current on a hidden window of its
+// own, since EGL will not bind one surface on two threads. A program that
+// fails to build is reported and the old one kept.
+
+#define PROGRAM_CACHE_DIR ".shader-cache"
+#define PROGRAM_CACHE_HEADER 16
+#define PROGRAM_WATCH_MAX 8
+#define PROGRAM_WATCH_POLL_NS 250000000
+
+struct program_cache {
+    char dir[256];
+    uint64_t gl_key; // hash of vendor, renderer and version
+    bool binaries;   // driver can hand out and take back program binaries
+    atomic_uint hits, misses;
+    atomic_uint_fast64_t load_ns; // spent in program_cache_load
+};
+
+static uint64_t program_cache_hash(uint64_t h, const void *data, size_t len) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ p[i]) * 0x100000001b3ull;
+    return h;
+}
+
+static char *program_cache_read(const char *path, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return NULL;
+    fseek(f, 0, SEEK_END);
+    long sz = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buf = sz >= 0 ? malloc(sz + 1) : NULL;
+    if (buf && fread(buf, 1, sz, f) != (size_t)sz) {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(f);
+    if (buf) {
+        buf[sz] = 0;
+        *len = sz;
+    }
+    return buf;
+}
+
+// Needs the GL context current. Creates dir if it does not exist.
+void program_cache_init(struct program_cache *pc, const char *dir) {
+    *pc = (struct program_cache){0};
+    snprintf(pc->dir, sizeof(pc->dir), "%s", dir);
+
+    uint64_t h = 0xcbf29ce484222325ull;
+    GLenum names[] = {GL_VENDOR, GL_RENDERER, GL_VERSION};
+    for (int i = 0; i < 3; i++) {
+        const char *s = (const char *)glGetString(names[i]);
+        h = program_cache_hash(h, s ? s : "", s ? strlen(s) + 1 : 1);
+    }
+    pc->gl_key = h;
+
+    GLint formats = 0;
+    if (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary)
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    pc->binaries = formats > 0;
+    if (pc->binaries && mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "program cache: cannot create %s: %s\n", dir, strerror(errno));
+        pc->binaries = false;
+    }
+}
+
+static GLuint program_cache_compile(const char *path, const char *src, GLenum type) {
+    GLuint sh = glCreateShader(type);
+    glShaderSource(sh, 1, &src, NULL);
+    glCompileShader(sh);
+
+    GLint ok;
+    glGetShaderiv(sh, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        char log[2048];
+        glGetShaderInfoLog(sh, sizeof(log), NULL, log);
+        fprintf(stderr, "Shader compile error in %s:\n%s\n", path, log);
+        glDeleteShader(sh);
+        return 0;
+    }
+    return sh;
+}
+
+static bool program_cache_linked(GLuint p) {
+    GLint ok;
+    glGetProgramiv(p, GL_LINK_STATUS, &ok);
+    return ok;
+}
+
+static void program_cache_entry(const struct program_cache *pc, uint64_t key, char *path,
+                                size_t size) {
+    snprintf(path, size, "%s/%016llx.bin", pc->dir, (unsigned long long)key);
+}
+
+// Program p from the entry for key, false if there is none or the driver
+// refuses it.
+static bool program_cache_fetch(const struct program_cache *pc, uint64_t key, GLuint p) {
+    char path[300];
+    program_cache_entry(pc, key, path, sizeof(path));
+    size_t len;
+    char *buf = program_cache_read(path, &len);
+    if (!buf)
+        return false;
+    uint32_t format;
+    uint64_t stored;
+    bool ok = len > PROGRAM_CACHE_HEADER && memcmp(buf, "SVPB", 4) == 0;
+    if (ok) {
+        memcpy(&format, buf + 4, 4);
+        memcpy(&stored, buf + 8, 8);
+        ok = stored == key;
+    }
+    if (ok) {
+        glProgramBinary(p, format, buf + PROGRAM_CACHE_HEADER, len - PROGRAM_CACHE_HEADER);
+        ok = program_cache_linked(p);
+    }
+    free(buf);
+    return ok;
+}
+
+// Written under a temporary name and renamed, so another instance starting
+// at the same time never reads half an entry.
+static void program_cache_store(const struct program_cache *pc, uint64_t key, GLuint p) {
+    GLint len = 0;
+    glGetProgramiv(p, GL_PROGRAM_BINARY_LENGTH, &len);
+    if (len <= 0)
+        return;
+    char *buf = malloc(PROGRAM_CACHE_HEADER + len);
+    GLenum format;
+    glGetProgramBinary(p, len, &len, &format, buf + PROGRAM_CACHE_HEADER);
+    uint32_t f32 = format;
+    memcpy(buf, "SVPB", 4);
+    memcpy(buf + 4, &f32, 4);
+    memcpy(buf + 8, &key, 8);
+
+    char path[300], tmp[310];
+    program_cache_entry(pc, key, path, sizeof(path));
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "wb");
+    bool ok = f && fwrite(buf, 1, PROGRAM_CACHE_HEADER + len, f) == PROGRAM_CACHE_HEADER + len;
+    if (f && fclose(f) != 0)
+        ok = false;
+    if (!ok || rename(tmp, path) != 0) {
+        fprintf(stderr, "program cache: cannot write %s\n", path);
+        remove(tmp);
+    }
+    free(buf);
+}
+
+static GLuint program_cache_build(struct program_cache *pc, const char *vs, const char *fs) {
+    size_t vs_len, fs_len;
+    char *vs_src = program_cache_read(vs, &vs_len);
+    char *fs_src = program_cache_read(fs, &fs_len);
+    if (!vs_src || !fs_src) {
+        fprintf(stderr, "Missing shader %s\n", vs_src ? fs : vs);
+        free(vs_src);
+        free(fs_src);
+        return 0;
+    }
+    // the terminators keep the boundary between the two sources in the key
+    uint64_t key = program_cache_hash(pc->gl_key, vs_src, vs_len + 1);
+    key = program_cache_hash(key, fs_src, fs_len + 1);
+
+    GLuint p = glCreateProgram();
+    if (pc->binaries && program_cache_fetch(pc, key, p)) {
+        atomic_fetch_add(&pc->hits, 1);
+        free(vs_src);
+        free(fs_src);
+        return p;
+    }
+    atomic_fetch_add(&pc->misses, 1);
+
+    GLuint v = program_cache_compile(vs, vs_src, GL_VERTEX_SHADER);
+    GLuint f = program_cache_compile(fs, fs_src, GL_FRAGMENT_SHADER);
+    free(vs_src);
+    free(fs_src);
+    if (!v || !f) {
+        glDeleteShader(v);
+        glDeleteShader(f);
+        glDeleteProgram(p);
+        return 0;
+    }
+    if (pc->binaries)
+        glProgramParameteri(p, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glAttachShader(p, v);
+    glAttachShader(p, f);
+    glLinkProgram(p);
+    glDeleteShader(v);
+    glDeleteShader(f);
+    if (!program_cache_linked(p)) {
+        char log[2048];
+        glGetProgramInfoLog(p, sizeof(log), NULL, log);
+        fprintf(stderr, "Link error in %s + %s:\n%s\n", vs, fs, log);
+        glDeleteProgram(p);
+        return 0;
+    }
+    if (pc->binaries)
+        program_cache_store(pc, key, p);
+    return p;
+}
+
+// Program from vertex and fragment shader files, out of the cache when it
+// can be. Returns 0 after printing the error if a source is missing or does
+// not compile or link.
+GLuint program_cache_load(struct program_cache *pc, const char *vs, const char *fs) {
+    Uint64 start = SDL_GetTicksNS();
+    GLuint p = program_cache_build(pc, vs, fs);
+    atomic_fetch_add(&pc->load_ns, SDL_GetTicksNS() - start);
+    return p;
+}
+
+struct program_watch_entry {
+    const char *vs, *fs;
+    struct timespec vs_mtime, fs_mtime;
+    _Atomic GLuint ready; // relinked, not yet taken by the main thread
+};
+
+struct program_watch {
+    struct program_cache *cache;
+    SDL_Window *window; // hidden, for ctx to be current on
+    SDL_GLContext ctx;  // shares objects with the main context
+    pthread_t thread;
+    atomic_bool quit;
+    bool running;
+
+    struct program_watch_entry entries[PROGRAM_WATCH_MAX];
+    int count;
+};
+
+static bool program_watch_mtime(const char *path, struct timespec *t) {
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return false;
+    bool changed = st.st_mtim.tv_sec != t->tv_sec || st.st_mtim.tv_nsec != t->tv_nsec;
+    *t = st.st_mtim;
+    return changed;
+}
+
+// Watch the program built from vs and fs. Returns the id to poll with, or -1
+// when the table is full. Call before program_watch_start.
+int program_watch_add(struct program_watch *w, const char *vs, const char *fs) {
+    if (w->count == PROGRAM_WATCH_MAX)
+        return -1;
+    struct program_watch_entry *e = &w->entries[w->count];
+    *e = (struct program_watch_entry){.vs = vs, .fs = fs};
+    program_watch_mtime(vs, &e->vs_mtime);
+    program_watch_mtime(fs, &e->fs_mtime);
+    return w->count++;
+}
+
+static void *program_watch_thread(void *arg) {
+    struct program_watch *w = arg;
+    if (!SDL_GL_MakeCurrent(w->window, w->ctx)) {
+        fprintf(stderr, "program watch: not watching, no current context: %s\n", SDL_GetError());
+        return NULL;
+    }
+    while (!atomic_load(&w->quit)) {
+        SDL_DelayNS(PROGRAM_WATCH_POLL_NS);
+        for (int i = 0; i < w->count; i++) {
+            struct program_watch_entry *e = &w->entries[i];
+            // both calls always run so a save of both files relinks once
+            bool changed = program_watch_mtime(e->vs, &e->vs_mtime);
+            changed |= program_watch_mtime(e->fs, &e->fs_mtime);
+            if (!changed)
+                continue;
+            GLuint p = program_cache_load(w->cache, e->vs, e->fs);
+            if (!p)
+                continue;
+            // the main context may only use what this one has finished
+            glFinish();
+            printf("Reloaded %s + %s\n", e->vs, e->fs);
+            GLuint stale = atomic_exchange(&e->ready, p);
+            if (stale)
+                glDeleteProgram(stale);
+        }
+    }
+    SDL_GL_MakeCurrent(w->window, NULL);
+    return NULL;
+}
+
+// Start polling. main_ctx must be current on the calling thread and stays so.
+bool program_watch_start(struct program_watch *w, struct program_cache *pc, SDL_Window *window,
+                         SDL_GLContext main_ctx) {
+    w->cache = pc;
+    w->window = SDL_CreateWindow("program watch", 1, 1, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+    if (!w->window) {
+        fprintf(stderr, "program watch: no window: %s\n", SDL_GetError());
+        return false;
+    }
+    SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+    w->ctx = SDL_GL_CreateContext(w->window);
+    SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 0);
+    SDL_GL_MakeCurrent(window, main_ctx); // creating made the new one current
+    if (!w->ctx) {
+        fprintf(stderr, "program watch: no shared context: %s\n", SDL_GetError());
+        SDL_DestroyWindow(w->window);
+        return false;
+    }
+    atomic_store(&w->quit, false);
+    pthread_create(&w->thread, NULL, program_watch_thread, w);
+    w->running = true;
+    return true;
+}
+
+// The program relinked for id since the last call, or 0. The caller owns it
+// and deletes the one it replaces.
+GLuint program_watch_poll(struct program_watch *w, int id) {
+    if (!w->running || id < 0)
+        return 0;
+    return atomic_exchange(&w->entries[id].ready, 0);
+}
+
+void program_watch_stop(struct program_watch *w) {
+    if (!w->running)
+        return;
+    atomic_store(&w->quit, true);
+    pthread_join(w->thread, NULL);
+    SDL_GL_DestroyContext(w->ctx);
+    SDL_DestroyWindow(w->window);
+    for (int i = 0; i < w->count; i++) {
+        GLuint p = atomic_exchange(&w->entries[i].ready, 0);
+        if (p)
+            glDeleteProgram(p);
+    }
+    w->running = false;
+}
+
+#endif
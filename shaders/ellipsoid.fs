@@ -1,5 +1,12 @@
 #version 330
 
+in float depth_w; // see ellipsoid.vs
+
 out vec4 FragColor;
 
-void main() { FragColor = vec4(1, 0, 0, 1); }
+uniform float log_depth; // 2 / log2(far + 1)
+
+void main() {
+    FragColor = vec4(1, 0, 0, 1);
+    gl_FragDepth = log2(depth_w) * log_depth * 0.5;
+}
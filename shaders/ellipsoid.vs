@@ -3,5 +3,13 @@
 in vec3 position;
 
 uniform mat4 mvp;
+uniform float log_depth; // 2 / log2(far + 1)
 
-void main() { gl_Position = mvp * vec4(position, 1.0); }
+out float depth_w; // 1 + clip w, log2 of it is the depth
+
+void main() {
+    gl_Position = mvp * vec4(position, 1.0);
+    // only for clipping, the depth itself is written per fragment
+    gl_Position.z = (log2(max(1e-6, 1.0 + gl_Position.w)) * log_depth - 1.0) * gl_Position.w;
+    depth_w = 1.0 + gl_Position.w;
+}
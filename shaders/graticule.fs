@@ -0,0 +1,59 @@
+#version 330
+
+// The reference ellipsoid and its graticule, ray traced per pixel instead of
+// drawn as a wireframe mesh, see render_graticule().
+
+in vec2 ndc;
+
+out vec4 fragColor;
+
+uniform vec3 eye;       // km ECEF
+uniform float eye_c;    // |eye / (A, A, B)|^2 - 1, exact from the CPU
+uniform vec3 forward;   // view direction
+uniform vec3 ray_x;     // right * tan(fov_x / 2)
+uniform vec3 ray_y;     // up * tan(fov_y / 2)
+uniform float A;
+uniform float B;
+uniform float E2;
+uniform float log_depth; // 2 / log2(far + 1)
+uniform float spacing;   // arc-minutes between lines
+
+const float PI = 3.14159265358979;
+
+// Coverage of a one pixel line at every whole x, fading out before the cells
+// get small enough to alias. dx is how much x changes across a pixel.
+float grid_line(float x, float dx) {
+    float d = abs(fract(x + 0.5) - 0.5) / max(dx, 1e-6); // no 0 / 0 where x holds still
+    return clamp(1.0 - d, 0.0, 1.0) * clamp(4.0 - 12.0 * dx, 0.0, 1.0);
+}
+
+void main() {
+    vec3 d = forward + ndc.x * ray_x + ndc.y * ray_y;
+
+    // |o + t d| = 1 on the ellipsoid squashed to the unit sphere. eye_c is
+    // tiny near the ground, and c / (-b + sqrt(disc)) is the near root
+    // without the cancellation of -b - sqrt(disc).
+    vec3 scale = vec3(1.0 / A, 1.0 / A, 1.0 / B);
+    vec3 o = eye * scale, v = d * scale;
+    float a = dot(v, v), b = dot(o, v);
+    float disc = b * b - a * eye_c;
+    // below the surface, looking away or missing it; discarded only after
+    // the derivatives below, which need the whole quad
+    bool miss = eye_c < 0.0 || b >= 0.0 || disc < 0.0;
+    float t = eye_c / (-b + sqrt(max(disc, 0.0)));
+    vec3 p = eye + t * d;
+
+    float lat = atan(p.z, (1.0 - E2) * length(p.xy));
+    float lon = atan(p.y, p.x);
+    vec2 cells = degrees(vec2(lat, lon)) * 60.0 / spacing;
+    // longitude jumps at the antimeridian, its shifted copy does not
+    float shifted = degrees(lon < 0.0 ? lon + 2.0 * PI : lon) * 60.0 / spacing;
+    float dlon = min(fwidth(cells.y), fwidth(shifted));
+    float line = max(grid_line(cells.x, fwidth(cells.x)), grid_line(cells.y, dlon));
+    if (miss || line <= 0.0)
+        discard;
+
+    // t is in units of d, whose component along the view direction is 1
+    gl_FragDepth = log2(max(1e-6, 1.0 + t)) * log_depth * 0.5;
+    fragColor = vec4(1, 0, 0, line);
+}
@@ -0,0 +1,13 @@
+#version 330
+
+in vec4 stroke; // offset across and along the stroke, half width and half length
+in vec4 tint;
+
+out vec4 fragColor;
+
+void main() {
+    // a pixel wide ramp at each edge, so strokes thinner than a pixel fade
+    // instead of breaking up
+    vec2 cover = clamp(stroke.zw + 0.5 - abs(stroke.xy), 0.0, 1.0);
+    fragColor = vec4(tint.rgb, tint.a * cover.x * cover.y);
+}
@@ -0,0 +1,16 @@
+#version 330
+
+layout(location = 0) in vec2 position; // pixels, y down
+layout(location = 1) in vec4 edge;     // offset from the middle of the stroke, its half extents
+layout(location = 2) in vec4 color;
+
+uniform vec2 screen; // viewport size in pixels
+
+out vec4 stroke;
+out vec4 tint;
+
+void main() {
+    stroke = edge;
+    tint = color;
+    gl_Position = vec4(position / screen * vec2(2.0, -2.0) + vec2(-1.0, 1.0), 0.0, 1.0);
+}
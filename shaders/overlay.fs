@@ -0,0 +1,51 @@
+#version 330
+
+flat in int kind;
+flat in float top;
+flat in vec3 sun;
+flat in int roof;
+in vec3 rel;
+in vec2 surface;
+in float depth_w;
+
+out vec4 fragColor;
+
+uniform float log_depth; // 2 / log2(far + 1)
+
+// terrain awareness, as in terrain.fs
+uniform float aircraft_height; // km
+uniform int taws_level;        // -1 off
+uniform float taws_clearance;  // km
+
+const vec3 COLORS[3] = vec3[](vec3(0.85, 0.4, 0.1), vec3(0.6, 0.58, 0.55), vec3(0.2, 0.2, 0.22));
+const vec3 MARKING = vec3(0.9, 0.9, 0.88);
+const vec3 TAWS_YELLOW = vec3(1.0, 0.85, 0.0);
+const vec3 TAWS_RED = vec3(1.0, 0.05, 0.0);
+
+const int RUNWAY = 2;
+const float DASH = 0.05;       // km, centerline dash and gap
+const float CENTERLINE = 0.03; // of the width
+
+void main() {
+    vec3 color = COLORS[kind];
+    // flat faces, turned toward the eye
+    vec3 normal = normalize(cross(dFdx(rel), dFdy(rel)));
+    if (dot(normal, rel) > 0.0)
+        normal = -normal;
+
+    if (kind == RUNWAY) {
+        if (roof == 1 && abs(surface.y) < CENTERLINE && fract(surface.x / DASH * 0.5) < 0.5)
+            color = MARKING;
+    } else if (taws_level >= 0) {
+        // obstacles reaching into the clearance below the aircraft or above it
+        float rel_top = top - aircraft_height;
+        if (rel_top > 0.0)
+            color = mix(color, TAWS_RED, 0.8);
+        else if (rel_top > -taws_clearance)
+            color = mix(color, TAWS_YELLOW, 0.7);
+    }
+
+    color *= max(dot(normal, sun), 0.2);
+    fragColor = vec4(color, 1.0);
+    gl_FragDepth = log2(depth_w) * log_depth * 0.5;
+}
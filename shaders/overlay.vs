@@ -0,0 +1,67 @@
+#version 330
+
+uniform mat4 mvp;
+uniform vec3 offset;     // anchor relative to the eye, or absolute without RTE
+uniform float log_depth; // 2 / log2(far + 1)
+
+// Every instance draws one feature as a box without a bottom, built here from
+// gl_VertexID. Its parameters are four texels of the features buffer, written
+// by overlay_gather():
+//   pos:    ground under the center relative to the anchor in km, kind
+//   trig:   sin lat, cos lat, sin lon, cos lon of the center
+//   size:   length, width and height in km, heading in radians
+//   ground: height of the ground under the center and its rise from one end
+//           of the length to the other, in km
+uniform samplerBuffer features;
+
+flat out int kind;
+flat out float top; // km above the ellipsoid
+flat out vec3 sun;
+flat out int roof;
+out vec3 rel;      // from the eye, for face normals
+out vec2 surface;  // km along the length from the center, across the width
+out float depth_w; // 1 + clip w, log2 of it is the depth
+
+const float FOOTING = 0.02; // km sunk into the ground, below slopes and coarse LOD
+// top of a tower, building and runway relative to its footprint
+const float TAPER[3] = float[](0.15, 1.0, 1.0);
+
+// corners as bits: x along the length, y across, z up
+const int CORNERS[30] = int[](4, 5, 7, 4, 7, 6, // top
+                              0, 1, 5, 0, 5, 4, 1, 3, 7, 1, 7, 5,
+                              3, 2, 6, 3, 6, 7, 2, 0, 4, 2, 4, 6);
+
+void main() {
+    int base = gl_InstanceID * 4;
+    vec4 pos = texelFetch(features, base);
+    vec4 trig = texelFetch(features, base + 1);
+    vec4 size = texelFetch(features, base + 2);
+    vec4 ground = texelFetch(features, base + 3);
+    kind = int(pos.w);
+
+    int c = CORNERS[gl_VertexID];
+    roof = gl_VertexID < 6 ? 1 : 0;
+    bool up = c >= 4;
+    float scale = up ? TAPER[kind] : 1.0;
+    float x = (float(c & 1) - 0.5) * scale;
+    float y = (float((c >> 1) & 1) - 0.5) * scale;
+    // runways follow the ground between their ends, the rest stand level
+    float z = x * ground.y + (up ? size.z : -FOOTING);
+
+    float sp = trig.x, cp = trig.y, sl = trig.z, cl = trig.w;
+    vec3 east = vec3(-sl, cl, 0.0);
+    vec3 north = vec3(-sp * cl, -sp * sl, cp);
+    vec3 normal = vec3(cp * cl, cp * sl, sp);
+    vec3 along = sin(size.w) * east + cos(size.w) * north;
+    vec3 across = cos(size.w) * east - sin(size.w) * north;
+
+    top = ground.x + ground.y * 0.5 + size.z;
+    // the terrain's light, see terrain.fs
+    sun = normalize(0.5 * east + normal - 0.5 * north);
+    surface = vec2(x * size.x, y);
+    rel = offset + pos.xyz + along * (x * size.x) + across * (y * size.y) + normal * z;
+    gl_Position = mvp * vec4(rel, 1.0);
+    // only for clipping, the depth itself is written per fragment
+    gl_Position.z = (log2(max(1e-6, 1.0 + gl_Position.w)) * log_depth - 1.0) * gl_Position.w;
+    depth_w = 1.0 + gl_Position.w;
+}
@@ -3,9 +3,20 @@
 in float water;
 in float height;
 in vec3 normal;
+in vec2 geo;      // lat, lon in degrees
+in float depth_w; // see terrain.vs
 
 out vec4 fragColor;
 
+uniform float log_depth; // 2 / log2(far + 1)
+
+// terrain awareness, see taws.h
+uniform float aircraft_height; // km
+uniform int taws_level;        // -1 off, 0 clear, 1 caution, 2 warning
+uniform float taws_clearance;  // km
+
+uniform float grid_spacing; // arc-minutes between graticule lines, 0 for none
+
 const vec3 WHITE = vec3(0.8, 0.8, 0.792);
 const vec3 GRAY = vec3(0.592, 0.592, 0.592);
 const vec3 BROWN3 = vec3(0.545, 0.235, 0.016);
@@ -17,6 +28,8 @@ const vec3 GREEN = vec3(0.255, 0.416, 0.055);
 const vec3 CYAN = vec3(0.306, 0.6, 0.573);
 const vec3 BLUE = vec3(0.145, 0.329, 0.408);
 const vec3 DARKBLUE = vec3(0.008, 0.004, 0.278);
+const vec3 TAWS_YELLOW = vec3(1.0, 0.85, 0.0);
+const vec3 TAWS_RED = vec3(1.0, 0.05, 0.0);
 
 #define M2FT(m) ((m) / 0.3048f)
 
@@ -37,26 +50,39 @@ vec3 colorFromAltitude(float y) {
     return WHITE;
 }
 
+// Coverage of a one pixel line at every whole x, as in graticule.fs
+float grid_line(float x, float dx) {
+    float d = abs(fract(x + 0.5) - 0.5) / max(dx, 1e-6); // no 0 / 0 where x holds still
+    return clamp(1.0 - d, 0.0, 1.0) * clamp(4.0 - 12.0 * dx, 0.0, 1.0);
+}
+
 void main() {
     vec3 base = colorFromAltitude(height);
     vec3 color = mix(base, DARKBLUE, water);
 
+    // Terrain within the required clearance below the aircraft is yellow and
+    // terrain above it red, faint while the path is clear and solid for the
+    // band that raised the current alert.
+    if (taws_level >= 0) {
+        float rel = height * 0.001 - aircraft_height;
+        if (rel > 0.0)
+            color = mix(color, TAWS_RED, taws_level == 2 ? 0.9 : 0.4);
+        else if (rel > -taws_clearance)
+            color = mix(color, TAWS_YELLOW, taws_level >= 1 ? 0.8 : 0.3);
+    }
+
     // shading
     vec3 norm = normalize(normal);
     float diff = max(dot(norm, vec3(0.5, 1.0, 0.5)), 0.2);
     color *= diff;
 
-    // grid
-    // TODO fix spacing of grid to be accurate
-    // 1 arc-minute spacing
-    // float spacingNS = 1855.0;
-    // float spacingEW = 1855.0 * cos(radians(fragWorldPos.z / 111320.0));
-    // float lineWidth = 10.0;
-
-    // if (mod(fragWorldPos.z, spacingNS) < lineWidth || mod(fragWorldPos.x, spacingEW) < lineWidth)
-    // {
-    //     color *= 0.5;
-    // }
+    // graticule, darkening the terrain under the lines
+    if (grid_spacing > 0.0) {
+        vec2 cells = geo * 60.0 / grid_spacing;
+        vec2 dcells = fwidth(cells);
+        color *= 1.0 - 0.5 * max(grid_line(cells.x, dcells.x), grid_line(cells.y, dcells.y));
+    }
 
     fragColor = vec4(color, 1.0);
+    gl_FragDepth = log2(depth_w) * log_depth * 0.5;
 }
@@ -3,56 +3,99 @@
 const float KM_SCALAR = 0.001;
 
 uniform mat4 mvp;
+uniform float log_depth; // 2 / log2(far + 1)
 
-uniform float A;
 uniform float B;
 uniform float E2;
-uniform float lat;
-uniform float lon;
-uniform isampler2D heightmap;
+uniform isampler2DArray heightmap; // one layer per cached tile
+uniform sampler2DArray normals;    // same layers, encoded by tdb_build_normals()
+
+// Every instance draws one patch, see lod.h. Its parameters are four texels of
+// the chunks buffer, written by render_terrain():
+//   origin: north-west corner of the patch relative to the eye (or absolute
+//           ECEF without RTE) and its prime vertical radius of curvature.
+//           Positions are built as offsets from it so no single precision
+//           value ever holds a full Earth-radius coordinate
+//   trig:   sin lat, cos lat, sin lon, cos lon of the corner
+//   patch:  u0, v0 and size of the patch within the tile, skirt depth in km
+//   tile:   heightmap layer, level to sample, tile resolution
+uniform samplerBuffer chunks;
+uniform int grid_res; // quads along each side of the patch
+uniform bool skirts;  // outermost ring of vertices hangs below the patch edge
 
 out float water;
 out float height;
 out vec3 normal;
+out vec2 geo;      // lat, lon in degrees, for the grid
+out float depth_w; // 1 + clip w, log2 of it is the depth
+
+// ECEF of (origin lat + dphi, origin lon + dlam, h) minus ECEF of (origin, 0),
+// written in terms of differences that stay accurate for small angles
+vec3 ecef_offset(vec4 origin_trig, float origin_n, float dphi, float dlam, float h) {
+    float sp0 = origin_trig.x, cp0 = origin_trig.y;
+    float sl0 = origin_trig.z, cl0 = origin_trig.w;
 
-// lon degrees
-// lat degrees
-// h km
-vec3 geodetic_to_ecef(float lat, float lon, float h) {
-    float theta = radians(lon); // lon
-    float phi = radians(lat);   // lat
-    float sinphi = sin(phi);
-    float N = A / sqrt(1.0 - E2 * sinphi * sinphi);
+    float s = sin(dphi * 0.5);
+    float dsp = sp0 * (-2.0 * s * s) + cp0 * sin(dphi); // sin(phi) - sin(phi0)
+    float dcp = cp0 * (-2.0 * s * s) - sp0 * sin(dphi); // cos(phi) - cos(phi0)
+    s = sin(dlam * 0.5);
+    float dsl = sl0 * (-2.0 * s * s) + cl0 * sin(dlam);
+    float dcl = cl0 * (-2.0 * s * s) - sl0 * sin(dlam);
+    float sp = sp0 + dsp, cp = cp0 + dcp;
+    float sl = sl0 + dsl, cl = cl0 + dcl;
 
-    vec3 earth_pos = vec3((N + h) * cos(phi) * cos(theta), (N + h) * cos(phi) * sin(theta),
-                          (N * (1.0 - E2) + h) * sin(phi));
+    // N - N0 without subtracting two Earth radii
+    float q = 1.0 - E2 * sp * sp;
+    float ratio = sqrt((1.0 - E2 * sp0 * sp0) / q);
+    float dn = origin_n * E2 * dsp * (sp + sp0) / q / (ratio + 1.0);
 
-    return earth_pos;
+    return vec3((dn + h) * cp * cl + origin_n * (dcp * cl + cp0 * dcl),
+                (dn + h) * cp * sl + origin_n * (dcp * sl + cp0 * dsl),
+                ((1.0 - E2) * dn + h) * sp + (1.0 - E2) * origin_n * dsp);
+}
+
+int fetch(ivec2 p, ivec2 size, int layer, int lod) {
+    return texelFetch(heightmap, ivec3(clamp(p, ivec2(0), size - 1), layer), lod).r;
+}
+
+// hemi-octahedral to a unit vector east, up, south, as tdb_normal_decode()
+vec3 decode_normal(vec2 e) {
+    e = e * 2.0 - 1.0;
+    vec2 p = vec2(e.x + e.y, e.x - e.y) * 0.5;
+    return normalize(vec3(p.x, 1.0 - abs(p.x) - abs(p.y), p.y));
 }
 
 void main() {
-    ivec2 size = textureSize(heightmap, 0);
-    int position_i = gl_VertexID / size.x;
-    int position_j = gl_VertexID % size.x;
-    ivec2 pixel = ivec2(position_j, position_i);
-    int texel = texelFetch(heightmap, pixel, 0).r;
+    int base = gl_InstanceID * 4;
+    vec4 origin = texelFetch(chunks, base);
+    vec4 trig = texelFetch(chunks, base + 1);
+    vec4 chunk = texelFetch(chunks, base + 2);
+    ivec4 tile = ivec4(texelFetch(chunks, base + 3));
+    int layer = tile.x, lod = tile.y;
+    // smaller tiles only fill the corner of their layer
+    ivec2 size = max(tile.zw >> lod, ivec2(1));
+
+    int border = skirts ? 1 : 0;
+    int width = grid_res + 1 + 2 * border;
+    ivec2 grid = ivec2(gl_VertexID % width, gl_VertexID / width) - border;
+    bool skirt = any(lessThan(grid, ivec2(0))) || any(greaterThan(grid, ivec2(grid_res)));
+    grid = clamp(grid, 0, grid_res);
+
+    vec2 uv = chunk.xy + vec2(grid) / float(grid_res) * chunk.z;
+    ivec2 pixel = ivec2(round(uv * vec2(size - 1)));
+    int texel = fetch(pixel, size, layer, lod);
     water = float(texel & 1);
     height = float(texel >> 1);
 
-    float plat = lat - float(position_i) / float(size.x - 1);
-    float plon = lon + float(position_j) / float(size.y - 1);
-    vec3 earth_pos = geodetic_to_ecef(plat, plon, height * KM_SCALAR);
-    gl_Position = mvp * vec4(earth_pos, 1.0);
-
-    // normal
-    const ivec3 off = ivec3(-1, 0, 1);
-    int left = texelFetchOffset(heightmap, pixel, 0, off.xy).r >> 1;
-    int right = texelFetchOffset(heightmap, pixel, 0, off.zy).r >> 1;
-    int down = texelFetchOffset(heightmap, pixel, 0, off.yx).r >> 1;
-    int up = texelFetchOffset(heightmap, pixel, 0, off.yz).r >> 1;
-    float dx_spacing = cos(radians(plat)) * radians(1.0 / size.x) * A * 1000;
-    float dz_spacing = radians(1.0 / size.y) * A * 1000;
-    float dx = (float(left) - float(right)) / dx_spacing;
-    float dz = (float(down) - float(up)) / dz_spacing;
-    normal = normalize(vec3(dx, 2.0, dz));
+    float h = height * KM_SCALAR - (skirt ? chunk.w : 0.0);
+    vec2 d = radians(vec2(grid) / float(grid_res) * chunk.z);
+    vec3 pos = origin.xyz + ecef_offset(trig, origin.w, -d.y, d.x, h);
+    geo = degrees(vec2(atan(trig.x, trig.y) - d.y, atan(trig.z, trig.w) + d.x));
+    gl_Position = mvp * vec4(pos, 1.0);
+    // only for clipping, the depth itself is written per fragment
+    gl_Position.z = (log2(max(1e-6, 1.0 + gl_Position.w)) * log_depth - 1.0) * gl_Position.w;
+    depth_w = 1.0 + gl_Position.w;
+
+    ivec3 at = ivec3(clamp(pixel, ivec2(0), size - 1), layer);
+    normal = decode_normal(texelFetch(normals, at, lod).rg);
 }
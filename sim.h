@@ -0,0 +1,224 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <SDL3/SDL_timer.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "aircraft_state.h"
+
+// Flight model on its own fixed-rate thread.
+//
+// The main thread hands control inputs over with sim_set_input() and reads
+// state back with sim_read(). The simulation steps at SIM_RATE from
+// nanosecond timestamps whatever the frame rate, so a slow frame delays the
+// picture, not the aircraft. Each step publishes the previous and the new
+// state through a lock-free triple buffer; the renderer draws one step in the
+// past and interpolates between the two, which hides the beat between the
+// step rate and the display rate.
+
+#define SIM_RATE 200             // steps per second
+#define SIM_MAX_LAG_NS 250000000 // behind by more than this, skip ahead instead of catching up
+
+#define FREE_CAM_MOUSE_SENS 0.0017 // rad per pixel
+#define FREE_CAM_SPEED 1           // km/s
+#define FREE_CAM_FAST_MULTIPLIER 100
+#define AIRCRAFT_TURN_RATE 30 // deg/s at full stick
+
+struct sim_input {
+    bool active; // inputs apply, false while the UI has the mouse
+    bool freecam;
+    float move[3]; // free camera right, up, forward in -1..1
+    bool fast;
+    float look[2];  // free camera mouse pixels since the last step, x and y
+    float stick[4]; // pitch, yaw, roll in -1..1 and throttle in 0..1
+    bool level;     // roll the up vector back to the local vertical once
+};
+
+struct sim_state {
+    struct aircraft_state ac;
+    double vel[3];  // km/s, smoothed over a few steps
+    Uint64 time_ns; // scheduled time of the step
+    uint64_t step;
+};
+
+struct sim_frame {
+    struct sim_state prev, cur;
+};
+
+#define SIM_FRESH 4u // set in sim.middle when it holds a frame the reader has not seen
+
+struct sim {
+    pthread_t thread;
+    atomic_bool quit;
+    Uint64 step_ns;
+
+    pthread_mutex_t input_lock;
+    struct sim_input input;
+    bool teleport_pending;
+    struct aircraft_state teleport;
+
+    // triple buffer: the writer owns back, the reader front, and middle
+    // changes hands by atomic exchange
+    struct sim_frame slots[3];
+    atomic_uint middle;
+    unsigned back, front;
+
+    atomic_uint_fast64_t skipped_ns; // simulated time dropped after stalls
+};
+
+static void sim_step(struct aircraft_state *ac, const struct sim_input *in, float dt) {
+    if (in->level) {
+        ac->up = glms_vec3_normalize(dvec3_to_vec3(ac->pos));
+        ac->right = glms_vec3_normalize(glms_cross(ac->forward, ac->up));
+    }
+    if (!in->active)
+        return;
+
+    if (in->freecam) {
+        float pitch_angle = -in->look[1] * FREE_CAM_MOUSE_SENS;
+        ac->forward = glms_vec3_rotate(ac->forward, pitch_angle, ac->right);
+        ac->right = glms_vec3_normalize(glms_vec3_cross(ac->forward, ac->up));
+        float yaw_angle = -in->look[0] * FREE_CAM_MOUSE_SENS;
+        ac->forward = glms_vec3_rotate(ac->forward, yaw_angle, ac->up);
+
+        vec3s world_move = glms_vec3_add(
+            glms_vec3_scale(ac->forward, in->move[2]),
+            glms_vec3_add(glms_vec3_scale(ac->right, in->move[0]),
+                          glms_vec3_scale(ac->up, in->move[1])));
+        float speed = FREE_CAM_SPEED;
+        if (in->fast)
+            speed *= FREE_CAM_FAST_MULTIPLIER;
+        ac->pos = dvec3_add_scaled(ac->pos, world_move, speed * dt);
+    } else {
+        aircraft_update(ac, dt);
+
+        float rate = glm_rad(AIRCRAFT_TURN_RATE) * dt;
+        aircraft_pitch(ac, rate * in->stick[0]);
+        aircraft_yaw(ac, rate * in->stick[1]);
+        aircraft_roll(ac, rate * in->stick[2]);
+        ac->throttle = in->stick[3];
+    }
+}
+
+static void *sim_worker(void *arg) {
+    struct sim *s = arg;
+    struct sim_state state = s->slots[s->back].cur;
+    float dt = s->step_ns * 1e-9;
+    Uint64 next = SDL_GetTicksNS();
+
+    while (!atomic_load(&s->quit)) {
+        Uint64 now = SDL_GetTicksNS();
+        if (now < next) {
+            SDL_DelayPrecise(next - now);
+            continue;
+        }
+        if (now - next > SIM_MAX_LAG_NS) {
+            atomic_fetch_add(&s->skipped_ns, now - next);
+            next = now;
+        }
+
+        pthread_mutex_lock(&s->input_lock);
+        struct sim_input in = s->input;
+        s->input.look[0] = s->input.look[1] = 0;
+        s->input.level = false;
+        if (s->teleport_pending) {
+            state.ac = s->teleport;
+            memset(state.vel, 0, sizeof(state.vel));
+            s->teleport_pending = false;
+        }
+        pthread_mutex_unlock(&s->input_lock);
+
+        struct sim_frame *f = &s->slots[s->back];
+        f->prev = state;
+        sim_step(&state.ac, &in, dt);
+        // both flight modes move pos directly, so velocity comes from the change
+        float k = dt / (dt + 0.1f);
+        for (int i = 0; i < 3; i++) {
+            double v = (state.ac.pos.raw[i] - f->prev.ac.pos.raw[i]) / dt;
+            state.vel[i] += (v - state.vel[i]) * k;
+        }
+        state.time_ns = next;
+        state.step++;
+        f->cur = state;
+
+        s->back = atomic_exchange(&s->middle, s->back | SIM_FRESH) & 3;
+        next += s->step_ns;
+    }
+    return NULL;
+}
+
+void sim_start(struct sim *s, const struct aircraft_state *ac) {
+    *s = (struct sim){.step_ns = 1000000000 / SIM_RATE, .back = 0, .front = 1};
+    atomic_init(&s->middle, 2);
+    Uint64 now = SDL_GetTicksNS();
+    for (int i = 0; i < 3; i++) {
+        s->slots[i].cur = (struct sim_state){.ac = *ac, .time_ns = now};
+        s->slots[i].prev = s->slots[i].cur;
+    }
+    pthread_mutex_init(&s->input_lock, NULL);
+    pthread_create(&s->thread, NULL, sim_worker, s);
+}
+
+void sim_stop(struct sim *s) {
+    if (!s->step_ns) // never started
+        return;
+    atomic_store(&s->quit, true);
+    pthread_join(s->thread, NULL);
+    pthread_mutex_destroy(&s->input_lock);
+}
+
+// Replace the inputs the next step sees. Mouse movement and level requests
+// accumulate until a step consumes them.
+void sim_set_input(struct sim *s, const struct sim_input *in) {
+    pthread_mutex_lock(&s->input_lock);
+    float look[2] = {s->input.look[0] + in->look[0], s->input.look[1] + in->look[1]};
+    bool level = s->input.level || in->level;
+    s->input = *in;
+    s->input.look[0] = look[0];
+    s->input.look[1] = look[1];
+    s->input.level = level;
+    pthread_mutex_unlock(&s->input_lock);
+}
+
+// Continue the simulation from ac, e.g. where an external source left off.
+void sim_teleport(struct sim *s, const struct aircraft_state *ac) {
+    pthread_mutex_lock(&s->input_lock);
+    s->teleport = *ac;
+    s->teleport_pending = true;
+    pthread_mutex_unlock(&s->input_lock);
+}
+
+static vec3s sim_nlerp(vec3s a, vec3s b, float t) {
+    return glms_vec3_normalize(glms_vec3_lerp(a, b, t));
+}
+
+// State at now_ns minus one step, interpolated between the last two steps.
+// Only the thread that reads may call this.
+void sim_read(struct sim *s, Uint64 now_ns, struct aircraft_state *ac, double vel[3]) {
+    if (atomic_load(&s->middle) & SIM_FRESH)
+        s->front = atomic_exchange(&s->middle, s->front) & 3;
+    const struct sim_frame *f = &s->slots[s->front];
+
+    double t = 1;
+    if (f->cur.time_ns > f->prev.time_ns) {
+        double at = (double)now_ns - s->step_ns;
+        t = (at - f->prev.time_ns) / (f->cur.time_ns - f->prev.time_ns);
+        t = t < 0 ? 0 : t > 1 ? 1 : t;
+    }
+
+    const struct aircraft_state *a = &f->prev.ac, *b = &f->cur.ac;
+    *ac = *b;
+    for (int i = 0; i < 3; i++) {
+        ac->pos.raw[i] = a->pos.raw[i] + (b->pos.raw[i] - a->pos.raw[i]) * t;
+        vel[i] = f->prev.vel[i] + (f->cur.vel[i] - f->prev.vel[i]) * t;
+    }
+    ac->forward = sim_nlerp(a->forward, b->forward, t);
+    ac->up = sim_nlerp(a->up, b->up, t);
+    ac->right = sim_nlerp(a->right, b->right, t);
+    ecef_to_geodetic(ac->pos, &ac->lat, &ac->lon, &ac->height);
+}
+
+#endif
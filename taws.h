@@ -0,0 +1,237 @@
+#ifndef TAWS_H
+#define TAWS_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "aircraft_state.h"
+#include "geodesy.h"
+#include "terrain.h"
+
+// Terrain awareness look-ahead.
+//
+// The aircraft is projected along its current velocity for `horizon`
+// seconds. At each of `steps` times a row of `lanes` points is laid across a
+// corridor that starts half_width either side of the track and widens by
+// `spread` km per km travelled, covering turns and drift. Every point is
+// compared against the terrain below it; the earliest one closer than
+// `clearance` to the ground sets the alert level by its time to conflict.
+//
+// Evaluation runs on its own thread. taws_submit() hands over the latest
+// state without blocking and taws_result() returns the last finished
+// evaluation, so a frame never waits for the corridor.
+
+enum taws_level { TAWS_CLEAR, TAWS_CAUTION, TAWS_WARNING };
+
+struct taws_params {
+    float horizon;      // s of look-ahead
+    float caution_time; // s, conflicts sooner than this raise a caution
+    float warning_time; // s, and sooner than this a warning
+    float clearance;    // km required between the path and the terrain
+    float half_width;   // km either side of the track at the aircraft
+    float spread;       // km of corridor widening per km along the track
+    int steps, lanes;
+};
+
+struct taws_result {
+    enum taws_level level;
+    float time_to_conflict; // s, INFINITY without a conflict
+    float min_clearance;    // km over the whole corridor
+    double conflict_lat, conflict_lon;
+    int points;
+    float eval_ms;
+    uint64_t evaluations;
+};
+
+struct taws {
+    struct terrain *terrain;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool quit, pending;
+    struct taws_params params;
+    dvec3s pos;
+    double vel[3]; // km/s
+    struct taws_result result;
+
+    // corridor buffers, only touched by the worker
+    double *x, *y, *z, *lat, *lon, *h;
+    float *alt, *ground;
+    size_t cap;
+};
+
+static const struct taws_params TAWS_DEFAULT_PARAMS = {
+    .horizon = 60,
+    .caution_time = 60,
+    .warning_time = 30,
+    .clearance = 0.3,
+    .half_width = 0.1,
+    .spread = 0.1,
+    .steps = 240,
+    .lanes = 32,
+};
+
+static void taws_evaluate(struct taws *t, const struct taws_params *p, dvec3s pos,
+                          const double vel[3], struct taws_result *r) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    size_t n = (size_t)p->steps * p->lanes;
+    if (n > t->cap) {
+        t->cap = n;
+        t->x = realloc(t->x, sizeof(double) * n);
+        t->y = realloc(t->y, sizeof(double) * n);
+        t->z = realloc(t->z, sizeof(double) * n);
+        t->lat = realloc(t->lat, sizeof(double) * n);
+        t->lon = realloc(t->lon, sizeof(double) * n);
+        t->h = realloc(t->h, sizeof(double) * n);
+        t->alt = realloc(t->alt, sizeof(float) * n);
+        t->ground = realloc(t->ground, sizeof(float) * n);
+    }
+
+    // across-track direction, horizontal at the aircraft
+    double up[3], right[3], len = 0;
+    for (int k = 0; k < 3; k++)
+        len += pos.raw[k] * pos.raw[k];
+    for (int k = 0; k < 3; k++)
+        up[k] = pos.raw[k] / sqrt(len);
+    right[0] = vel[1] * up[2] - vel[2] * up[1];
+    right[1] = vel[2] * up[0] - vel[0] * up[2];
+    right[2] = vel[0] * up[1] - vel[1] * up[0];
+    len = sqrt(right[0] * right[0] + right[1] * right[1] + right[2] * right[2]);
+    double speed = sqrt(vel[0] * vel[0] + vel[1] * vel[1] + vel[2] * vel[2]);
+    if (len < 1e-9) {
+        // hovering: any horizontal direction will do, east unless at a pole
+        right[0] = -up[1];
+        right[1] = up[0];
+        right[2] = 0;
+        len = hypot(right[0], right[1]);
+        if (len < 1e-9)
+            right[0] = len = 1;
+    }
+    for (int k = 0; k < 3; k++)
+        right[k] /= len;
+
+    size_t i = 0;
+    for (int s = 0; s < p->steps; s++) {
+        double time = p->horizon * (s + 1) / p->steps;
+        double width = p->half_width + p->spread * speed * time;
+        for (int l = 0; l < p->lanes; l++, i++) {
+            double across = p->lanes > 1 ? (2.0 * l / (p->lanes - 1) - 1) * width : 0;
+            t->x[i] = pos.x + vel[0] * time + right[0] * across;
+            t->y[i] = pos.y + vel[1] * time + right[1] * across;
+            t->z[i] = pos.z + vel[2] * time + right[2] * across;
+        }
+    }
+    ecef_to_geodetic_n(t->x, t->y, t->z, t->lat, t->lon, t->h, n);
+    for (i = 0; i < n; i++) {
+        t->lat[i] *= 180 / M_PI;
+        t->lon[i] *= 180 / M_PI;
+        t->alt[i] = t->h[i];
+    }
+    terrain_heights(t->terrain, t->lat, t->lon, t->ground, n);
+
+    *r = (struct taws_result){
+        .level = TAWS_CLEAR,
+        .time_to_conflict = INFINITY,
+        .min_clearance = INFINITY,
+        .points = n,
+        .evaluations = r->evaluations + 1,
+    };
+    for (i = 0; i < n; i++) {
+        if (isnan(t->ground[i]))
+            continue;
+        float c = t->alt[i] - t->ground[i];
+        if (c < r->min_clearance)
+            r->min_clearance = c;
+        float time = p->horizon * (i / p->lanes + 1) / p->steps;
+        if (c < p->clearance && time < r->time_to_conflict) {
+            r->time_to_conflict = time;
+            r->conflict_lat = t->lat[i];
+            r->conflict_lon = t->lon[i];
+        }
+    }
+    if (r->time_to_conflict <= p->warning_time)
+        r->level = TAWS_WARNING;
+    else if (r->time_to_conflict <= p->caution_time)
+        r->level = TAWS_CAUTION;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    r->eval_ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) * 1e-6;
+}
+
+static void *taws_worker(void *arg) {
+    struct taws *t = arg;
+    pthread_mutex_lock(&t->lock);
+    for (;;) {
+        while (!t->pending && !t->quit)
+            pthread_cond_wait(&t->cond, &t->lock);
+        if (t->quit)
+            break;
+        struct taws_params p = t->params;
+        dvec3s pos = t->pos;
+        double vel[3] = {t->vel[0], t->vel[1], t->vel[2]};
+        struct taws_result r = t->result;
+        t->pending = false;
+        pthread_mutex_unlock(&t->lock);
+
+        taws_evaluate(t, &p, pos, vel, &r);
+
+        pthread_mutex_lock(&t->lock);
+        t->result = r;
+    }
+    pthread_mutex_unlock(&t->lock);
+    return NULL;
+}
+
+void taws_init(struct taws *t, struct terrain *terrain) {
+    *t = (struct taws){
+        .terrain = terrain,
+        .params = TAWS_DEFAULT_PARAMS,
+        .result = {.time_to_conflict = INFINITY, .min_clearance = INFINITY},
+    };
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->cond, NULL);
+    pthread_create(&t->thread, NULL, taws_worker, t);
+}
+
+void taws_destroy(struct taws *t) {
+    pthread_mutex_lock(&t->lock);
+    t->quit = true;
+    pthread_cond_signal(&t->cond);
+    pthread_mutex_unlock(&t->lock);
+    pthread_join(t->thread, NULL);
+    pthread_mutex_destroy(&t->lock);
+    pthread_cond_destroy(&t->cond);
+    free(t->x);
+    free(t->y);
+    free(t->z);
+    free(t->lat);
+    free(t->lon);
+    free(t->h);
+    free(t->alt);
+    free(t->ground);
+}
+
+// Queue an evaluation for the aircraft at pos moving at vel km/s. A state
+// the worker has not picked up yet is replaced.
+void taws_submit(struct taws *t, const struct taws_params *p, dvec3s pos, const double vel[3]) {
+    pthread_mutex_lock(&t->lock);
+    t->params = *p;
+    t->pos = pos;
+    memcpy(t->vel, vel, sizeof(t->vel));
+    t->pending = true;
+    pthread_cond_signal(&t->cond);
+    pthread_mutex_unlock(&t->lock);
+}
+
+struct taws_result taws_result(struct taws *t) {
+    pthread_mutex_lock(&t->lock);
+    struct taws_result r = t->result;
+    pthread_mutex_unlock(&t->lock);
+    return r;
+}
+
+#endif
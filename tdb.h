@@ -0,0 +1,827 @@
+#ifndef TDB_H
+#define TDB_H
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __x86_64__
+#include <emmintrin.h>
+#endif
+
+// Terrain database (TDB) on-disk layout, version 2:
+//
+//   struct tdb_header                       at offset 0
+//   struct tdb_entry[num_tiles]             at dir_offset, sorted by (lat, lon)
+//   tile payloads                           each starting on a TDB_PAGE_SIZE boundary
+//
+// A payload is xres * yres int16 samples, row-major, 15 bits of height in meters
+// shifted left by one with the water mask in the LSB. Readers step through the
+// directory with entry_size so newer writers can append fields to tdb_entry;
+// fields a writer did not know about read as zero.
+//
+// The base payload is either raw or, with encoding TDB_ENCODING_DELTA, the
+// compressed stream written by tdb_encode(); size is then its length in
+// bytes. Pyramids are always stored raw so they can be used straight from the
+// mapping.
+//
+// A tile may carry a mip pyramid of `levels` levels below the base, each level
+// max(1, n >> l) samples along each axis. At pyramid_offset come the average
+// levels 1..levels (packed like the base, water by majority), then the minimum
+// and then the maximum height levels (plain meters). An output sample covers
+// the 2x2 block under it plus the odd last row or column, so min and max are
+// conservative bounds of everything beneath them.
+//
+// A delta encoded tile also stores at edge_offset, raw, the samples one step
+// in from each edge of its base: row 1, row yres - 2, column 1 and column
+// xres - 2. Neighbouring tiles read their halos from it, see tdb_inner_line(),
+// without decoding the whole tile.
+//
+// Version 1 is the original headerless format: a plain sequence of
+// (lat, lon, xres, yres) int16 records each followed by its samples.
+
+#define TDB_MAGIC "TDB\x02"
+#define TDB_VERSION 2
+#define TDB_PAGE_SIZE 4096
+#define TDB_ENTRY_MIN_SIZE 24
+#define TDB_MIN_HEIGHT -500 // meters, bounds for tiles without a pyramid
+#define TDB_MAX_HEIGHT 9000
+
+struct tdb_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t num_tiles;
+    uint32_t entry_size;
+    uint64_t dir_offset;
+};
+
+struct tdb_entry {
+    int16_t lat, lon, xres, yres;
+    uint64_t offset; // byte offset of the payload in the file
+    uint64_t size;   // payload size in bytes
+    uint32_t levels;   // mip levels below the base, 0 without a pyramid
+    uint32_t encoding; // enum tdb_encoding of the base payload
+    uint64_t pyramid_offset;
+    uint64_t edge_offset; // inner edges of an encoded base, 0 if none
+};
+
+enum tdb_pyramid_kind { TDB_PYRAMID_AVG, TDB_PYRAMID_MIN, TDB_PYRAMID_MAX };
+
+enum tdb_encoding { TDB_ENCODING_RAW, TDB_ENCODING_DELTA };
+
+struct tdb {
+    int fd;
+    uint8_t *map;
+    size_t map_size;
+    uint32_t version;
+    struct tdb_entry *entries;
+    size_t num_tiles;
+};
+
+static int tdb_entry_cmp(const void *a, const void *b) {
+    const struct tdb_entry *ea = a, *eb = b;
+    if (ea->lat != eb->lat)
+        return ea->lat - eb->lat;
+    return ea->lon - eb->lon;
+}
+
+int tdb_pyramid_levels(int xres, int yres) {
+    int levels = 0;
+    while ((xres >> levels) > 1 || (yres >> levels) > 1)
+        levels++;
+    return levels;
+}
+
+void tdb_level_dims(int xres, int yres, int level, int *w, int *h) {
+    *w = xres >> level > 0 ? xres >> level : 1;
+    *h = yres >> level > 0 ? yres >> level : 1;
+}
+
+// Samples before level within one kind's block of the pyramid (level >= 1).
+size_t tdb_level_offset(int xres, int yres, int level) {
+    size_t off = 0;
+    for (int l = 1; l < level; l++) {
+        int w, h;
+        tdb_level_dims(xres, yres, l, &w, &h);
+        off += (size_t)w * h;
+    }
+    return off;
+}
+
+// Samples in levels 1..levels of one kind.
+size_t tdb_pyramid_samples(int xres, int yres) {
+    return tdb_level_offset(xres, yres, tdb_pyramid_levels(xres, yres) + 1);
+}
+
+static int tdb_floor_div(int64_t a, int64_t b) { return a / b - (a % b != 0 && (a < 0) != (b < 0)); }
+
+// Reduce one w x h level into the next. packed sources carry the water bit.
+static void tdb_reduce(const int16_t *src, int w, int h, bool packed, int16_t *dst,
+                       enum tdb_pyramid_kind kind) {
+    int ow = w >> 1 > 0 ? w >> 1 : 1;
+    int oh = h >> 1 > 0 ? h >> 1 : 1;
+    for (int y = 0; y < oh; y++) {
+        int y1 = y == oh - 1 ? h : 2 * y + 2;
+        for (int x = 0; x < ow; x++) {
+            int x1 = x == ow - 1 ? w : 2 * x + 2;
+            int64_t sum = 0;
+            int n = 0, water = 0, lo = INT16_MAX, hi = INT16_MIN;
+            for (int sy = 2 * y; sy < y1; sy++) {
+                for (int sx = 2 * x; sx < x1; sx++) {
+                    int v = src[sy * w + sx];
+                    int height = packed ? v >> 1 : v;
+                    water += v & 1;
+                    sum += height;
+                    lo = height < lo ? height : lo;
+                    hi = height > hi ? height : hi;
+                    n++;
+                }
+            }
+            int16_t out;
+            if (kind == TDB_PYRAMID_AVG)
+                out = tdb_floor_div(2 * sum + n, 2 * n) * 2 + (2 * water > n);
+            else
+                out = kind == TDB_PYRAMID_MIN ? lo : hi;
+            dst[y * ow + x] = out;
+        }
+    }
+}
+
+// Build the pyramid of a base tile. Any of avg, min and max may be NULL; each
+// receives tdb_pyramid_samples() samples laid out level after level.
+void tdb_build_pyramid(const int16_t *base, int xres, int yres, int16_t *avg, int16_t *min,
+                       int16_t *max) {
+    int16_t *out[] = {avg, min, max};
+    int levels = tdb_pyramid_levels(xres, yres);
+    for (int kind = TDB_PYRAMID_AVG; kind <= TDB_PYRAMID_MAX; kind++) {
+        if (!out[kind])
+            continue;
+        const int16_t *src = base;
+        bool packed = true;
+        for (int l = 1; l <= levels; l++) {
+            int w, h;
+            tdb_level_dims(xres, yres, l - 1, &w, &h);
+            int16_t *dst = out[kind] + tdb_level_offset(xres, yres, l);
+            tdb_reduce(src, w, h, packed, dst, kind);
+            src = dst;
+            packed = kind == TDB_PYRAMID_AVG;
+        }
+    }
+}
+
+enum tdb_side { TDB_NORTH, TDB_SOUTH, TDB_WEST, TDB_EAST };
+
+// Samples in the inner edges of a base.
+size_t tdb_edge_samples(int xres, int yres) { return 2 * (size_t)xres + 2 * (size_t)yres; }
+
+// Copy the inner edges of base to dst in the order stored, see above.
+void tdb_build_edges(const int16_t *base, int xres, int yres, int16_t *dst) {
+    int r1 = yres > 1 ? 1 : 0, c1 = xres > 1 ? 1 : 0;
+    memcpy(dst, base + (size_t)r1 * xres, xres * sizeof(int16_t));
+    memcpy(dst + xres, base + (size_t)(yres - 1 - r1) * xres, xres * sizeof(int16_t));
+    for (int y = 0; y < yres; y++) {
+        dst[2 * xres + y] = base[(size_t)y * xres + c1];
+        dst[2 * xres + yres + y] = base[(size_t)y * xres + xres - 1 - c1];
+    }
+}
+
+// Surface normals for shading and slope.
+//
+// Every sample of the base and of each average level gets a unit normal in
+// the local frame x east, y up, z south (along the rows), from central
+// differences over the true ground distance between samples: a level n
+// samples wide spans the tile's degree in n - 1 steps, and a step east
+// shrinks with the cosine of the row's latitude. Normals point upward, so two
+// bytes of hemi-octahedral encoding keep them to about half a degree; the
+// slope is acos of the up component.
+//
+// Samples on the tile edge difference across it with a halo, the line of
+// samples one step into the neighbouring tile, so both tiles agree on the
+// normal along their shared edge. A neighbour of another resolution is
+// sampled nearest along the edge and its step scaled to ours. Where there is
+// no neighbour the terrain is extended linearly, a one sided difference.
+
+#define TDB_NORMAL_BYTES 2
+#define TDB_WGS84_A 6378137.0         // m
+#define TDB_WGS84_E2 0.00669437999014 // first eccentricity squared
+
+// A line of samples in a level: len samples stride apart, in a level across
+// samples deep in the other direction.
+struct tdb_line {
+    const int16_t *p;
+    ptrdiff_t stride;
+    int len, across;
+};
+
+static inline void tdb_normal_encode(float e, float u, float s, uint8_t out[2]) {
+    float k = 0.5f / (fabsf(e) + fabsf(u) + fabsf(s));
+    float px = e * k, py = s * k; // half the octahedral coordinates
+    out[0] = (uint8_t)(((px + py) + 0.5f) * 255 + 0.5f);
+    out[1] = (uint8_t)(((px - py) + 0.5f) * 255 + 0.5f);
+}
+
+// Unit normal, east, up, south, of an encoded one; terrain.vs decodes alike.
+void tdb_normal_decode(const uint8_t in[2], float n[3]) {
+    float ex = in[0] / 255.0f * 2 - 1, ey = in[1] / 255.0f * 2 - 1;
+    float px = (ex + ey) * 0.5f, py = (ex - ey) * 0.5f;
+    float up = 1 - fabsf(px) - fabsf(py);
+    float len = sqrtf(px * px + up * up + py * py);
+    n[0] = px / len;
+    n[1] = up / len;
+    n[2] = py / len;
+}
+
+// Heights in meters one of our steps beyond side of a w x h level, from the
+// halo if there is one and by linear extension otherwise.
+static void tdb_level_pad(const int16_t *src, int w, int h, enum tdb_side side,
+                          const struct tdb_line *halo, int32_t *pad) {
+    bool rows = side == TDB_NORTH || side == TDB_SOUTH;
+    int len = rows ? w : h, across = rows ? h : w;
+    ptrdiff_t step = rows ? 1 : w;   // along the edge
+    ptrdiff_t inward = rows ? w : 1; // towards the inside
+    const int16_t *edge = src;
+    if (side == TDB_SOUTH)
+        edge += (size_t)(h - 1) * w;
+    else if (side == TDB_EAST)
+        edge += w - 1;
+    if (side == TDB_SOUTH || side == TDB_EAST)
+        inward = -inward;
+    if (across < 2)
+        inward = 0;
+
+    bool use_halo = halo && halo->p && halo->len > 0 && halo->across > 1 && across > 1;
+    float scale = use_halo ? (float)(halo->across - 1) / (across - 1) : 0;
+    for (int k = 0; k < len; k++) {
+        int e = edge[k * step] >> 1;
+        if (use_halo) {
+            // nearest halo sample along the edge
+            int j = len > 1 ? (2 * (int64_t)k * (halo->len - 1) + len - 1) / (2 * (len - 1)) : 0;
+            int n = halo->p[j * halo->stride] >> 1;
+            pad[k] = e + lroundf((n - e) * scale);
+        } else {
+            pad[k] = 2 * e - (edge[k * step + inward] >> 1);
+        }
+    }
+}
+
+static void tdb_level_normals(const int16_t *src, int w, int h, int lat,
+                              const struct tdb_line halo[4], int32_t *pad, uint8_t *dst) {
+    int32_t *pad_n = pad, *pad_s = pad + w, *pad_w = pad + 2 * w, *pad_e = pad + 2 * w + h;
+    tdb_level_pad(src, w, h, TDB_NORTH, halo ? &halo[TDB_NORTH] : NULL, pad_n);
+    tdb_level_pad(src, w, h, TDB_SOUTH, halo ? &halo[TDB_SOUTH] : NULL, pad_s);
+    tdb_level_pad(src, w, h, TDB_WEST, halo ? &halo[TDB_WEST] : NULL, pad_w);
+    tdb_level_pad(src, w, h, TDB_EAST, halo ? &halo[TDB_EAST] : NULL, pad_e);
+
+    double step_lon = w > 1 ? 1.0 / (w - 1) : 1, step_lat = h > 1 ? 1.0 / (h - 1) : 1;
+    for (int y = 0; y < h; y++) {
+        double phi = (lat - y * step_lat) * (M_PI / 180);
+        double q = 1 - TDB_WGS84_E2 * sin(phi) * sin(phi);
+        double n = TDB_WGS84_A / sqrt(q);                            // prime vertical radius
+        double m = TDB_WGS84_A * (1 - TDB_WGS84_E2) / (q * sqrt(q)); // meridian radius
+        // per meter over two steps east and south
+        float kx = 0.5 / fmax(n * cos(phi) * step_lon * (M_PI / 180), 1e-3);
+        float kz = 0.5 / (m * step_lat * (M_PI / 180));
+        const int16_t *row = src + (size_t)y * w;
+        const int16_t *north = y > 0 ? row - w : NULL, *south = y < h - 1 ? row + w : NULL;
+        uint8_t *out = dst + (size_t)y * w * TDB_NORMAL_BYTES;
+        for (int x = 0; x < w; x++) {
+            int west = x > 0 ? row[x - 1] >> 1 : pad_w[y];
+            int east = x < w - 1 ? row[x + 1] >> 1 : pad_e[y];
+            int up = north ? north[x] >> 1 : pad_n[x];
+            int down = south ? south[x] >> 1 : pad_s[x];
+            tdb_normal_encode((west - east) * kx, 1, (up - down) * kz,
+                              out + x * TDB_NORMAL_BYTES);
+        }
+    }
+}
+
+// Normals of a base tile whose north-west corner is at lat degrees and of
+// its average levels avg, as built by tdb_build_pyramid(), or of the base
+// alone if avg is NULL. halo holds the four halos, indexed by enum tdb_side,
+// of every level from the base down, or is NULL; missing ones have a NULL p.
+// dst receives TDB_NORMAL_BYTES per sample, laid out like the samples: base,
+// then level after level.
+void tdb_build_normals(const int16_t *base, const int16_t *avg, int xres, int yres, int lat,
+                       const struct tdb_line (*halo)[4], uint8_t *dst) {
+    int32_t *pad = malloc(sizeof(int32_t) * tdb_edge_samples(xres, yres));
+    tdb_level_normals(base, xres, yres, lat, halo ? halo[0] : NULL, pad, dst);
+    dst += (size_t)xres * yres * TDB_NORMAL_BYTES;
+    for (int l = 1; avg && l <= tdb_pyramid_levels(xres, yres); l++) {
+        int w, h;
+        tdb_level_dims(xres, yres, l, &w, &h);
+        size_t off = tdb_level_offset(xres, yres, l);
+        tdb_level_normals(avg + off, w, h, lat, halo ? halo[l] : NULL, pad,
+                          dst + off * TDB_NORMAL_BYTES);
+    }
+    free(pad);
+}
+
+// Delta encoding of a base payload.
+//
+// Heights are predicted from their west, north and north-west neighbours
+// (w + n - nw, the first row and column from the one neighbour they have) and
+// the residuals zigzag coded and bit-packed in blocks of TDB_CODEC_BLOCK
+// samples, each block led by a byte holding its bit width. Smooth terrain
+// leaves residuals of a few meters, so most blocks need 2 to 5 bits. The
+// water mask goes first as alternating dry/wet run lengths, LEB128 varints,
+// behind a uint32 byte count. Decoding restores every sample bit for bit.
+//
+// bench codec decodes about 1 GB/s per core, so encoded tiles load faster
+// only from storage slower than about 700 MB/s (hard disks, SATA SSDs,
+// network mounts). On NVMe they just save space, which is why raw stays the
+// default.
+
+#define TDB_CODEC_BLOCK 64
+
+// Largest stream tdb_encode() can produce for an xres x yres tile.
+size_t tdb_encode_bound(int xres, int yres) {
+    size_t n = (size_t)xres * yres;
+    return 4 + 5 * (n + 1) + n / TDB_CODEC_BLOCK + 1 + n * 4 + 8;
+}
+
+static uint8_t *tdb_put_varint(uint8_t *p, uint32_t v) {
+    while (v >= 0x80) {
+        *p++ = v | 0x80;
+        v >>= 7;
+    }
+    *p++ = v;
+    return p;
+}
+
+static const uint8_t *tdb_get_varint(const uint8_t *p, const uint8_t *end, uint32_t *v) {
+    *v = 0;
+    for (int shift = 0; p < end && shift < 35; shift += 7) {
+        uint8_t b = *p++;
+        *v |= (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return p;
+    }
+    return NULL;
+}
+
+static int32_t tdb_predict(const int32_t *row, const int32_t *above, int x) {
+    if (!above)
+        return x ? row[x - 1] : 0;
+    if (!x)
+        return above[0];
+    return row[x - 1] + above[x] - above[x - 1];
+}
+
+// Compress an xres x yres payload into dst, which must hold
+// tdb_encode_bound() bytes. Returns the length of the stream.
+size_t tdb_encode(const int16_t *src, int xres, int yres, uint8_t *dst) {
+    size_t n = (size_t)xres * yres;
+
+    // water runs
+    uint8_t *p = dst + 4;
+    int water = 0;
+    uint32_t run = 0;
+    for (size_t i = 0; i < n; i++) {
+        if ((src[i] & 1) != water) {
+            p = tdb_put_varint(p, run);
+            water ^= 1;
+            run = 0;
+        }
+        run++;
+    }
+    p = tdb_put_varint(p, run);
+    uint32_t water_bytes = p - dst - 4;
+    memcpy(dst, &water_bytes, 4);
+
+    // height residuals
+    int32_t *rows = malloc(sizeof(int32_t) * 2 * xres);
+    uint32_t block[TDB_CODEC_BLOCK];
+    int fill = 0;
+    for (int y = 0; y < yres; y++) {
+        int32_t *row = rows + (y & 1) * xres;
+        int32_t *above = y ? rows + ((y - 1) & 1) * xres : NULL;
+        for (int x = 0; x < xres; x++) {
+            row[x] = src[(size_t)y * xres + x] >> 1;
+            int32_t r = row[x] - tdb_predict(row, above, x);
+            block[fill++] = ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);
+            bool last = y == yres - 1 && x == xres - 1;
+            if (fill < TDB_CODEC_BLOCK && !last)
+                continue;
+
+            uint32_t all = 0;
+            for (int k = 0; k < fill; k++)
+                all |= block[k];
+            int bits = all ? 32 - __builtin_clz(all) : 0;
+            *p++ = bits;
+            uint64_t acc = 0;
+            int used = 0;
+            for (int k = 0; k < fill; k++) {
+                acc |= (uint64_t)block[k] << used;
+                used += bits;
+                while (used >= 8) {
+                    *p++ = acc;
+                    acc >>= 8;
+                    used -= 8;
+                }
+            }
+            if (used > 0)
+                *p++ = acc;
+            fill = 0;
+        }
+    }
+    free(rows);
+    return p - dst;
+}
+
+struct tdb_bit_reader {
+    const uint8_t *p, *end;
+    size_t left; // residuals not yet unpacked
+    uint16_t block[TDB_CODEC_BLOCK]; // a block straddling rows, zigzag decoded
+    int next, avail;
+};
+
+// Residuals come out modulo 2^16, which is all the 16-bit reconstruction needs.
+static inline uint16_t tdb_unzigzag(uint32_t z) { return (z >> 1) ^ -(z & 1); }
+
+static inline __attribute__((always_inline)) void tdb_unpack_full(const uint8_t *p, int bits,
+                                                                  uint16_t *restrict out) {
+    // 8 values always end on a byte boundary, so the offsets within each
+    // group of 8 are the same and constant for a constant width
+    uint64_t mask = (1ull << bits) - 1;
+    uint32_t z[TDB_CODEC_BLOCK];
+    for (int g = 0; g < TDB_CODEC_BLOCK; g += 8, p += bits) {
+#pragma GCC unroll 8
+        for (int j = 0; j < 8; j++) {
+            uint64_t w;
+            memcpy(&w, p + (j * bits >> 3), 8);
+            z[g + j] = (w >> (j * bits & 7)) & mask;
+        }
+    }
+    // the zigzag step vectorizes on its own
+    for (int k = 0; k < TDB_CODEC_BLOCK; k++)
+        out[k] += tdb_unzigzag(z[k]);
+}
+
+// Add the next block onto out. Returns the number of residuals, 0 if the
+// stream is malformed.
+static int tdb_unpack_block(struct tdb_bit_reader *r, uint16_t *restrict out) {
+    int count = r->left < TDB_CODEC_BLOCK ? r->left : TDB_CODEC_BLOCK;
+    if (count == 0 || r->p >= r->end)
+        return 0;
+    int bits = *r->p++;
+    size_t bytes = ((size_t)count * bits + 7) / 8;
+    if (bits > 32 || bytes > (size_t)(r->end - r->p))
+        return 0;
+
+    uint64_t mask = (1ull << bits) - 1;
+    if (count == TDB_CODEC_BLOCK && (size_t)(r->end - r->p) >= bytes + 8) {
+        // a full block with slack behind it: every value sits within one
+        // unaligned 64-bit load, and a constant width per case lets the
+        // compiler turn the loop into straight shifts
+        switch (bits) {
+#define TDB_UNPACK_CASE(b)                                                                         \
+    case b:                                                                                        \
+        tdb_unpack_full(r->p, b, out);                                                             \
+        break;
+            TDB_UNPACK_CASE(0) TDB_UNPACK_CASE(1) TDB_UNPACK_CASE(2) TDB_UNPACK_CASE(3)
+            TDB_UNPACK_CASE(4) TDB_UNPACK_CASE(5) TDB_UNPACK_CASE(6) TDB_UNPACK_CASE(7)
+            TDB_UNPACK_CASE(8) TDB_UNPACK_CASE(9) TDB_UNPACK_CASE(10) TDB_UNPACK_CASE(11)
+            TDB_UNPACK_CASE(12) TDB_UNPACK_CASE(13) TDB_UNPACK_CASE(14) TDB_UNPACK_CASE(15)
+            TDB_UNPACK_CASE(16)
+#undef TDB_UNPACK_CASE
+        default:
+            tdb_unpack_full(r->p, bits, out);
+        }
+    } else {
+        const uint8_t *p = r->p;
+        uint64_t acc = 0;
+        int have = 0;
+        for (int k = 0; k < count; k++) {
+            while (have < bits) {
+                acc |= (uint64_t)*p++ << have;
+                have += 8;
+            }
+            out[k] += tdb_unzigzag(acc & mask);
+            acc >>= bits;
+            have -= bits;
+        }
+    }
+    r->p += bytes;
+    r->left -= count;
+    return count;
+}
+
+// Add the next count residuals onto diff.
+static bool tdb_unpack_add(struct tdb_bit_reader *r, uint16_t *restrict diff, int count) {
+    while (count > 0) {
+        if (r->next == r->avail) {
+            // blocks within the row are added straight onto it, one that
+            // runs into the next row is staged
+            if (count >= TDB_CODEC_BLOCK) {
+                if (!tdb_unpack_block(r, diff))
+                    return false;
+                diff += TDB_CODEC_BLOCK;
+                count -= TDB_CODEC_BLOCK;
+                continue;
+            }
+            memset(r->block, 0, sizeof(r->block));
+            if (!(r->avail = tdb_unpack_block(r, r->block)))
+                return false;
+            r->next = 0;
+        }
+        int k = r->avail - r->next < count ? r->avail - r->next : count;
+        const uint16_t *restrict block = r->block + r->next;
+        for (int x = 0; x < k; x++)
+            diff[x] += block[x];
+        r->next += k;
+        diff += k;
+        count -= k;
+    }
+    return true;
+}
+
+// out[x] |= (diff[0] + ... + diff[x]) << 1
+static void tdb_running_sum(const uint16_t *restrict diff, int count, uint16_t *restrict out) {
+    uint16_t sum = 0;
+    int x = 0;
+#ifdef __x86_64__
+    // in-register prefix sums of 8, carried across by the top lane
+    __m128i carry = _mm_setzero_si128();
+    for (; x + 8 <= count; x += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(diff + x));
+        v = _mm_add_epi16(v, _mm_slli_si128(v, 2));
+        v = _mm_add_epi16(v, _mm_slli_si128(v, 4));
+        v = _mm_add_epi16(v, _mm_slli_si128(v, 8));
+        v = _mm_add_epi16(v, carry);
+        carry = _mm_shuffle_epi32(_mm_shufflehi_epi16(v, 0xff), 0xff);
+        __m128i o = _mm_loadu_si128((const __m128i *)(out + x));
+        _mm_storeu_si128((__m128i *)(out + x), _mm_or_si128(o, _mm_slli_epi16(v, 1)));
+    }
+    sum = _mm_extract_epi16(carry, 7);
+#endif
+    for (; x < count; x++) {
+        sum += diff[x];
+        out[x] |= sum << 1;
+    }
+}
+
+// Expand a tdb_encode() stream of size bytes into xres x yres samples.
+// Returns false if the stream is malformed.
+bool tdb_decode(const uint8_t *src, size_t size, int xres, int yres, int16_t *dst) {
+    size_t n = (size_t)xres * yres;
+    uint32_t water_bytes;
+    if (size < 4)
+        return false;
+    memcpy(&water_bytes, src, 4);
+    if (water_bytes > size - 4)
+        return false;
+
+    // the water runs first, straight into the low bits
+    uint16_t *out = (uint16_t *)dst;
+    const uint8_t *p = src + 4, *end = src + 4 + water_bytes;
+    size_t i = 0;
+    uint16_t water = 0;
+    while (i < n) {
+        uint32_t run;
+        if (!(p = tdb_get_varint(p, end, &run)) || run > n - i)
+            return false;
+        for (size_t k = i; k < i + run; k++)
+            out[k] = water;
+        i += run;
+        water ^= 1;
+    }
+
+    // A w + n - nw residual is the change in the west difference (v - w)
+    // from the row above, so a row is a column-wise add onto the previous
+    // row's differences and then a running sum. Heights only ever land in
+    // 15 bits, so all of it can wrap in 16-bit lanes.
+    struct tdb_bit_reader r = {.p = src + 4 + water_bytes, .end = src + size, .left = n};
+    uint16_t *diff = calloc(xres, sizeof(uint16_t));
+    bool ok = true;
+    for (int y = 0; y < yres && (ok = tdb_unpack_add(&r, diff, xres)); y++, out += xres)
+        tdb_running_sum(diff, xres, out);
+    free(diff);
+    return ok;
+}
+
+static bool tdb_read_legacy(struct tdb *db) {
+    size_t cap = 0;
+    size_t off = 0;
+    while (off + 4 * sizeof(int16_t) <= db->map_size) {
+        int16_t hdr[4];
+        memcpy(hdr, db->map + off, sizeof(hdr));
+        uint64_t size = (uint64_t)hdr[2] * hdr[3] * sizeof(int16_t);
+        if (hdr[2] <= 0 || hdr[3] <= 0 || off + sizeof(hdr) + size > db->map_size)
+            break;
+
+        if (db->num_tiles == cap) {
+            cap = cap ? cap * 2 : 64;
+            db->entries = realloc(db->entries, cap * sizeof(struct tdb_entry));
+        }
+        db->entries[db->num_tiles++] = (struct tdb_entry){
+            .lat = hdr[0],
+            .lon = hdr[1],
+            .xres = hdr[2],
+            .yres = hdr[3],
+            .offset = off + sizeof(hdr),
+            .size = size,
+        };
+        off += sizeof(hdr) + size;
+    }
+    if (off != db->map_size)
+        fprintf(stderr, "tdb: trailing %zu bytes ignored\n", db->map_size - off);
+
+    qsort(db->entries, db->num_tiles, sizeof(struct tdb_entry), tdb_entry_cmp);
+    return true;
+}
+
+static bool tdb_read_directory(struct tdb *db) {
+    struct tdb_header h;
+    memcpy(&h, db->map, sizeof(h));
+    if (h.version != TDB_VERSION) {
+        fprintf(stderr, "tdb: unsupported version %u\n", h.version);
+        return false;
+    }
+    if (h.entry_size < TDB_ENTRY_MIN_SIZE ||
+        h.dir_offset + (uint64_t)h.num_tiles * h.entry_size > db->map_size) {
+        fprintf(stderr, "tdb: corrupt tile directory\n");
+        return false;
+    }
+
+    db->num_tiles = h.num_tiles;
+    db->entries = calloc(h.num_tiles, sizeof(struct tdb_entry));
+    size_t copy = h.entry_size < sizeof(struct tdb_entry) ? h.entry_size : sizeof(struct tdb_entry);
+    for (size_t i = 0; i < h.num_tiles; i++) {
+        struct tdb_entry *e = &db->entries[i];
+        memcpy(e, db->map + h.dir_offset + i * h.entry_size, copy);
+        uint64_t pyramid_size =
+            e->levels ? 3 * tdb_pyramid_samples(e->xres, e->yres) * sizeof(int16_t) : 0;
+        if (e->offset + e->size > db->map_size || e->encoding > TDB_ENCODING_DELTA ||
+            (e->encoding == TDB_ENCODING_RAW &&
+             e->size < (uint64_t)e->xres * e->yres * sizeof(int16_t)) ||
+            (e->levels && (e->levels != (uint32_t)tdb_pyramid_levels(e->xres, e->yres) ||
+                           e->pyramid_offset + pyramid_size > db->map_size)) ||
+            (e->edge_offset && e->edge_offset + tdb_edge_samples(e->xres, e->yres) *
+                                                      sizeof(int16_t) > db->map_size)) {
+            fprintf(stderr, "tdb: tile %d,%d out of bounds\n", e->lat, e->lon);
+            return false;
+        }
+        // tdb_find() searches the directory in place
+        if (i > 0 && tdb_entry_cmp(e - 1, e) >= 0) {
+            fprintf(stderr, "tdb: tile %d,%d out of order\n", e->lat, e->lon);
+            return false;
+        }
+    }
+    return true;
+}
+
+void tdb_close(struct tdb *db) {
+    if (db->map)
+        munmap(db->map, db->map_size);
+    if (db->fd >= 0)
+        close(db->fd);
+    free(db->entries);
+    *db = (struct tdb){.fd = -1};
+}
+
+bool tdb_open(struct tdb *db, const char *path) {
+    *db = (struct tdb){.fd = -1};
+
+    db->fd = open(path, O_RDONLY);
+    if (db->fd < 0) {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(db->fd, &st) != 0 || st.st_size < (off_t)sizeof(struct tdb_header)) {
+        fprintf(stderr, "tdb: %s is empty\n", path);
+        tdb_close(db);
+        return false;
+    }
+    db->map_size = st.st_size;
+    db->map = mmap(NULL, db->map_size, PROT_READ, MAP_PRIVATE, db->fd, 0);
+    if (db->map == MAP_FAILED) {
+        db->map = NULL;
+        perror("tdb: mmap");
+        tdb_close(db);
+        return false;
+    }
+    // tiles are visited individually, read-ahead across the whole file is wasted
+    madvise(db->map, db->map_size, MADV_RANDOM);
+
+    bool ok;
+    if (memcmp(db->map, TDB_MAGIC, 4) == 0) {
+        db->version = TDB_VERSION;
+        ok = tdb_read_directory(db);
+    } else {
+        db->version = 1;
+        ok = tdb_read_legacy(db);
+    }
+    if (!ok) {
+        tdb_close(db);
+        return false;
+    }
+    return true;
+}
+
+// Index of the tile whose north-west corner is (lat, lon), or -1.
+long tdb_find(const struct tdb *db, int lat, int lon) {
+    struct tdb_entry key = {.lat = lat, .lon = lon};
+    struct tdb_entry *e =
+        bsearch(&key, db->entries, db->num_tiles, sizeof(struct tdb_entry), tdb_entry_cmp);
+    return e ? e - db->entries : -1;
+}
+
+// Samples of a raw tile straight from the mapping, NULL for encoded tiles.
+const int16_t *tdb_tile_data(const struct tdb *db, size_t i) {
+    if (db->entries[i].encoding != TDB_ENCODING_RAW)
+        return NULL;
+    return (const int16_t *)(db->map + db->entries[i].offset);
+}
+
+// Copy or decode the samples of tile i into dst (xres * yres of them).
+bool tdb_read_tile(const struct tdb *db, size_t i, int16_t *dst) {
+    const struct tdb_entry *e = &db->entries[i];
+    if (e->encoding == TDB_ENCODING_RAW) {
+        memcpy(dst, db->map + e->offset, (size_t)e->xres * e->yres * sizeof(int16_t));
+        return true;
+    }
+    if (!tdb_decode(db->map + e->offset, e->size, e->xres, e->yres, dst)) {
+        fprintf(stderr, "tdb: tile %d,%d is corrupt\n", e->lat, e->lon);
+        return false;
+    }
+    return true;
+}
+
+// Stored pyramid level (1..levels) of tile i, or NULL if the tile has none.
+const int16_t *tdb_pyramid(const struct tdb *db, size_t i, enum tdb_pyramid_kind kind,
+                           int level) {
+    const struct tdb_entry *e = &db->entries[i];
+    if (!e->levels)
+        return NULL;
+    size_t off = kind * tdb_pyramid_samples(e->xres, e->yres) +
+                 tdb_level_offset(e->xres, e->yres, level);
+    return (const int16_t *)(db->map + e->pyramid_offset) + off;
+}
+
+// The samples one step in from side of level (0 for the base) of tile i, the
+// halo of the neighbour across that side. False where they are not at hand
+// in the mapping: encoded bases without stored edges, levels of tiles
+// without a pyramid, and levels too small to have an inside.
+bool tdb_inner_line(const struct tdb *db, size_t i, int level, enum tdb_side side,
+                    struct tdb_line *line) {
+    const struct tdb_entry *e = &db->entries[i];
+    int w, h;
+    tdb_level_dims(e->xres, e->yres, level, &w, &h);
+    bool rows = side == TDB_NORTH || side == TDB_SOUTH;
+    *line = (struct tdb_line){.len = rows ? w : h, .across = rows ? h : w};
+    if (line->across < 2 || level < 0 || (uint32_t)level > e->levels)
+        return false;
+
+    const int16_t *edges = e->edge_offset ? (const int16_t *)(db->map + e->edge_offset) : NULL;
+    const int16_t *samples = level ? tdb_pyramid(db, i, TDB_PYRAMID_AVG, level)
+                                   : tdb_tile_data(db, i);
+    if (!level && !samples && edges) {
+        size_t start[] = {0, w, 2 * (size_t)w, 2 * (size_t)w + h};
+        line->p = edges + start[side];
+        line->stride = 1;
+        return true;
+    }
+    if (!samples)
+        return false;
+    switch (side) {
+    case TDB_NORTH:
+        line->p = samples + w;
+        break;
+    case TDB_SOUTH:
+        line->p = samples + (size_t)(h - 2) * w;
+        break;
+    case TDB_WEST:
+        line->p = samples + 1;
+        break;
+    case TDB_EAST:
+        line->p = samples + w - 2;
+        break;
+    }
+    line->stride = rows ? 1 : w;
+    return true;
+}
+
+// Lowest and highest height in meters of tile i, from the top of its pyramid.
+// Tiles without one get bounds that hold anywhere on Earth and false.
+bool tdb_tile_range(const struct tdb *db, size_t i, int *min, int *max) {
+    int levels = db->entries[i].levels;
+    if (!levels) {
+        *min = TDB_MIN_HEIGHT;
+        *max = TDB_MAX_HEIGHT;
+        return false;
+    }
+    *min = *tdb_pyramid(db, i, TDB_PYRAMID_MIN, levels);
+    *max = *tdb_pyramid(db, i, TDB_PYRAMID_MAX, levels);
+    return true;
+}
+
+#endif
@@ -0,0 +1,453 @@
+// Builds terrain.tdb from Copernicus DEM/WBM GeoTIFF pairs.
+//
+//   tdbconv [-j threads] [-o out.tdb] [--region lat0:lat1,lon0:lon1] [--update] [--compress]
+//           [data_dir]
+//
+// Tiles are decoded and reduced into their pyramids on a pool of worker
+// threads. Each worker writes its finished tile straight to its own page
+// aligned slot of the output and drops it, so memory stays at one tile per
+// worker no matter how large the region is. The directory is written last.
+//
+// --region only converts tiles whose (lat, lon) key falls inside the given
+// inclusive bounds. --update reads the existing output and copies every tile
+// whose source files are not newer than it instead of decoding them again;
+// tiles of the old database without a source in this run are kept as well.
+// --compress stores base payloads with the delta encoding of tdb.h, along with
+// the inner edges neighbouring tiles build their halos from. It makes loads
+// faster only on storage slower than the decoder (see tdb.h).
+
+#include <dirent.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <tiffio.h>
+#include <unistd.h>
+
+#include "tdb.h"
+
+#define MAX_THREADS 64
+
+struct job {
+    int lat, lon;
+    char *dem, *wbm; // NULL when the tile comes from the old database
+    long old;        // index in the old database, or -1
+};
+
+static struct {
+    struct job *jobs;
+    size_t num_jobs;
+    size_t next_job;
+    struct tdb_entry *entries;
+    struct tdb old;
+    int fd;
+    uint64_t end; // first free page of the output
+    bool compress;
+    bool failed;
+    size_t decoded, copied;
+    uint64_t raw_bytes, payload_bytes;
+    pthread_mutex_t lock;
+} conv = {.lock = PTHREAD_MUTEX_INITIALIZER, .fd = -1};
+
+static uint64_t page_align(uint64_t off) {
+    return (off + TDB_PAGE_SIZE - 1) / TDB_PAGE_SIZE * TDB_PAGE_SIZE;
+}
+
+// Parse "..._N44_00_W073_00_DEM.tif" into the tile key.
+static bool parse_name(const char *name, int *lat, int *lon) {
+    char ns, ew;
+    const char *p = strstr(name, "_00_DEM");
+    if (!p || p - name < 12)
+        return false;
+    if (sscanf(p - 12, "_%c%2d_00_%c%3d", &ns, lat, &ew, lon) != 4 ||
+        (ns != 'N' && ns != 'S') || (ew != 'E' && ew != 'W'))
+        return false;
+    if (ns == 'S')
+        *lat = -*lat;
+    if (ew == 'W')
+        *lon = -*lon;
+    return true;
+}
+
+// Read band 0 of a single-band GeoTIFF, stripped or tiled, as floats.
+static float *read_tiff(const char *path, int *w, int *h) {
+    TIFF *tif = TIFFOpen(path, "r");
+    if (!tif) {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return NULL;
+    }
+
+    uint32_t width = 0, height = 0;
+    uint16_t bits = 0, format = SAMPLEFORMAT_UINT, spp = 1;
+    TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &width);
+    TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &height);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_BITSPERSAMPLE, &bits);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_SAMPLEFORMAT, &format);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_SAMPLESPERPIXEL, &spp);
+    if (spp != 1 || (bits != 8 && bits != 16 && bits != 32) ||
+        (format == SAMPLEFORMAT_IEEEFP && bits != 32)) {
+        fprintf(stderr, "%s: unsupported sample layout (%u x %u bit, format %u)\n", path, spp,
+                bits, format);
+        TIFFClose(tif);
+        return NULL;
+    }
+
+    float *out = malloc(sizeof(float) * width * height);
+    uint32_t bw = width, bh = 1; // block size, a scanline unless tiled
+    bool tiled = TIFFIsTiled(tif);
+    if (tiled) {
+        TIFFGetField(tif, TIFFTAG_TILEWIDTH, &bw);
+        TIFFGetField(tif, TIFFTAG_TILELENGTH, &bh);
+    }
+    uint8_t *buf = malloc(tiled ? TIFFTileSize(tif) : TIFFScanlineSize(tif));
+    int bytes = bits / 8;
+
+    bool ok = true;
+    for (uint32_t y0 = 0; y0 < height && ok; y0 += bh) {
+        for (uint32_t x0 = 0; x0 < width && ok; x0 += bw) {
+            ok = tiled ? TIFFReadTile(tif, buf, x0, y0, 0, 0) >= 0
+                       : TIFFReadScanline(tif, buf, y0, 0) >= 0;
+            for (uint32_t y = y0; ok && y < y0 + bh && y < height; y++) {
+                for (uint32_t x = x0; x < x0 + bw && x < width; x++) {
+                    const uint8_t *s = buf + ((size_t)(y - y0) * bw + (x - x0)) * bytes;
+                    float v;
+                    if (format == SAMPLEFORMAT_IEEEFP)
+                        memcpy(&v, s, 4);
+                    else if (bits == 8)
+                        v = format == SAMPLEFORMAT_INT ? *(int8_t *)s : *s;
+                    else if (bits == 16)
+                        v = format == SAMPLEFORMAT_INT ? *(int16_t *)s : *(uint16_t *)s;
+                    else
+                        v = format == SAMPLEFORMAT_INT ? *(int32_t *)s : *(uint32_t *)s;
+                    out[(size_t)y * width + x] = v;
+                }
+            }
+        }
+    }
+    free(buf);
+    TIFFClose(tif);
+    if (!ok) {
+        fprintf(stderr, "%s: read error\n", path);
+        free(out);
+        return NULL;
+    }
+    *w = width;
+    *h = height;
+    return out;
+}
+
+// 15 bits of height in meters and the water mask in the LSB, as in conv.py.
+static int16_t *decode_tile(const struct job *j, int *xres, int *yres) {
+    int ww, wh;
+    float *dem = read_tiff(j->dem, xres, yres);
+    float *wbm = dem ? read_tiff(j->wbm, &ww, &wh) : NULL;
+    if (!wbm || ww != *xres || wh != *yres) {
+        if (wbm)
+            fprintf(stderr, "%s: size does not match its DEM\n", j->wbm);
+        free(dem);
+        free(wbm);
+        return NULL;
+    }
+
+    size_t n = (size_t)*xres * *yres;
+    int16_t *packed = malloc(sizeof(int16_t) * n);
+    for (size_t i = 0; i < n; i++)
+        packed[i] = (int16_t)dem[i] * 2 | (wbm[i] != 0);
+    free(dem);
+    free(wbm);
+    return packed;
+}
+
+static bool write_all(const void *buf, size_t size, uint64_t off) {
+    while (size > 0) {
+        ssize_t n = pwrite(conv.fd, buf, size, off);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("tdbconv: write");
+            return false;
+        }
+        buf = (const uint8_t *)buf + n;
+        size -= n;
+        off += n;
+    }
+    return true;
+}
+
+static bool convert_tile(size_t i) {
+    struct job *j = &conv.jobs[i];
+    int xres, yres;
+    int16_t *base;
+    const int16_t *stored = NULL;
+    if (j->old >= 0) {
+        const struct tdb_entry *e = &conv.old.entries[j->old];
+        xres = e->xres;
+        yres = e->yres;
+        base = malloc((size_t)xres * yres * sizeof(int16_t));
+        if (!tdb_read_tile(&conv.old, j->old, base)) {
+            free(base);
+            return false;
+        }
+        stored = tdb_pyramid(&conv.old, j->old, TDB_PYRAMID_AVG, 1);
+    } else if (!(base = decode_tile(j, &xres, &yres))) {
+        return false;
+    }
+
+    size_t base_size = (size_t)xres * yres * sizeof(int16_t);
+    size_t kind_size = tdb_pyramid_samples(xres, yres) * sizeof(int16_t);
+    int16_t *pyramid = NULL;
+    if (!stored) {
+        pyramid = malloc(3 * kind_size);
+        tdb_build_pyramid(base, xres, yres, pyramid, pyramid + kind_size / sizeof(int16_t),
+                          pyramid + 2 * kind_size / sizeof(int16_t));
+        stored = pyramid;
+    }
+
+    const void *payload = base;
+    size_t payload_size = base_size;
+    uint8_t *encoded = NULL;
+    int16_t *edges = NULL;
+    size_t edge_size = 0;
+    if (conv.compress) {
+        encoded = malloc(tdb_encode_bound(xres, yres));
+        payload_size = tdb_encode(base, xres, yres, encoded);
+        payload = encoded;
+        // neighbours build their halos from these rather than decode the tile
+        edge_size = tdb_edge_samples(xres, yres) * sizeof(int16_t);
+        edges = malloc(edge_size);
+        tdb_build_edges(base, xres, yres, edges);
+    }
+
+    pthread_mutex_lock(&conv.lock);
+    uint64_t off = conv.end;
+    conv.end = page_align(off + payload_size + 3 * kind_size + edge_size);
+    pthread_mutex_unlock(&conv.lock);
+
+    uint64_t edge_offset = off + payload_size + 3 * kind_size;
+    bool ok = write_all(payload, payload_size, off) &&
+              write_all(stored, 3 * kind_size, off + payload_size) &&
+              (!edges || write_all(edges, edge_size, edge_offset));
+    conv.entries[i] = (struct tdb_entry){
+        .lat = j->lat,
+        .lon = j->lon,
+        .xres = xres,
+        .yres = yres,
+        .offset = off,
+        .size = payload_size,
+        .levels = tdb_pyramid_levels(xres, yres),
+        .encoding = conv.compress ? TDB_ENCODING_DELTA : TDB_ENCODING_RAW,
+        .pyramid_offset = off + payload_size,
+        .edge_offset = edges ? edge_offset : 0,
+    };
+    pthread_mutex_lock(&conv.lock);
+    conv.raw_bytes += base_size;
+    conv.payload_bytes += payload_size;
+    pthread_mutex_unlock(&conv.lock);
+    free(base);
+    free(encoded);
+    free(edges);
+    free(pyramid);
+    return ok;
+}
+
+static void *worker(void *arg) {
+    for (;;) {
+        pthread_mutex_lock(&conv.lock);
+        size_t i = conv.next_job++;
+        bool stop = i >= conv.num_jobs || conv.failed;
+        pthread_mutex_unlock(&conv.lock);
+        if (stop)
+            return NULL;
+
+        bool ok = convert_tile(i);
+        pthread_mutex_lock(&conv.lock);
+        if (!ok)
+            conv.failed = true;
+        else if (conv.jobs[i].old < 0)
+            conv.decoded++;
+        else
+            conv.copied++;
+        pthread_mutex_unlock(&conv.lock);
+    }
+}
+
+static int job_cmp(const void *a, const void *b) {
+    const struct job *ja = a, *jb = b;
+    if (ja->lat != jb->lat)
+        return ja->lat - jb->lat;
+    return ja->lon - jb->lon;
+}
+
+static char *join(const char *dir, const char *name) {
+    char *path = malloc(strlen(dir) + strlen(name) + 2);
+    sprintf(path, "%s/%s", dir, name);
+    return path;
+}
+
+static bool newer(const char *path, const struct timespec *than) {
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return true;
+    return st.st_mtim.tv_sec > than->tv_sec ||
+           (st.st_mtim.tv_sec == than->tv_sec && st.st_mtim.tv_nsec > than->tv_nsec);
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: tdbconv [-j threads] [-o out.tdb] [--region lat0:lat1,lon0:lon1] "
+                    "[--update] [--compress] [data_dir]\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    const char *out_path = "terrain.tdb";
+    const char *data_dir = "data";
+    int lat0 = -90, lat1 = 90, lon0 = -180, lon1 = 180;
+    bool update = false;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    static struct option long_opts[] = {
+        {"region", required_argument, 0, 'r'},
+        {"update", no_argument, 0, 'u'},
+        {"compress", no_argument, 0, 'z'},
+        {0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "j:o:z", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'j':
+            threads = atol(optarg);
+            break;
+        case 'o':
+            out_path = optarg;
+            break;
+        case 'r':
+            if (sscanf(optarg, "%d:%d,%d:%d", &lat0, &lat1, &lon0, &lon1) != 4)
+                usage();
+            break;
+        case 'u':
+            update = true;
+            break;
+        case 'z':
+            conv.compress = true;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind < argc)
+        data_dir = argv[optind++];
+    if (optind < argc)
+        usage();
+    threads = threads < 1 ? 1 : threads > MAX_THREADS ? MAX_THREADS : threads;
+
+    // previous output for --update, modification time decides what is stale
+    struct stat old_st;
+    conv.old = (struct tdb){.fd = -1};
+    if (update && stat(out_path, &old_st) == 0 && !tdb_open(&conv.old, out_path))
+        return 1;
+
+    DIR *dir = opendir(data_dir);
+    if (!dir) {
+        fprintf(stderr, "Failed to open %s\n", data_dir);
+        return 1;
+    }
+    size_t cap = 0;
+    struct dirent *d;
+    while ((d = readdir(dir))) {
+        int lat, lon;
+        if (!parse_name(d->d_name, &lat, &lon) || lat < lat0 || lat > lat1 || lon < lon0 ||
+            lon > lon1)
+            continue;
+        if (conv.num_jobs == cap) {
+            cap = cap ? cap * 2 : 64;
+            conv.jobs = realloc(conv.jobs, sizeof(struct job) * cap);
+        }
+        char *wbm_name = strdup(d->d_name);
+        memcpy(strstr(wbm_name, "_00_DEM") + 4, "WBM", 3);
+        struct job *j = &conv.jobs[conv.num_jobs++];
+        *j = (struct job){.lat = lat, .lon = lon, .old = -1};
+        j->dem = join(data_dir, d->d_name);
+        j->wbm = join(data_dir, wbm_name);
+        free(wbm_name);
+
+        long old = conv.old.map ? tdb_find(&conv.old, lat, lon) : -1;
+        if (old >= 0 && !newer(j->dem, &old_st.st_mtim) && !newer(j->wbm, &old_st.st_mtim))
+            j->old = old;
+    }
+    closedir(dir);
+
+    // tiles of the old database this run has no source for are carried over
+    qsort(conv.jobs, conv.num_jobs, sizeof(struct job), job_cmp);
+    size_t num_sources = conv.num_jobs;
+    for (size_t i = 0; i < conv.old.num_tiles; i++) {
+        const struct tdb_entry *e = &conv.old.entries[i];
+        struct job key = {.lat = e->lat, .lon = e->lon};
+        if (bsearch(&key, conv.jobs, num_sources, sizeof(struct job), job_cmp))
+            continue;
+        if (conv.num_jobs == cap) {
+            cap = cap ? cap * 2 : 64;
+            conv.jobs = realloc(conv.jobs, sizeof(struct job) * cap);
+        }
+        conv.jobs[conv.num_jobs++] = (struct job){.lat = e->lat, .lon = e->lon, .old = i};
+    }
+    qsort(conv.jobs, conv.num_jobs, sizeof(struct job), job_cmp);
+    for (size_t i = 1; i < conv.num_jobs; i++) {
+        if (job_cmp(&conv.jobs[i - 1], &conv.jobs[i]) == 0) {
+            fprintf(stderr, "tdbconv: duplicate tile %d,%d\n", conv.jobs[i].lat,
+                    conv.jobs[i].lon);
+            return 1;
+        }
+    }
+
+    // the old database stays mapped while the new one is written beside it
+    char *tmp_path = malloc(strlen(out_path) + 5);
+    sprintf(tmp_path, "%s.tmp", out_path);
+    conv.fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (conv.fd < 0) {
+        fprintf(stderr, "Failed to create %s\n", tmp_path);
+        return 1;
+    }
+    conv.entries = calloc(conv.num_jobs, sizeof(struct tdb_entry));
+    conv.end = page_align(sizeof(struct tdb_header));
+
+    pthread_t pool[MAX_THREADS];
+    for (long t = 0; t < threads; t++)
+        pthread_create(&pool[t], NULL, worker, NULL);
+    for (long t = 0; t < threads; t++)
+        pthread_join(pool[t], NULL);
+
+    struct tdb_header h = {
+        .magic = TDB_MAGIC,
+        .version = TDB_VERSION,
+        .num_tiles = conv.num_jobs,
+        .entry_size = sizeof(struct tdb_entry),
+        .dir_offset = conv.end,
+    };
+    bool ok = !conv.failed &&
+              write_all(conv.entries, sizeof(struct tdb_entry) * conv.num_jobs, h.dir_offset) &&
+              write_all(&h, sizeof(h), 0);
+    ok = close(conv.fd) == 0 && ok;
+    if (!ok || rename(tmp_path, out_path) != 0) {
+        fprintf(stderr, "tdbconv: failed to write %s\n", out_path);
+        unlink(tmp_path);
+        return 1;
+    }
+    printf("%s: %zu tiles, %zu decoded, %zu copied, payloads %.1f MB (%.2fx)\n", out_path,
+           conv.num_jobs, conv.decoded, conv.copied, conv.payload_bytes / 1e6,
+           conv.payload_bytes ? (double)conv.raw_bytes / conv.payload_bytes : 0.0);
+
+    tdb_close(&conv.old);
+    for (size_t i = 0; i < conv.num_jobs; i++) {
+        free(conv.jobs[i].dem);
+        free(conv.jobs[i].wbm);
+    }
+    free(conv.jobs);
+    free(conv.entries);
+    free(tmp_path);
+    return 0;
+}
@@ -0,0 +1,327 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include <immintrin.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "tdb.h"
+
+// CPU-side terrain height and slope queries.
+//
+// Tiles are found through a one degree grid over the whole globe, so a
+// lookup is a couple of multiplies and one load. Heights are interpolated
+// bilinearly between the four samples around a point, with the same sample
+// placement as terrain.vs. Raw tiles are read straight from the database
+// mapping; encoded ones are decoded on first use and kept until
+// terrain_trim() drops them. Normals are the ones the renderer shades with,
+// tdb_build_normals() of the base with the neighbours' halos, built per tile
+// on the first normal or slope query and dropped alike. Queries may run on
+// any number of threads.
+
+#define TERRAIN_GRID_LAT 180
+#define TERRAIN_GRID_LON 360
+
+struct terrain_tile {
+    _Atomic(int16_t *) samples; // decoded copy of an encoded tile, or NULL
+    _Atomic(uint8_t *) normals; // encoded normals of the base, or NULL
+    atomic_int readers;
+};
+
+typedef void (*terrain_sample_fn)(const int16_t *s, const struct tdb_entry *e, const double *lat,
+                                  const double *lon, float *out, size_t n);
+
+struct terrain {
+    const struct tdb *db;
+    int32_t *grid; // tile index per one degree cell, -1 where there is none
+    struct terrain_tile *tiles;
+    pthread_mutex_t lock; // serializes decoding and building normals
+    terrain_sample_fn sample;
+};
+
+// Grid cell of the tile holding (lat, lon) in degrees; tiles are keyed by
+// their north-west corner.
+static inline long terrain_cell(double lat, double lon) {
+    int row = (int)floor(lat) + 1 + 89; // key lat -89..90
+    int col = (int)floor(lon) + 180;    // key lon -180..179
+    if (row < 0 || row >= TERRAIN_GRID_LAT || col < 0 || col >= TERRAIN_GRID_LON)
+        return -1;
+    return (long)row * TERRAIN_GRID_LON + col;
+}
+
+static inline int terrain_tile_at(const struct terrain *t, double lat, double lon) {
+    long cell = terrain_cell(lat, lon);
+    return cell >= 0 ? t->grid[cell] : -1;
+}
+
+// Index of the tile whose north-west corner is (lat, lon), or -1.
+static inline int terrain_tile_keyed(const struct terrain *t, int lat, int lon) {
+    return terrain_tile_at(t, lat - 0.5, lon + 0.5);
+}
+
+// Samples of tile i, held until terrain_release(). NULL, and not held, if
+// there is no memory to decode it into.
+const int16_t *terrain_acquire(struct terrain *t, int i) {
+    const struct tdb *db = t->db;
+    if (db->entries[i].encoding == TDB_ENCODING_RAW)
+        return tdb_tile_data(db, i);
+
+    struct terrain_tile *tt = &t->tiles[i];
+    atomic_fetch_add(&tt->readers, 1);
+    int16_t *s = atomic_load(&tt->samples);
+    if (s)
+        return s;
+
+    pthread_mutex_lock(&t->lock);
+    s = atomic_load(&tt->samples);
+    if (!s) {
+        const struct tdb_entry *e = &db->entries[i];
+        s = malloc((size_t)e->xres * e->yres * sizeof(int16_t));
+        if (!s) {
+            fprintf(stderr, "terrain: no memory to decode tile %d,%d\n", e->lat, e->lon);
+            atomic_fetch_sub(&tt->readers, 1);
+        } else {
+            if (!tdb_read_tile(db, i, s))
+                memset(s, 0, (size_t)e->xres * e->yres * sizeof(int16_t));
+            atomic_store(&tt->samples, s);
+        }
+    }
+    pthread_mutex_unlock(&t->lock);
+    return s;
+}
+
+void terrain_release(struct terrain *t, int i) {
+    if (t->db->entries[i].encoding != TDB_ENCODING_RAW)
+        atomic_fetch_sub(&t->tiles[i].readers, 1);
+}
+
+// Normals of tile i, held until terrain_release_normals(). NULL, and not
+// held, if there is no memory to build them in.
+const uint8_t *terrain_acquire_normals(struct terrain *t, int i) {
+    struct terrain_tile *tt = &t->tiles[i];
+    atomic_fetch_add(&tt->readers, 1);
+    uint8_t *n = atomic_load(&tt->normals);
+    if (n)
+        return n;
+
+    const int16_t *s = terrain_acquire(t, i);
+    if (!s) {
+        atomic_fetch_sub(&tt->readers, 1);
+        return NULL;
+    }
+    pthread_mutex_lock(&t->lock);
+    n = atomic_load(&tt->normals);
+    if (!n) {
+        const struct tdb *db = t->db;
+        const struct tdb_entry *e = &db->entries[i];
+        // the neighbour across each side, seen from its side facing this tile
+        static const enum tdb_side facing[] = {TDB_SOUTH, TDB_NORTH, TDB_EAST, TDB_WEST};
+        int west = e->lon > -180 ? e->lon - 1 : 179, east = e->lon < 179 ? e->lon + 1 : -180;
+        int neighbor[] = {terrain_tile_keyed(t, e->lat + 1, e->lon),
+                          terrain_tile_keyed(t, e->lat - 1, e->lon),
+                          terrain_tile_keyed(t, e->lat, west), terrain_tile_keyed(t, e->lat, east)};
+        struct tdb_line halo[1][4] = {0};
+        for (int side = 0; side < 4; side++)
+            if (neighbor[side] >= 0)
+                tdb_inner_line(db, neighbor[side], 0, facing[side], &halo[0][side]);
+        n = malloc((size_t)e->xres * e->yres * TDB_NORMAL_BYTES);
+        if (!n) {
+            fprintf(stderr, "terrain: no memory for the normals of tile %d,%d\n", e->lat, e->lon);
+            atomic_fetch_sub(&tt->readers, 1);
+        } else {
+            tdb_build_normals(s, NULL, e->xres, e->yres, e->lat, halo, n);
+            atomic_store(&tt->normals, n);
+        }
+    }
+    pthread_mutex_unlock(&t->lock);
+    terrain_release(t, i);
+    return n;
+}
+
+void terrain_release_normals(struct terrain *t, int i) {
+    atomic_fetch_sub(&t->tiles[i].readers, 1);
+}
+
+static void terrain_sample_scalar(const int16_t *s, const struct tdb_entry *e, const double *lat,
+                                  const double *lon, float *out, size_t n) {
+    for (size_t k = 0; k < n; k++) {
+        double x = (lon[k] - e->lon) * (e->xres - 1);
+        double y = (e->lat - lat[k]) * (e->yres - 1);
+        x = x < 0 ? 0 : x > e->xres - 1 ? e->xres - 1 : x;
+        y = y < 0 ? 0 : y > e->yres - 1 ? e->yres - 1 : y;
+        int x0 = x, y0 = y;
+        int x1 = x0 + 1 < e->xres ? x0 + 1 : x0;
+        int y1 = y0 + 1 < e->yres ? y0 + 1 : y0;
+        double fx = x - x0, fy = y - y0;
+        const int16_t *r0 = s + (size_t)y0 * e->xres, *r1 = s + (size_t)y1 * e->xres;
+        double a = (r0[x0] >> 1) + ((r0[x1] >> 1) - (r0[x0] >> 1)) * fx;
+        double b = (r1[x0] >> 1) + ((r1[x1] >> 1) - (r1[x0] >> 1)) * fx;
+        out[k] = (a + (b - a) * fy) * 0.001;
+    }
+}
+
+// Four points at a time. One 32-bit gather at a sample picks up its east
+// neighbour in the high half, so two gathers fetch all four corners.
+__attribute__((target("avx2,fma"))) static void
+terrain_sample_avx2(const int16_t *s, const struct tdb_entry *e, const double *lat,
+                    const double *lon, float *out, size_t n) {
+    if (e->xres < 2 || e->yres < 2) {
+        terrain_sample_scalar(s, e, lat, lon, out, n);
+        return;
+    }
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d xmax = _mm256_set1_pd(e->xres - 1), ymax = _mm256_set1_pd(e->yres - 1);
+    const __m256d x0max = _mm256_set1_pd(e->xres - 2), y0max = _mm256_set1_pd(e->yres - 2);
+    const __m256d lon0 = _mm256_set1_pd(e->lon), lat0 = _mm256_set1_pd(e->lat);
+    const __m128i stride = _mm_set1_epi32(e->xres);
+    size_t k = 0;
+    for (; k + 4 <= n; k += 4) {
+        __m256d x = _mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(lon + k), lon0), xmax);
+        __m256d y = _mm256_mul_pd(_mm256_sub_pd(lat0, _mm256_loadu_pd(lat + k)), ymax);
+        x = _mm256_min_pd(_mm256_max_pd(x, zero), xmax);
+        y = _mm256_min_pd(_mm256_max_pd(y, zero), ymax);
+        // the last row and column interpolate from the one before with f = 1
+        __m256d x0 = _mm256_min_pd(_mm256_floor_pd(x), x0max);
+        __m256d y0 = _mm256_min_pd(_mm256_floor_pd(y), y0max);
+        __m256d fx = _mm256_sub_pd(x, x0), fy = _mm256_sub_pd(y, y0);
+
+        __m128i idx = _mm_add_epi32(_mm_mullo_epi32(_mm256_cvtpd_epi32(y0), stride),
+                                    _mm256_cvtpd_epi32(x0));
+        __m128i top = _mm_i32gather_epi32((const int *)s, idx, 2);
+        __m128i bot = _mm_i32gather_epi32((const int *)s, _mm_add_epi32(idx, stride), 2);
+        // low half is the sample itself, high half its east neighbour; >> 17
+        // drops the water bit along with the other half
+        __m256d h00 = _mm256_cvtepi32_pd(_mm_srai_epi32(_mm_slli_epi32(top, 16), 17));
+        __m256d h01 = _mm256_cvtepi32_pd(_mm_srai_epi32(top, 17));
+        __m256d h10 = _mm256_cvtepi32_pd(_mm_srai_epi32(_mm_slli_epi32(bot, 16), 17));
+        __m256d h11 = _mm256_cvtepi32_pd(_mm_srai_epi32(bot, 17));
+
+        __m256d a = _mm256_fmadd_pd(_mm256_sub_pd(h01, h00), fx, h00);
+        __m256d b = _mm256_fmadd_pd(_mm256_sub_pd(h11, h10), fx, h10);
+        __m256d h = _mm256_fmadd_pd(_mm256_sub_pd(b, a), fy, a);
+        _mm_storeu_ps(out + k, _mm256_cvtpd_ps(_mm256_mul_pd(h, _mm256_set1_pd(0.001))));
+    }
+    // GCC tail-calls the scalar version without a vzeroupper, leaving every
+    // SSE instruction after the return to pay for the dirty upper halves
+    _mm256_zeroupper();
+    terrain_sample_scalar(s, e, lat + k, lon + k, out + k, n - k);
+}
+
+bool terrain_init(struct terrain *t, const struct tdb *db) {
+    *t = (struct terrain){.db = db};
+    t->grid = malloc(sizeof(int32_t) * TERRAIN_GRID_LAT * TERRAIN_GRID_LON);
+    for (int i = 0; i < TERRAIN_GRID_LAT * TERRAIN_GRID_LON; i++)
+        t->grid[i] = -1;
+    for (size_t i = 0; i < db->num_tiles; i++) {
+        const struct tdb_entry *e = &db->entries[i];
+        long cell = terrain_cell(e->lat - 0.5, e->lon + 0.5);
+        if (cell < 0) {
+            fprintf(stderr, "terrain: tile %d,%d is off the globe\n", e->lat, e->lon);
+            continue;
+        }
+        t->grid[cell] = i;
+    }
+    t->tiles = calloc(db->num_tiles ? db->num_tiles : 1, sizeof(struct terrain_tile));
+    pthread_mutex_init(&t->lock, NULL);
+    t->sample = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")
+                    ? terrain_sample_avx2
+                    : terrain_sample_scalar;
+    return true;
+}
+
+void terrain_destroy(struct terrain *t) {
+    for (size_t i = 0; t->tiles && i < t->db->num_tiles; i++) {
+        free(atomic_load(&t->tiles[i].samples));
+        free(atomic_load(&t->tiles[i].normals));
+    }
+    free(t->tiles);
+    free(t->grid);
+    pthread_mutex_destroy(&t->lock);
+    *t = (struct terrain){0};
+}
+
+// Free decoded tiles and normals whose tile center is more than radius
+// degrees from (lat, lon). Waits for queries still reading them.
+void terrain_trim(struct terrain *t, double lat, double lon, double radius) {
+    for (size_t i = 0; i < t->db->num_tiles; i++) {
+        const struct tdb_entry *e = &t->db->entries[i];
+        if (fabs(e->lat - 0.5 - lat) <= radius && fabs(e->lon + 0.5 - lon) <= radius)
+            continue;
+        int16_t *s = atomic_exchange(&t->tiles[i].samples, NULL);
+        uint8_t *n = atomic_exchange(&t->tiles[i].normals, NULL);
+        if (!s && !n)
+            continue;
+        while (atomic_load(&t->tiles[i].readers) > 0)
+            sched_yield();
+        free(s);
+        free(n);
+    }
+}
+
+// Terrain height in km at (lat, lon) in degrees, NAN where there is no tile
+// or it cannot be read.
+float terrain_height_at(struct terrain *t, double lat, double lon) {
+    int i = terrain_tile_at(t, lat, lon);
+    const int16_t *s = i >= 0 ? terrain_acquire(t, i) : NULL;
+    if (!s)
+        return NAN;
+    float h;
+    terrain_sample_scalar(s, &t->db->entries[i], &lat, &lon, &h, 1);
+    terrain_release(t, i);
+    return h;
+}
+
+// Unit surface normal, east, up, south, at (lat, lon) in degrees from the
+// nearest sample, as terrain.vs picks it. Returns false where there is no
+// tile or its normals cannot be built.
+bool terrain_normal_at(struct terrain *t, double lat, double lon, float n[3]) {
+    int i = terrain_tile_at(t, lat, lon);
+    if (i < 0)
+        return false;
+    const struct tdb_entry *e = &t->db->entries[i];
+    double x = (lon - e->lon) * (e->xres - 1), y = (e->lat - lat) * (e->yres - 1);
+    int px = lround(x < 0 ? 0 : x > e->xres - 1 ? e->xres - 1 : x);
+    int py = lround(y < 0 ? 0 : y > e->yres - 1 ? e->yres - 1 : y);
+    const uint8_t *normals = terrain_acquire_normals(t, i);
+    if (!normals)
+        return false;
+    tdb_normal_decode(normals + ((size_t)py * e->xres + px) * TDB_NORMAL_BYTES, n);
+    terrain_release_normals(t, i);
+    return true;
+}
+
+// Ground slope in radians from the horizontal at (lat, lon) in degrees, NAN
+// where terrain_normal_at() has none.
+float terrain_slope_at(struct terrain *t, double lat, double lon) {
+    float n[3];
+    if (!terrain_normal_at(t, lat, lon, n))
+        return NAN;
+    return acosf(fminf(n[1], 1));
+}
+
+// terrain_height_at() for n points. Runs of neighbouring points in the same
+// tile, as along a path, are sampled together with SIMD where available.
+void terrain_heights(struct terrain *t, const double *lat, const double *lon, float *out,
+                     size_t n) {
+    size_t k = 0;
+    while (k < n) {
+        int i = terrain_tile_at(t, lat[k], lon[k]);
+        size_t end = k + 1;
+        while (end < n && terrain_tile_at(t, lat[end], lon[end]) == i)
+            end++;
+        const int16_t *s = i >= 0 ? terrain_acquire(t, i) : NULL;
+        if (!s) {
+            for (size_t j = k; j < end; j++)
+                out[j] = NAN;
+        } else {
+            t->sample(s, &t->db->entries[i], lat + k, lon + k, out + k, end - k);
+            terrain_release(t, i);
+        }
+        k = end;
+    }
+}
+
+#endif
@@ -0,0 +1,496 @@
+#ifndef TILE_CACHE_H
+#define TILE_CACHE_H
+
+#include <GL/glew.h>
+#include <cglm/util.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tdb.h"
+
+// Tile residency manager.
+//
+// Worker threads prepare tiles near the aircraft, heights and precomputed
+// normals, straight into pixel unpack buffers that the render thread keeps
+// mapped. Once per frame tile_cache_update() unmaps the finished buffers and
+// copies them into a fixed number of slots, the layers of a pair of 2D array
+// textures sized for the largest tile, spending at most upload_budget bytes.
+// When all slots are taken the least recently used tile is evicted; ties go
+// to the tile furthest from the prefetch center, which leads the aircraft, so
+// tiles behind it are the first to go.
+//
+// Normals along a tile's edges take a halo from the neighbouring tiles, found
+// through an adjacency table built once at startup.
+
+#define TILE_CACHE_STAGING 4
+#define TILE_CACHE_MAX_WORKERS 4
+#define TILE_CACHE_STALE_FRAMES 120 // drop queued tiles nobody asked for since
+
+enum tile_state { TILE_ABSENT, TILE_QUEUED, TILE_LOADING, TILE_RESIDENT };
+enum staging_state { STAGING_UNMAPPED, STAGING_MAPPED, STAGING_FILLING, STAGING_FILLED };
+
+struct tile_cache_stats {
+    uint64_t hits, misses, evictions, uploads, upload_bytes;
+};
+
+struct tile_slot {
+    int tile;           // -1 when free
+    uint64_t last_used; // frame number
+};
+
+struct staging_buffer {
+    enum staging_state state;
+    int tile;
+    GLuint pbo;
+    void *ptr;
+};
+
+struct tile_job {
+    int tile;
+    float priority; // lower is sooner
+};
+
+struct tile_cache {
+    const struct tdb *db;
+    int capacity;
+    struct tile_slot *slots;
+    GLuint tex;        // GL_TEXTURE_2D_ARRAY, one layer per slot
+    GLuint normal_tex; // same layout, RG8 encoded normals, see tdb_build_normals()
+    int xres, yres, levels;
+    int *slot_of;            // per tile, -1 when not resident
+    int32_t (*neighbors)[4]; // per tile, by enum tdb_side, -1 where there is none
+    uint8_t *state;          // per tile, enum tile_state
+    uint64_t *wanted;        // per tile, last frame it was requested
+
+    struct tile_job *jobs;
+    int num_jobs;
+    struct staging_buffer staging[TILE_CACHE_STAGING];
+    size_t staging_size;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t workers[TILE_CACHE_MAX_WORKERS];
+    int num_workers;
+    bool quit;
+
+    size_t upload_budget; // bytes per frame
+    uint64_t frame;
+    float center_lat, center_lon;
+    struct tile_cache_stats stats;
+};
+
+static float tile_cache_distance(const struct tile_cache *c, int tile) {
+    const struct tdb_entry *e = &c->db->entries[tile];
+    float dlat = (e->lat - 0.5f) - c->center_lat;
+    float dlon = ((e->lon + 0.5f) - c->center_lon) * cosf(glm_rad(c->center_lat));
+    return sqrtf(dlat * dlat + dlon * dlon);
+}
+
+// Samples in the base level plus average mip levels of a tile.
+static size_t tile_cache_tile_samples(const struct tdb_entry *e) {
+    return (size_t)e->xres * e->yres + tdb_pyramid_samples(e->xres, e->yres);
+}
+
+// Bytes staged for a tile: heights, then normals.
+static size_t tile_cache_tile_size(const struct tdb_entry *e) {
+    return tile_cache_tile_samples(e) * (sizeof(int16_t) + TDB_NORMAL_BYTES);
+}
+
+// Fill dst with everything the render thread needs to upload tile i: the base
+// level followed by the average levels, built here if the database has none,
+// and then the normals of all of them.
+static void tile_cache_prepare(const struct tile_cache *c, int i, void *dst) {
+    const struct tdb *db = c->db;
+    const struct tdb_entry *e = &db->entries[i];
+    size_t base = (size_t)e->xres * e->yres;
+    if (!tdb_read_tile(db, i, dst))
+        memset(dst, 0, base * sizeof(int16_t)); // sea level rather than garbage
+    int16_t *avg = (int16_t *)dst + base;
+    if (e->levels)
+        memcpy(avg, tdb_pyramid(db, i, TDB_PYRAMID_AVG, 1),
+               tdb_pyramid_samples(e->xres, e->yres) * sizeof(int16_t));
+    else
+        tdb_build_pyramid(dst, e->xres, e->yres, avg, NULL, NULL);
+
+    // the neighbour across each side, seen from its side facing this tile
+    static const enum tdb_side facing[] = {TDB_SOUTH, TDB_NORTH, TDB_EAST, TDB_WEST};
+    struct tdb_line halo[16][4] = {0}; // levels of int16 sized tiles
+    for (int side = 0; side < 4; side++) {
+        int n = c->neighbors[i][side];
+        for (int l = 0; n >= 0 && l <= tdb_pyramid_levels(e->xres, e->yres); l++)
+            tdb_inner_line(db, n, l, facing[side], &halo[l][side]);
+    }
+    uint8_t *normals = (uint8_t *)dst + tile_cache_tile_samples(e) * sizeof(int16_t);
+    tdb_build_normals(dst, avg, e->xres, e->yres, e->lat, halo, normals);
+}
+
+// Called with the lock held. Returns the index of the best job or -1.
+static int tile_cache_next_job(struct tile_cache *c) {
+    int best = -1;
+    for (int j = 0; j < c->num_jobs; j++) {
+        struct tile_job *job = &c->jobs[j];
+        if (c->frame > c->wanted[job->tile] + TILE_CACHE_STALE_FRAMES) {
+            c->state[job->tile] = TILE_ABSENT;
+            c->jobs[j--] = c->jobs[--c->num_jobs];
+            continue;
+        }
+        if (best < 0 || job->priority < c->jobs[best].priority)
+            best = j;
+    }
+    return best;
+}
+
+static void *tile_cache_worker(void *arg) {
+    struct tile_cache *c = arg;
+
+    pthread_mutex_lock(&c->lock);
+    while (!c->quit) {
+        struct staging_buffer *sb = NULL;
+        for (int s = 0; s < TILE_CACHE_STAGING && !sb; s++)
+            if (c->staging[s].state == STAGING_MAPPED)
+                sb = &c->staging[s];
+        int j = sb ? tile_cache_next_job(c) : -1;
+        if (j < 0) {
+            pthread_cond_wait(&c->cond, &c->lock);
+            continue;
+        }
+
+        int tile = c->jobs[j].tile;
+        c->jobs[j] = c->jobs[--c->num_jobs];
+        c->state[tile] = TILE_LOADING;
+        sb->state = STAGING_FILLING;
+        sb->tile = tile;
+        pthread_mutex_unlock(&c->lock);
+
+        tile_cache_prepare(c, tile, sb->ptr);
+
+        pthread_mutex_lock(&c->lock);
+        sb->state = STAGING_FILLED;
+    }
+    pthread_mutex_unlock(&c->lock);
+    return NULL;
+}
+
+void tile_cache_init(struct tile_cache *c, const struct tdb *db, int capacity) {
+    *c = (struct tile_cache){
+        .db = db,
+        .capacity = capacity,
+        .upload_budget = 8 << 20,
+    };
+    c->slots = malloc(sizeof(struct tile_slot) * capacity);
+    for (int i = 0; i < capacity; i++)
+        c->slots[i] = (struct tile_slot){.tile = -1};
+
+    size_t n = db->num_tiles;
+    c->slot_of = malloc(sizeof(int) * n);
+    for (size_t i = 0; i < n; i++)
+        c->slot_of[i] = -1;
+    c->state = calloc(n, sizeof(uint8_t));
+    c->wanted = calloc(n, sizeof(uint64_t));
+    c->jobs = malloc(sizeof(struct tile_job) * (n ? n : 1));
+    c->neighbors = malloc(sizeof(*c->neighbors) * (n ? n : 1));
+    for (size_t i = 0; i < n; i++) {
+        const struct tdb_entry *e = &db->entries[i];
+        int west = e->lon > -180 ? e->lon - 1 : 179, east = e->lon < 179 ? e->lon + 1 : -180;
+        c->neighbors[i][TDB_NORTH] = tdb_find(db, e->lat + 1, e->lon);
+        c->neighbors[i][TDB_SOUTH] = tdb_find(db, e->lat - 1, e->lon);
+        c->neighbors[i][TDB_WEST] = tdb_find(db, e->lat, west);
+        c->neighbors[i][TDB_EAST] = tdb_find(db, e->lat, east);
+    }
+
+    c->xres = c->yres = 1;
+    for (size_t i = 0; i < n; i++) {
+        const struct tdb_entry *e = &db->entries[i];
+        size_t sz = tile_cache_tile_size(e);
+        if (sz > c->staging_size)
+            c->staging_size = sz;
+        c->xres = e->xres > c->xres ? e->xres : c->xres;
+        c->yres = e->yres > c->yres ? e->yres : c->yres;
+    }
+
+    c->levels = tdb_pyramid_levels(c->xres, c->yres);
+    glGenTextures(1, &c->tex);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, c->tex);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, c->levels);
+    for (int l = 0; l <= c->levels; l++) {
+        int w, h;
+        tdb_level_dims(c->xres, c->yres, l, &w, &h);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, l, GL_R16I, w, h, capacity, 0, GL_RED_INTEGER,
+                     GL_SHORT, NULL);
+    }
+    glGenTextures(1, &c->normal_tex);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, c->normal_tex);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, c->levels);
+    for (int l = 0; l <= c->levels; l++) {
+        int w, h;
+        tdb_level_dims(c->xres, c->yres, l, &w, &h);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, l, GL_RG8, w, h, capacity, 0, GL_RG, GL_UNSIGNED_BYTE,
+                     NULL);
+    }
+    for (int s = 0; s < TILE_CACHE_STAGING; s++) {
+        glGenBuffers(1, &c->staging[s].pbo);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, c->staging[s].pbo);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, c->staging_size, NULL, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->cond, NULL);
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+    c->num_workers = cpus < 1 ? 1 : cpus > TILE_CACHE_MAX_WORKERS ? TILE_CACHE_MAX_WORKERS : cpus;
+    for (int i = 0; i < c->num_workers; i++)
+        pthread_create(&c->workers[i], NULL, tile_cache_worker, c);
+}
+
+void tile_cache_destroy(struct tile_cache *c) {
+    pthread_mutex_lock(&c->lock);
+    c->quit = true;
+    pthread_cond_broadcast(&c->cond);
+    pthread_mutex_unlock(&c->lock);
+    for (int i = 0; i < c->num_workers; i++)
+        pthread_join(c->workers[i], NULL);
+
+    for (int s = 0; s < TILE_CACHE_STAGING; s++) {
+        if (c->staging[s].ptr) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, c->staging[s].pbo);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+        glDeleteBuffers(1, &c->staging[s].pbo);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteTextures(1, &c->tex);
+    glDeleteTextures(1, &c->normal_tex);
+
+    pthread_cond_destroy(&c->cond);
+    pthread_mutex_destroy(&c->lock);
+    free(c->slots);
+    free(c->slot_of);
+    free(c->state);
+    free(c->wanted);
+    free(c->jobs);
+    free(c->neighbors);
+}
+
+// Called with the lock held.
+static void tile_cache_request(struct tile_cache *c, int tile, float priority) {
+    c->wanted[tile] = c->frame;
+    switch (c->state[tile]) {
+    case TILE_ABSENT:
+        c->jobs[c->num_jobs++] = (struct tile_job){tile, priority};
+        c->state[tile] = TILE_QUEUED;
+        pthread_cond_signal(&c->cond);
+        break;
+    case TILE_QUEUED:
+        for (int j = 0; j < c->num_jobs; j++)
+            if (c->jobs[j].tile == tile && priority < c->jobs[j].priority)
+                c->jobs[j].priority = priority;
+        break;
+    case TILE_RESIDENT:
+        c->slots[c->slot_of[tile]].last_used = c->frame;
+        break;
+    default:
+        break;
+    }
+}
+
+// Queue every tile within radius degrees of a point lookahead degrees ahead of
+// (lat, lon) along the (north, east) ground track.
+void tile_cache_prefetch(struct tile_cache *c, float lat, float lon, float north, float east,
+                         float lookahead, float radius) {
+    float len = sqrtf(north * north + east * east);
+    if (len > 1e-6f) {
+        lat += north / len * lookahead;
+        lon += east / len * lookahead / cosf(glm_rad(lat));
+    }
+
+    pthread_mutex_lock(&c->lock);
+    c->center_lat = lat;
+    c->center_lon = lon;
+    int r = (int)ceilf(radius);
+    for (int tlat = (int)floorf(lat) + 1 - r; tlat <= (int)floorf(lat) + 1 + r; tlat++) {
+        for (int tlon = (int)floorf(lon) - r; tlon <= (int)floorf(lon) + r; tlon++) {
+            long tile = tdb_find(c->db, tlat, tlon);
+            if (tile < 0)
+                continue;
+            float d = tile_cache_distance(c, tile);
+            if (d < radius)
+                tile_cache_request(c, tile, d);
+        }
+    }
+    pthread_mutex_unlock(&c->lock);
+}
+
+// Array layer holding tile i, or -1 if it is not resident yet, in which case
+// it is queued ahead of prefetched tiles at a similar distance.
+int tile_cache_get(struct tile_cache *c, int tile) {
+    int slot = c->slot_of[tile];
+    if (slot >= 0) {
+        c->slots[slot].last_used = c->frame;
+        c->stats.hits++;
+        return slot;
+    }
+    c->stats.misses++;
+    pthread_mutex_lock(&c->lock);
+    tile_cache_request(c, tile, tile_cache_distance(c, tile) * 0.5f);
+    pthread_mutex_unlock(&c->lock);
+    return -1;
+}
+
+// Layer of a resident tile without touching the statistics, or -1.
+int tile_cache_layer(const struct tile_cache *c, int tile) { return c->slot_of[tile]; }
+
+static int tile_cache_pick_slot(struct tile_cache *c) {
+    int best = -1;
+    float best_dist = 0;
+    for (int i = 0; i < c->capacity; i++) {
+        struct tile_slot *s = &c->slots[i];
+        if (s->tile < 0)
+            return i;
+        // anything drawn or prefetched last frame is still wanted
+        if (s->last_used + 1 >= c->frame)
+            continue;
+        float d = tile_cache_distance(c, s->tile);
+        if (best < 0 || s->last_used < c->slots[best].last_used ||
+            (s->last_used == c->slots[best].last_used && d > best_dist)) {
+            best = i;
+            best_dist = d;
+        }
+    }
+    return best;
+}
+
+// Returns the number of bytes uploaded.
+static size_t tile_cache_upload(struct tile_cache *c, struct staging_buffer *sb) {
+    const struct tdb_entry *e = &c->db->entries[sb->tile];
+    size_t bytes = tile_cache_tile_size(e);
+    int slot = tile_cache_pick_slot(c);
+    if (slot < 0)
+        return 0;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, sb->pbo);
+    bool intact = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    sb->ptr = NULL;
+
+    pthread_mutex_lock(&c->lock);
+    struct tile_slot *s = &c->slots[slot];
+    if (s->tile >= 0) {
+        c->slot_of[s->tile] = -1;
+        c->state[s->tile] = TILE_ABSENT;
+        c->stats.evictions++;
+    }
+    s->tile = -1;
+    if (intact) {
+        s->tile = sb->tile;
+        s->last_used = c->frame;
+        c->slot_of[sb->tile] = slot;
+        c->state[sb->tile] = TILE_RESIDENT;
+    } else {
+        c->state[sb->tile] = TILE_ABSENT; // contents lost, ask again next frame
+    }
+    sb->state = STAGING_UNMAPPED;
+    pthread_mutex_unlock(&c->lock);
+
+    if (intact) {
+        // heights, then normals with the same layout
+        GLuint tex[] = {c->tex, c->normal_tex};
+        GLenum format[] = {GL_RED_INTEGER, GL_RG}, type[] = {GL_SHORT, GL_UNSIGNED_BYTE};
+        size_t texel[] = {sizeof(int16_t), TDB_NORMAL_BYTES};
+        size_t start[] = {0, tile_cache_tile_samples(e) * sizeof(int16_t)};
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+        for (int t = 0; t < 2; t++) {
+            glBindTexture(GL_TEXTURE_2D_ARRAY, tex[t]);
+            for (int l = 0; l <= tdb_pyramid_levels(e->xres, e->yres); l++) {
+                int w, h;
+                tdb_level_dims(e->xres, e->yres, l, &w, &h);
+                size_t off =
+                    l ? (size_t)e->xres * e->yres + tdb_level_offset(e->xres, e->yres, l) : 0;
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, l, 0, 0, slot, w, h, 1, format[t], type[t],
+                                (void *)(start[t] + off * texel[t]));
+            }
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        c->stats.uploads++;
+        c->stats.upload_bytes += bytes;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return intact ? bytes : 0;
+}
+
+// Upload prepared tiles until budget bytes are spent and hand mapped staging
+// buffers back to the workers. Returns the bytes uploaded.
+static size_t tile_cache_pump(struct tile_cache *c, size_t budget) {
+    size_t spent = 0;
+    for (int s = 0; s < TILE_CACHE_STAGING; s++) {
+        struct staging_buffer *sb = &c->staging[s];
+        pthread_mutex_lock(&c->lock);
+        enum staging_state state = sb->state;
+        pthread_mutex_unlock(&c->lock);
+
+        if (state == STAGING_FILLED && spent < budget) {
+            spent += tile_cache_upload(c, sb);
+            state = sb->state;
+        }
+        if (state == STAGING_UNMAPPED) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, sb->pbo);
+            // invalidating lets the driver hand back fresh storage while the
+            // previous upload from this buffer is still in flight
+            sb->ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, c->staging_size,
+                                       GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            if (sb->ptr) {
+                pthread_mutex_lock(&c->lock);
+                sb->state = STAGING_MAPPED;
+                pthread_cond_broadcast(&c->cond);
+                pthread_mutex_unlock(&c->lock);
+            }
+        }
+    }
+    return spent;
+}
+
+// Start a frame: upload within the frame budget. Render thread only.
+void tile_cache_update(struct tile_cache *c) {
+    pthread_mutex_lock(&c->lock);
+    c->frame++;
+    pthread_mutex_unlock(&c->lock);
+    tile_cache_pump(c, c->upload_budget);
+}
+
+// Wait until every queued tile is resident, or cannot become so because all
+// slots hold tiles in use, so what is drawn does not depend on worker timing.
+// Render thread only.
+void tile_cache_settle(struct tile_cache *c) {
+    for (;;) {
+        size_t spent = tile_cache_pump(c, SIZE_MAX);
+        pthread_mutex_lock(&c->lock);
+        int filling = 0, filled = 0;
+        for (int s = 0; s < TILE_CACHE_STAGING; s++) {
+            filling += c->staging[s].state == STAGING_FILLING;
+            filled += c->staging[s].state == STAGING_FILLED;
+        }
+        bool busy = c->num_jobs > 0 || filling > 0 || filled > 0;
+        bool stuck = filling == 0 && filled > 0 && spent == 0;
+        pthread_mutex_unlock(&c->lock);
+        if (!busy || stuck)
+            return;
+        usleep(500);
+    }
+}
+
+int tile_cache_resident(const struct tile_cache *c) {
+    int n = 0;
+    for (int i = 0; i < c->capacity; i++)
+        n += c->slots[i].tile >= 0;
+    return n;
+}
+
+#endif
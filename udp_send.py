@@ -0,0 +1,78 @@
+"""Test sender for synvis network input, see netin.h.
+
+Flies a banked circle and streams position/attitude over UDP, so the
+network path can be exercised without a simulator:
+
+    ./a.out --udp &
+    python udp_send.py --rate 50 --jitter 5
+"""
+
+import argparse
+import math
+import random
+import socket
+import struct
+import time
+
+# "SYNV" layout, see netin.h
+SYNV = struct.Struct("<4sIQ3d3f")
+# X-Plane DATA groups: index plus eight floats
+XPLANE_GROUP = struct.Struct("<i8f")
+
+EARTH_RADIUS = 6378137.0  # m, near enough for a test path
+
+
+def xplane_packet(lat, lon, alt_m, heading, pitch, roll):
+    return (
+        b"DATA\0"
+        + XPLANE_GROUP.pack(17, pitch, roll, heading, heading, 0, 0, 0, 0)
+        + XPLANE_GROUP.pack(20, lat, lon, alt_m / 0.3048, 0, 0, 0, 0, 0)
+    )
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=49003)
+    parser.add_argument("--rate", type=float, default=50, help="packets per second")
+    parser.add_argument("--jitter", type=float, default=0, help="max extra send delay in ms")
+    parser.add_argument("--xplane", action="store_true", help="send X-Plane DATA packets")
+    parser.add_argument("--lat", type=float, default=44.0)
+    parser.add_argument("--lon", type=float, default=-74.0)
+    parser.add_argument("--alt", type=float, default=1500, help="m above the ellipsoid")
+    parser.add_argument("--speed", type=float, default=120, help="m/s")
+    parser.add_argument("--radius", type=float, default=3000, help="m")
+    args = parser.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    start = time.monotonic()
+    omega = args.speed / args.radius
+    bank = math.degrees(math.atan(args.speed * omega / 9.81))
+    seq = 0
+    while True:
+        t = time.monotonic() - start
+        angle = omega * t
+        north = args.radius * math.sin(angle)
+        east = args.radius * (1 - math.cos(angle))
+        lat = args.lat + math.degrees(north / EARTH_RADIUS)
+        lon = args.lon + math.degrees(east / (EARTH_RADIUS * math.cos(math.radians(args.lat))))
+        alt = args.alt + 100 * math.sin(angle * 3)
+        climb = 100 * 3 * omega * math.cos(angle * 3)
+        heading = math.degrees(angle) % 360
+        pitch = math.degrees(math.atan2(climb, args.speed))
+
+        if args.xplane:
+            packet = xplane_packet(lat, lon, alt, heading, pitch, bank)
+        else:
+            packet = SYNV.pack(b"SYNV", seq, time.monotonic_ns(), lat, lon, alt, heading, pitch, bank)
+        if args.jitter:
+            time.sleep(random.uniform(0, args.jitter) / 1000)
+        sock.sendto(packet, (args.host, args.port))
+        seq += 1
+
+        next_send = start + seq / args.rate
+        time.sleep(max(0, next_send - time.monotonic()))
+
+
+if __name__ == "__main__":
+    main()